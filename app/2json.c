@@ -205,6 +205,17 @@ static void zsv_2json_row(void *ctx) {
       jsonwriter_end_array(data->jsw);
     if(obj)
       jsonwriter_end_object(data->jsw);
+
+    if(!data->rows_processed && data->schema == ZSV_JSON_SCHEMA_OBJECT && !data->no_header) {
+      // data cells without a header are not output, so the parser can skip them
+      unsigned *indexes = malloc(cols * sizeof(*indexes));
+      if(indexes) {
+        for(unsigned int i = 0; i < cols; i++)
+          indexes[i] = i;
+        zsv_set_projection(data->parser, indexes, cols);
+        free(indexes);
+      }
+    }
     data->rows_processed++;
   }
   data->current_header = data->headers;
@@ -11,9 +11,12 @@
 #include <zsv/utils/signal.h>
 #include <zsv/utils/arg.h>
 #include <zsv/utils/compiler.h>
+#include <zsv/utils/writer.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
 
 enum zsv_2tsv_status {
   zsv_2tsv_status_ok = 0,
@@ -26,6 +29,8 @@ struct static_buff {
   char *buff; // will be ZSV_2TSV_BUFF_SIZE
   size_t used;
   FILE *stream;
+  size_t (*write)(const void *restrict, size_t size, size_t nitems, void *restrict stream);
+  void *write_stream; // stream, or the file descriptor to write to (see zsv_writer_fd_write())
 };
 
 struct zsv_2tsv_data {
@@ -36,7 +41,7 @@ struct zsv_2tsv_data {
 };
 
 __attribute__((always_inline)) static inline void zsv_2tsv_flush(struct static_buff *b) {
-  fwrite(b->buff, b->used, 1, b->stream);
+  b->write(b->buff, b->used, 1, b->write_stream);
   b->used = 0;
 }
 
@@ -45,7 +50,7 @@ static inline void zsv_2tsv_write(struct static_buff *b, const unsigned char *s,
     if(VERY_UNLIKELY(n + b->used > ZSV_2TSV_BUFF_SIZE)) {
       zsv_2tsv_flush(b);
       if(VERY_UNLIKELY(n > ZSV_2TSV_BUFF_SIZE)) { // n too big, so write directly
-        fwrite(s, n, 1, b->stream);
+        b->write(s, n, 1, b->write_stream);
         return;
       }
     }
@@ -201,6 +206,15 @@ int MAIN(int argc, const char *argv[]) {
 
   if(!data.out.stream)
     data.out.stream = stdout;
+  data.out.write = (size_t (*)(const void *restrict, size_t, size_t, void *restrict))fwrite;
+  data.out.write_stream = data.out.stream;
+#ifndef _WIN32
+  if(data.out.stream == stdout && !isatty(STDOUT_FILENO)) {
+    // bypass stdio, which would copy our buffer again
+    data.out.write = zsv_writer_fd_write;
+    data.out.write_stream = (void *)(intptr_t)STDOUT_FILENO;
+  }
+#endif
 
   struct zsv_opts opts = zsv_get_default_opts();
   opts.row = zsv_2tsv_row;
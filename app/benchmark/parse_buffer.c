@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+/*
+ * Compare parsing data that is already in memory with zsv_parse_string(),
+ * which copies it through the parser's buffer, and zsv_parse_buffer(),
+ * which scans it in place
+ *
+ * Usage: parse_buffer <file> [chunk size]
+ */
+
+#include <zsv.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct data {
+  zsv_parser parser;
+  size_t rows;
+  size_t bytes;
+};
+
+static void row(void *ctx) {
+  struct data *d = ctx;
+  size_t n = zsv_column_count(d->parser);
+  for(size_t i = 0; i < n; i++)
+    d->bytes += zsv_get_cell(d->parser, i).len;
+  d->rows++;
+}
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int run(const char *name, const unsigned char *buff, size_t len, size_t chunk, char zero_copy) {
+  struct data d = { 0 };
+  struct zsv_opts opts = { 0 };
+  opts.row = row;
+  opts.ctx = &d;
+  if(!(d.parser = zsv_new(&opts)))
+    return 1;
+
+  double start = now();
+  enum zsv_status stat = zsv_status_ok;
+  for(size_t offset = 0; stat == zsv_status_ok; ) {
+    size_t n = len - offset > chunk ? chunk : len - offset;
+    if(zero_copy)
+      stat = zsv_parse_buffer(d.parser, buff + offset, n, offset + n == len);
+    else
+      stat = zsv_parse_string(d.parser, buff + offset, n);
+    offset += n;
+    if(offset == len)
+      break;
+  }
+  if(!zero_copy && stat == zsv_status_ok)
+    stat = zsv_finish(d.parser);
+  double elapsed = now() - start;
+  zsv_delete(d.parser);
+
+  if(stat != zsv_status_ok) {
+    fprintf(stderr, "%s: %s\n", name, zsv_parse_status_desc(stat));
+    return 1;
+  }
+  printf("%-18s: %.3f (%zu rows, %zu cell bytes)\n", name, elapsed, d.rows, d.bytes);
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  if(argc < 2) {
+    fprintf(stderr, "Usage: %s <file> [chunk size]\n", argv[0]);
+    return 1;
+  }
+  size_t chunk = argc > 2 ? strtoul(argv[2], NULL, 10) : 0;
+
+  FILE *f = fopen(argv[1], "rb");
+  if(!f) {
+    perror(argv[1]);
+    return 1;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  unsigned char *buff = size > 0 ? malloc(size) : NULL;
+  if(!buff || fread(buff, 1, size, f) != (size_t)size) {
+    fprintf(stderr, "Unable to read %s\n", argv[1]);
+    fclose(f);
+    free(buff);
+    return 1;
+  }
+  fclose(f);
+  if(!chunk)
+    chunk = size;
+
+  int err = run("zsv_parse_string", buff, size, chunk, 0)
+    || run("zsv_parse_buffer", buff, size, chunk, 1);
+  free(buff);
+  return err;
+}
@@ -30,15 +30,22 @@ static int main_help(int argc, const char *argv[]) {
     "  -c,--max-column-count <n>: set the maximum number of columns parsed per row. defaults to 1024",
     "  -r,--max-row-size <n>: set the minimum supported maximum row size. defaults to 64k",
     "  -B,--buff-size <n>: set internal buffer size. defaults to 256k",
+    "  --max-buff-size <n>: grow the buffer as needed up to n bytes, instead of truncating rows that do not fit",
     "  -t,--tab-delim: set column delimiter to tab",
     "  -O,--other-delim <char>: set column delimiter to specified character",
     "  -q,--no-quote: turn off quote handling",
+    "  --sniff: detect the delimiter (comma, tab, pipe or semicolon) and quote handling from the data",
+    "  --structural-index: use the experimental two-stage scanner (may be faster for heavily quoted data)",
+    "  --read-ahead <n>: read up to n buffers ahead of the parser in a separate thread",
     "  -v,--verbose: verbose output",
+    "  --stats: print parser counters and read / scan times to stderr (requires a build with ZSV_STATS=1)",
     "",
     "Commands:",
     "  select: extract rows/columns by name or position and perform other basic and 'cleanup' operations",
     "  sql: run ad-hoc SQL",
     "  count: print the number of rows",
+    "  index: save a row index of a file, for faster access to rows further into the file",
+    "  detect-fixed: guess the column offsets of fixed-width text, for use with select --fixed",
     "  desc: describe each column",
     "  pretty: pretty print for console display",
     "  flatten: flatten a table consisting of N groups of data, each with 1 or",
@@ -53,6 +53,8 @@ CLI_BUILTIN_DECL_STATIC(unregister);
 CLI_BUILTIN_DECL(select);
 CLI_BUILTIN_DECL(desc);
 CLI_BUILTIN_DECL(count);
+CLI_BUILTIN_DECL(index);
+CLI_BUILTIN_DECL(detect_fixed);
 CLI_BUILTIN_DECL(pretty);
 CLI_BUILTIN_DECL(sql);
 CLI_BUILTIN_DECL(flatten);
@@ -79,6 +81,8 @@ struct builtin_cmd builtin_cmds[] = {
   CLI_BUILTIN_CMD(select),
   CLI_BUILTIN_CMD(desc),
   CLI_BUILTIN_CMD(count),
+  CLI_BUILTIN_CMD(index),
+  { .name = "detect-fixed", .main = main_detect_fixed },
   CLI_BUILTIN_CMD(pretty),
   CLI_BUILTIN_CMD(sql),
   CLI_BUILTIN_CMD(flatten),
@@ -323,6 +327,7 @@ static struct zsv_ext_callbacks *zsv_ext_callbacks_init(struct zsv_ext_callbacks
 
     e->ext_parse_all = ext_parse_all;
     e->ext_parser_opts = ext_parser_opts;
+    e->parse_batch = zsv_parse_batch;
   }
   return e;
 }
@@ -31,7 +31,13 @@ static int count_usage() {
     "Usage: count [options]\n"
     "Options:\n"
     " -h, --help            : show usage\n"
-    " [-i, --input] <filename>: use specified file input\n";
+    " [-i, --input] <filename>: use specified file input\n"
+    " -j, --threads <n>     : parse using n threads (0 = one per CPU). Input must be a file\n"
+#ifndef _WIN32
+    " --queue-depth <n>     : read the input file with up to n reads in flight (uses io_uring on Linux)\n"
+    " --direct              : with --queue-depth, bypass the page cache if supported\n"
+#endif
+    ;
   printf("%s\n", usage);
   return 0;
 }
@@ -41,6 +47,14 @@ int MAIN(int argc, const char *argv[]) {
   INIT_CMD_DEFAULT_ARGS();
 
   struct zsv_opts opts = zsv_get_default_opts();
+  unsigned threads = 1;
+  const char *input_path = NULL;
+  struct zsv_index *index = NULL;
+#ifndef _WIN32
+  unsigned queue_depth = 0;
+  char direct = 0;
+  struct zsv_file_reader *reader = NULL;
+#endif
 
   int err = 0;
   for(int i = 1; !err && i < argc; i++) {
@@ -48,17 +62,33 @@ int MAIN(int argc, const char *argv[]) {
     if(!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
       count_usage();
       goto count_done;
-    } if(!strcmp(arg, "-i") || !strcmp(arg, "--input") || *arg != '-') {
+    } else if(!strcmp(arg, "-j") || !strcmp(arg, "--threads")) {
+      if(++i >= argc || *argv[i] < '0' || *argv[i] > '9') {
+        fprintf(stderr, "%s option requires a non-negative integer value\n", arg);
+        err = 1;
+      } else
+        threads = (unsigned)atoi(argv[i]);
+#ifndef _WIN32
+    } else if(!strcmp(arg, "--queue-depth")) {
+      if(++i >= argc || atoi(argv[i]) < 1) {
+        fprintf(stderr, "%s option requires a positive integer value\n", arg);
+        err = 1;
+      } else
+        queue_depth = (unsigned)atoi(argv[i]);
+    } else if(!strcmp(arg, "--direct")) {
+      direct = 1;
+#endif
+    } else if(!strcmp(arg, "-i") || !strcmp(arg, "--input") || *arg != '-') {
       err = 1;
       if((!strcmp(arg, "-i") || !strcmp(arg, "--input")) && ++i >= argc)
         fprintf(stderr, "%s option requires a filename\n", arg);
       else {
-        if(opts.stream)
+        if(input_path)
           fprintf(stderr, "Input may not be specified more than once\n");
-        else if(!(opts.stream = fopen(argv[i], "rb")))
-          fprintf(stderr, "Unable to open for reading: %s\n", argv[i]);
-        else
+        else {
+          input_path = argv[i];
           err = 0;
+        }
       }
     } else {
       fprintf(stderr, "Unrecognized option: %s\n", arg);
@@ -67,31 +97,77 @@ int MAIN(int argc, const char *argv[]) {
   }
 
 #ifdef NO_STDIN
-  if(!opts.stream || opts.stream == stdin) {
+  if(!input_path) {
     fprintf(stderr, "Please specify an input file\n");
     err = 1;
   }
 #endif
 
+#ifndef _WIN32
+  if(!err && (queue_depth || direct)) {
+    if(!input_path || threads != 1) {
+      fprintf(stderr, "--queue-depth and --direct require a file input and a single thread\n");
+      err = 1;
+    } else if(!(reader = zsv_file_reader_new(input_path, queue_depth, opts.buffsize, direct)))
+      err = 1;
+    else {
+      opts.read = zsv_file_reader_read;
+      opts.stream = reader;
+    }
+  }
+#endif
+
+  // the parallel parser reads its input from a stream; otherwise, map the file into memory
+  if(!err && input_path && threads != 1 && !(opts.stream = fopen(input_path, "rb"))) {
+    fprintf(stderr, "Unable to open for reading: %s\n", input_path);
+    err = 1;
+  }
+
   if(!err) {
     opts.row = row;
     opts.ctx = &data;
-    if(!(data.parser = zsv_new(&opts))) {
+    if(opts.read)
+      data.parser = zsv_new(&opts);
+    else if(input_path && threads == 1)
+      data.parser = zsv_new_mmap(input_path, &opts);
+    else
+      data.parser = zsv_new(&opts);
+    if(!data.parser) {
       fprintf(stderr, "Unable to initialize parser");
       err = 1;
     } else {
       enum zsv_status status;
-      while((status = zsv_parse_more(data.parser)) == zsv_status_ok)
-        ;
-      zsv_finish(data.parser);
+      if(threads != 1) {
+        // split the file at indexed rows, if it has an index (see `zsv index`)
+        if(input_path && (index = zsv_index_load(input_path, &opts)))
+          zsv_set_index(data.parser, index);
+        status = zsv_parse_parallel(data.parser, threads);
+      } else {
+        while((status = zsv_parse_more(data.parser)) == zsv_status_ok)
+          ;
+      }
+      if(status == zsv_status_no_more_input)
+        status = zsv_finish(data.parser);
       zsv_delete(data.parser);
-      printf("%zu\n", data.rows  > 0 ? data.rows - 1 : 0);
+      if(status != zsv_status_ok) {
+        // don't print a count of only part of the input
+        fprintf(stderr, "Error: %s\n", zsv_parse_status_desc(status));
+        err = 1;
+      } else
+        printf("%zu\n", data.rows  > 0 ? data.rows - 1 : 0);
     }
   }
 
  count_done:
+#ifndef _WIN32
+  if(reader) {
+    zsv_file_reader_delete(reader);
+    opts.stream = NULL;
+  }
+#endif
   if(opts.stream && opts.stream != stdin)
     fclose(opts.stream);
+  zsv_index_delete(index);
 
   return err;
 }
@@ -520,6 +520,8 @@ static void zsv_desc_execute(struct zsv_desc_data *data) {
   if(!data->max_enum)
     data->max_enum = ZSV_DESC_MAX_ENUM_DEFAULT;
   data->parser = zsv_new(&data->opts);
+  if(data->parser && data->malformed_utf8_replace)
+    zsv_set_malformed_utf8_replace(data->parser, (unsigned char)*data->malformed_utf8_replace);
 
   FILE *input_temp_file = NULL;
 
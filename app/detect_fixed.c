@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <zsv.h>
+#include <zsv/utils/arg.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifndef MAIN
+#define MAIN main
+#endif
+
+static int detect_fixed_usage() {
+  static const char *usage =
+    "Usage: detect-fixed [options] [filename]\n"
+    "Guess the column offsets of fixed-width text, from the byte positions that\n"
+    "are blank on every line, and print them in the form that select --fixed\n"
+    "accepts. A large file is not read in full: instead, blocks spread evenly\n"
+    "across it are sampled. If no filename is given, the start of stdin is used\n"
+    "\n"
+    "Options:\n"
+    " -h, --help            : show usage\n"
+    " -n, --blocks <n>      : number of blocks to sample from a large file. defaults to 16\n"
+    ;
+  printf("%s\n", usage);
+  return 0;
+}
+
+int MAIN(int argc, const char *argv[]) {
+  INIT_CMD_DEFAULT_ARGS();
+
+  struct zsv_opts opts = zsv_get_default_opts();
+  size_t blocks = 0;
+  const char *input_path = NULL;
+
+  int err = 0;
+  for(int i = 1; !err && i < argc; i++) {
+    const char *arg = argv[i];
+    if(!strcmp(arg, "-h") || !strcmp(arg, "--help"))
+      return detect_fixed_usage();
+    else if(!strcmp(arg, "-n") || !strcmp(arg, "--blocks")) {
+      if(++i >= argc || atol(argv[i]) < 1) {
+        fprintf(stderr, "%s option requires a positive integer value\n", arg);
+        err = 1;
+      } else
+        blocks = (size_t)atol(argv[i]);
+    } else if(*arg == '-') {
+      fprintf(stderr, "Unrecognized option: %s\n", arg);
+      err = 1;
+    } else if(input_path) {
+      fprintf(stderr, "Input may not be specified more than once\n");
+      err = 1;
+    } else
+      input_path = arg;
+  }
+  if(err)
+    return err;
+
+  size_t *offsets = calloc(opts.max_columns, sizeof(*offsets));
+  if(!offsets) {
+    fprintf(stderr, "Out of memory!\n");
+    return 1;
+  }
+
+  size_t count;
+  if(input_path)
+    count = zsv_detect_fixed_offsets_file(input_path, blocks, offsets, opts.max_columns);
+  else {
+    unsigned char *buff = malloc(ZSV_DEFAULT_SCANNER_BUFFSIZE);
+    if(!buff) {
+      fprintf(stderr, "Out of memory!\n");
+      free(offsets);
+      return 1;
+    }
+    size_t n = fread(buff, 1, ZSV_DEFAULT_SCANNER_BUFFSIZE, stdin);
+    count = zsv_detect_fixed_offsets(buff, n, offsets, opts.max_columns);
+    free(buff);
+  }
+
+  if(!count) {
+    fprintf(stderr, "No lines to detect columns from\n");
+    err = 1;
+  } else if(count > opts.max_columns) {
+    fprintf(stderr, "Found %zu columns, which exceeds the max column count %u\n", count, opts.max_columns);
+    err = 1;
+  } else {
+    for(size_t i = 0; i < count; i++)
+      printf("%s%zu", i ? "," : "", offsets[i]);
+    printf("\n");
+  }
+  free(offsets);
+  return err;
+}
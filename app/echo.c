@@ -15,14 +15,48 @@
 struct data {
   zsv_parser parser;
   zsv_csv_writer csv_writer;
+  char raw_ok; // the input is comma-delimited, so a row without quotes is valid CSV as-is
 };
 
-static void row(void *ctx) {
-  struct data *data = ctx;
-  unsigned j = zsv_column_count(data->parser);
-  for(unsigned i = 0; i < j; i++) {
-    struct zsv_cell c = zsv_get_cell(data->parser, i);
-    zsv_writer_cell(data->csv_writer, i == 0, c.str, c.len, c.quoted);
+/**
+ * Return non-zero if no cell of the row needed quotes, in which case the row
+ * is stored in the buffer as-is, with its cells in one contiguous block
+ */
+static inline char row_is_raw(const struct zsv_row_batch *batch, size_t r) {
+  for(size_t i = batch->row_starts[r]; i < batch->row_starts[r+1]; i++)
+    if(batch->cell_quoted[i])
+      return 0;
+  return batch->row_starts[r+1] > batch->row_starts[r];
+}
+
+static inline const unsigned char *row_start(const struct zsv_row_batch *batch, size_t r) {
+  return batch->base + batch->cell_offsets[batch->row_starts[r]];
+}
+
+static inline const unsigned char *row_end(const struct zsv_row_batch *batch, size_t r) {
+  size_t last = batch->row_starts[r+1] - 1;
+  return batch->base + batch->cell_offsets[last] + batch->cell_lengths[last];
+}
+
+static void write_batch(struct data *data, const struct zsv_row_batch *batch) {
+  for(size_t r = 0; r < batch->row_count; r++) {
+    if(data->raw_ok && row_is_raw(batch, r)) {
+      // copy the row, and any rows that directly follow it after a single \n, at once
+      const unsigned char *start = row_start(batch, r);
+      const unsigned char *end = row_end(batch, r);
+      while(r + 1 < batch->row_count && *end == '\n' && row_start(batch, r + 1) == end + 1
+            && row_is_raw(batch, r + 1))
+        end = row_end(batch, ++r);
+      zsv_writer_raw_row(data->csv_writer, start, end - start);
+      continue;
+    }
+    size_t first = batch->row_starts[r];
+    for(size_t i = first; i < batch->row_starts[r+1]; i++) {
+      char quoted = batch->cell_quoted[i];
+      // a raw value is already valid CSV, so output it as-is
+      zsv_writer_cell(data->csv_writer, i == first, batch->base + batch->cell_offsets[i],
+                      batch->cell_lengths[i], (quoted & ZSV_PARSER_QUOTE_RAW) ? 0 : quoted);
+    }
   }
 }
 
@@ -31,59 +65,88 @@ static void row(void *ctx) {
 #endif
 
 int MAIN(int argc, const char *argv[]) {
-  FILE *f = NULL;
   struct zsv_csv_writer_options writer_opts = zsv_writer_get_default_opts();
   struct data data = { 0 };
 
   INIT_CMD_DEFAULT_ARGS();
 
+  const char **inputs = calloc(argc, sizeof(*inputs));
+  int input_count = 0;
+  if(!inputs) {
+    fprintf(stderr, "Out of memory!\n");
+    return 1;
+  }
   for(int i = 1; i < argc; i++) {
     if(!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) {
-      fprintf(stdout, "Usage: csv_echo [-b, --with-bom] [filename]\n");
-      fprintf(stdout, "  Reads CSV input and prints CSV output with BOM prefix\n\n");
+      fprintf(stdout, "Usage: csv_echo [-b, --with-bom] [filename...]\n");
+      fprintf(stdout, "  Reads CSV input and prints CSV output with BOM prefix\n");
+      fprintf(stdout, "  Multiple files are read, one after the other, as a single input\n\n");
       fprintf(stdout, "Options:\n");
       fprintf(stdout, "    -b, --with-bom: print byte-order mark\n");
+      fprintf(stdout, "    --async-write: write output from a separate thread\n");
+      fprintf(stdout, "    --write-buff-size <n>: size of the output buffer, in bytes\n");
+      free(inputs);
       return 0;
     } else if(!strcmp(argv[i], "-b") || !strcmp(argv[i], "--with-bom"))
       writer_opts.with_bom = 1;
-    else if(!f) {
-      if(!(f = fopen(argv[i], "rb"))) {
-        fprintf(stderr, "Unable to open %s for writing\n", argv[i]);
+    else if(!strcmp(argv[i], "--async-write"))
+      writer_opts.async = 1;
+    else if(!strcmp(argv[i], "--write-buff-size")) {
+      if(++i >= argc || atol(argv[i]) < 1) {
+        fprintf(stderr, "--write-buff-size requires a positive integer value\n");
+        free(inputs);
         return 1;
       }
-    } else {
-      fprintf(stderr, "Input file specified more than once (second was %s)\n", argv[i]);
-      if(f)
-        fclose(f);
-      return 1;
-    }
+      writer_opts.buffsize = (size_t)atol(argv[i]);
+    } else
+      inputs[input_count++] = argv[i];
   }
 
-  if(!f)
-    f = stdin;
+  FILE *f = stdin;
+  if(input_count && !(f = fopen(inputs[0], "rb"))) {
+    fprintf(stderr, "Unable to open %s for reading\n", inputs[0]);
+    free(inputs);
+    return 1;
+  }
 
+  int err = 0;
   struct zsv_opts opts = zsv_get_default_opts();
-  opts.row = row;
-  opts.ctx = &data;
+  opts.lazy_dequote = 1;
+  data.raw_ok = (!opts.delimiter || opts.delimiter == ',') && !opts.sniff;
 
+  if(writer_opts.stream == stdout)
+    zsv_writer_opts_stdout_fd(&writer_opts);
   if((data.csv_writer = zsv_writer_new(&writer_opts))) {
-    unsigned char writer_buff[64];
-    zsv_writer_set_temp_buff(data.csv_writer, writer_buff, sizeof(writer_buff));
     opts.stream = f;
     if((data.parser = zsv_new(&opts))) {
       zsv_handle_ctrl_c_signal();
-      enum zsv_status status;
-      while(!zsv_signal_interrupted && (status = zsv_parse_more(data.parser)) == zsv_status_ok)
-        ;
-      zsv_finish(data.parser);
+      struct zsv_row_batch batch;
+      for(int i = 0; !err && !zsv_signal_interrupted; ) {
+        enum zsv_status stat = zsv_status_ok;
+        while(!zsv_signal_interrupted && (stat = zsv_parse_batch(data.parser, &batch, 0)) == zsv_status_ok)
+          write_batch(&data, &batch);
+        if(stat != zsv_status_no_more_input || ++i >= input_count)
+          break;
+
+        // continue with the next file, through the same parser
+        FILE *next = fopen(inputs[i], "rb");
+        if(!next) {
+          fprintf(stderr, "Unable to open %s for reading\n", inputs[i]);
+          err = 1;
+        } else if(zsv_next_input(data.parser, next) != zsv_status_ok) {
+          fclose(next);
+          err = 1;
+        } else {
+          fclose(f);
+          f = next;
+        }
+      }
       zsv_delete(data.parser);
     }
     zsv_writer_delete(data.csv_writer);
   }
-  fclose(f);
-  return 0;
-}            
-
-
-
-
+  if(f != stdin)
+    fclose(f);
+  free(inputs);
+  return err;
+}
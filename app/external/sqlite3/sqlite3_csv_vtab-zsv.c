@@ -113,6 +113,10 @@ typedef struct zsvTable {
   struct zsv_vtab_cache header;
   struct zsv_vtab_cache data;
   size_t rowCount;
+  sqlite3_uint64 colUsed;         /* Columns used by the current query (see xBestIndex) */
+  struct zsv_index *index;        /* Row index of the file (see `zsv index`), or NULL */
+  size_t firstRowid;              /* First rowid of the current scan */
+  size_t lastRowid;               /* Last rowid of the current scan, or 0 if none */
 } zsvTable;
 
 struct zsvTable *zsvTable_new() {
@@ -120,6 +124,7 @@ struct zsvTable *zsvTable_new() {
   if(z) {
     memset(z, 0, sizeof(*z));
     z->parser_opts = zsv_get_default_opts();
+    z->colUsed = ~(sqlite3_uint64)0;
     z->header.last = &z->header.rows;
     z->data.last = &z->data.rows;
   }
@@ -191,15 +196,16 @@ static int remove_row_from_cache(struct zsv_vtab_cache *cache) {
 
 static void zsvTable_clear(struct zsvTable *z) {
   while(remove_row_from_cache(&z->data)) ;
-  if(z->parser)
-    zsv_delete(z->parser);
   z->rowCount = 0;
 }
 
 static void zsvTable_delete(struct zsvTable *z) {
   if(z) {
     zsvTable_clear(z);
+    if(z->parser)
+      zsv_delete(z->parser);
     while(remove_row_from_cache(&z->header)) ;
+    zsv_index_delete(z->index);
     sqlite3_free(z->zFilename);
     sqlite3_free(z);
   }
@@ -219,13 +225,36 @@ static struct zsv_cell get_cell_from_cache(struct zsv_vtab_cache *cache, int n)
 /* cache each row of data for use later */
 static void zsv_row_data(void *ctx) {
   zsvTable *t = ctx;
-  add_row_to_cache(t->parser, &t->data, ++t->rowCount);
+  if(++t->rowCount < t->firstRowid || (t->lastRowid && t->rowCount > t->lastRowid))
+    return;
+  add_row_to_cache(t->parser, &t->data, t->rowCount);
+}
+
+/* tell the parser to skip columns that the current query does not use */
+static void zsv_set_projection_from_col_used(zsvTable *t) {
+  size_t count = t->header.rows ? t->header.rows->column_count : 0;
+  if(t->colUsed == ~(sqlite3_uint64)0 || !count) {
+    zsv_set_projection(t->parser, NULL, 0); /* the parser is reused across queries */
+    return;
+  }
+  unsigned *indexes = sqlite3_malloc64(count * sizeof(*indexes));
+  if(indexes) {
+    size_t n = 0;
+    for(size_t i = 0; i < count; i++) {
+      /* bit 63 of colUsed means any column from 63 onwards is used */
+      if((t->colUsed >> (i < 63 ? i : 63)) & 1)
+        indexes[n++] = i;
+    }
+    zsv_set_projection(t->parser, indexes, n);
+    sqlite3_free(indexes);
+  }
 }
 
 static void zsv_row_header(void *ctx) {
   zsvTable *t = ctx;
   if(!t->header.rows)
     add_row_to_cache(t->parser, &t->header, 0);
+  zsv_set_projection_from_col_used(t);
   zsv_set_row_handler(t->parser, zsv_row_data);
 }
 
@@ -309,6 +338,7 @@ static int zsvtabConnect(
   pNew->parser_opts.ctx = pNew;
   if(!(pNew->parser = zsv_new(&pNew->parser_opts)))
     goto zsvtab_connect_oom;
+  pNew->index = zsv_index_load(CSV_FILENAME, &pNew->parser_opts);
 
   pNew->parser_status = zsv_parse_more(pNew->parser);
   if(pNew->parser_status != zsv_status_ok &&
@@ -398,17 +428,42 @@ zsvtab_connect_error:
 }
 
 /*
-** Only a forward full table scan is supported.  xBestIndex is mostly
-** a no-op.  If CSVTEST_FIDX is set, then the presence of equality
-** constraints lowers the estimated cost, which is fiction, but is useful
-** for testing certain kinds of virtual table behavior.
+** Only a forward table scan is supported.  xBestIndex passes the set of
+** columns used by the query to xFilter (as idxStr), so that the parser can
+** skip the others. If the file has an index, a constraint on rowid is also
+** passed (as idxNum), so that the scan can start at, and for equality stop
+** after, the given row
 */
 static int zsvtabBestIndex(
   sqlite3_vtab *tab,
   sqlite3_index_info *pIdxInfo
 ){
-  (void)(tab);
+  zsvTable *pTab = (zsvTable*)tab;
   pIdxInfo->estimatedCost = 1000000;
+  if(pTab->index) {
+    int best = -1;
+    for(int i = 0; i < pIdxInfo->nConstraint; i++) {
+      const struct sqlite3_index_constraint *c = &pIdxInfo->aConstraint[i];
+      if(c->usable && c->iColumn == -1
+         && (c->op == SQLITE_INDEX_CONSTRAINT_EQ || c->op == SQLITE_INDEX_CONSTRAINT_GT
+             || c->op == SQLITE_INDEX_CONSTRAINT_GE)
+         && (best < 0 || c->op == SQLITE_INDEX_CONSTRAINT_EQ))
+        best = i;
+    }
+    if(best >= 0) {
+      /* sqlite still checks the constraint, so the scan may return extra rows */
+      pIdxInfo->aConstraintUsage[best].argvIndex = 1;
+      pIdxInfo->idxNum = pIdxInfo->aConstraint[best].op;
+      if(pIdxInfo->idxNum == SQLITE_INDEX_CONSTRAINT_EQ) {
+        pIdxInfo->estimatedCost = 10;
+        pIdxInfo->estimatedRows = 1;
+        pIdxInfo->idxFlags |= SQLITE_INDEX_SCAN_UNIQUE;
+      } else
+        pIdxInfo->estimatedCost = 500000;
+    }
+  }
+  pIdxInfo->idxStr = sqlite3_mprintf("%llx", (unsigned long long)pIdxInfo->colUsed);
+  pIdxInfo->needToFreeIdxStr = 1;
   return SQLITE_OK;
 }
 
@@ -443,27 +498,70 @@ static int zsvtabClose(sqlite3_vtab_cursor *cur){
 
 
 /*
-** Only a full table scan is supported.  So xFilter simply rewinds to
-** the beginning.
+** Parse until at least one row of the current scan is cached, or the scan
+** is done
+*/
+static void zsvTable_fill(zsvTable *pTab) {
+  while(!pTab->data.rows && pTab->parser_status == zsv_status_ok) {
+    if(pTab->lastRowid && pTab->rowCount >= pTab->lastRowid)
+      pTab->parser_status = zsv_status_no_more_input;
+    else if((pTab->parser_status = zsv_parse_more(pTab->parser)) == zsv_status_no_more_input)
+      zsv_finish(pTab->parser);
+  }
+}
+
+/*
+** xFilter rewinds to the beginning or, given a rowid constraint (see
+** xBestIndex), to the indexed row nearest to the first row that may match
 */
 static int zsvtabFilter(
   sqlite3_vtab_cursor *pVtabCursor,
   int idxNum, const char *idxStr,
   int argc, sqlite3_value **argv
 ){
-  (void)(idxNum);
-  (void)(idxStr);
-  (void)(argc);
-  (void)(argv);
   zsvTable *pTab = (zsvTable*)pVtabCursor->pVtab;
 
   zsvTable_clear(pTab);
-  fseek(pTab->parser_opts.stream, 0, SEEK_SET);
-
-  pTab->parser_opts.row = zsv_row_header;
-  if(!(pTab->parser = zsv_new(&pTab->parser_opts)))
-    return SQLITE_NOMEM;
-  pTab->parser_status = zsv_parse_more(pTab->parser);
+  pTab->colUsed = idxStr ? (sqlite3_uint64)strtoull(idxStr, NULL, 16) : ~(sqlite3_uint64)0;
+  pTab->firstRowid = 1;
+  pTab->lastRowid = 0;
+  if(idxNum && argc > 0) {
+    int type = sqlite3_value_numeric_type(argv[0]);
+    if(type == SQLITE_INTEGER || type == SQLITE_FLOAT) {
+      sqlite3_int64 rowid = sqlite3_value_int64(argv[0]);
+      if(idxNum == SQLITE_INDEX_CONSTRAINT_GT)
+        rowid++;
+      if(idxNum == SQLITE_INDEX_CONSTRAINT_EQ && rowid < 1) {
+        pTab->parser_status = zsv_status_no_more_input; /* no such row */
+        return SQLITE_OK;
+      }
+      if(rowid > 1)
+        pTab->firstRowid = (size_t)rowid;
+      if(idxNum == SQLITE_INDEX_CONSTRAINT_EQ)
+        pTab->lastRowid = pTab->firstRowid;
+    }
+  }
+  /* reuse the parser's buffer and cells array. It is reset before the stream
+     is repositioned, which stops any read-ahead of the previous scan */
+  if(pTab->parser) {
+    if(zsv_reset(pTab->parser, pTab->parser_opts.stream) != zsv_status_ok)
+      return SQLITE_ERROR;
+    fseek(pTab->parser_opts.stream, 0, SEEK_SET);
+    zsv_set_row_handler(pTab->parser, zsv_row_header);
+  } else {
+    fseek(pTab->parser_opts.stream, 0, SEEK_SET);
+    pTab->parser_opts.row = zsv_row_header;
+    if(!(pTab->parser = zsv_new(&pTab->parser_opts)))
+      return SQLITE_NOMEM;
+  }
+  if(pTab->firstRowid > 1 && pTab->index && zsv_set_index(pTab->parser, pTab->index) == zsv_status_ok) {
+    /* the header is file row 0, so each data row's file row is its rowid */
+    size_t row = zsv_index_seek(pTab->parser, pTab->firstRowid);
+    if(row)
+      pTab->rowCount = row - 1;
+  }
+  pTab->parser_status = zsv_status_ok;
+  zsvTable_fill(pTab);
   return SQLITE_OK;
 }
 
@@ -476,11 +574,7 @@ static int zsvtabNext(sqlite3_vtab_cursor *cur){
   zsvTable *pTab = (zsvTable*)cur->pVtab;
 
   remove_row_from_cache(&pTab->data);
-  if(!pTab->data.rows && pTab->parser_status != zsv_status_no_more_input) {
-    pTab->parser_status = zsv_parse_more(pTab->parser);
-    if(pTab->parser_status == zsv_status_no_more_input)
-      zsv_finish(pTab->parser);
-  }
+  zsvTable_fill(pTab);
   return SQLITE_OK;
 }
 
@@ -490,7 +584,7 @@ static int zsvtabNext(sqlite3_vtab_cursor *cur){
 */
 static int zsvtabEof(sqlite3_vtab_cursor *cur){
   zsvTable *pTab = (zsvTable*)cur->pVtab;
-  return !pTab->data.rows && pTab->parser_status == zsv_status_no_more_input;
+  return !pTab->data.rows && pTab->parser_status != zsv_status_ok;
 }
 
 /*
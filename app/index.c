@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <zsv.h>
+#include <zsv/utils/arg.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifndef MAIN
+#define MAIN main
+#endif
+
+static int index_usage() {
+  static const char *usage =
+    "Usage: index [options] <filename>\n"
+    "Save an index of the file's rows as <filename>.zsvidx, so that commands that\n"
+    "read the file can start at any row without parsing the rows before it. The\n"
+    "index is used by select (-D), sql (rowid lookups) and parallel parsing (-j)\n"
+    "as long as the file is unchanged and is parsed with the same delimiter and\n"
+    "quote options\n"
+    "\n"
+    "Options:\n"
+    " -h, --help            : show usage\n"
+    " -n, --interval <n>    : index every nth row. defaults to 1000\n"
+    ;
+  printf("%s\n", usage);
+  return 0;
+}
+
+int MAIN(int argc, const char *argv[]) {
+  INIT_CMD_DEFAULT_ARGS();
+
+  struct zsv_opts opts = zsv_get_default_opts();
+  size_t interval = ZSV_INDEX_INTERVAL_DEFAULT;
+  const char *input_path = NULL;
+
+  int err = 0;
+  for(int i = 1; !err && i < argc; i++) {
+    const char *arg = argv[i];
+    if(!strcmp(arg, "-h") || !strcmp(arg, "--help"))
+      return index_usage();
+    else if(!strcmp(arg, "-n") || !strcmp(arg, "--interval")) {
+      if(++i >= argc || atol(argv[i]) < 1) {
+        fprintf(stderr, "%s option requires a positive integer value\n", arg);
+        err = 1;
+      } else
+        interval = (size_t)atol(argv[i]);
+    } else if(*arg == '-') {
+      fprintf(stderr, "Unrecognized option: %s\n", arg);
+      err = 1;
+    } else if(input_path) {
+      fprintf(stderr, "Input may not be specified more than once\n");
+      err = 1;
+    } else
+      input_path = arg;
+  }
+
+  if(!err && !input_path) {
+    fprintf(stderr, "Please specify an input file\n");
+    err = 1;
+  }
+
+  if(!err && zsv_index_build(input_path, &opts, interval) != zsv_status_ok)
+    err = 1;
+  return err;
+}
@@ -70,10 +70,8 @@ static int jv_print_scalar(jv value, char inside_string, FILE *f, char as_csv) {
     return 1;
   case JV_KIND_NUMBER:
     {
-      char s[64];
-      int n = snprintf(s, sizeof(s), "%lf", jv_number_value(value));
-      if(n > 0 && (size_t) n < sizeof(s))
-        fprintf(f, "%.*s", (int)zsv_strip_trailing_zeros(s, n), s);
+      char s[ZSV_WRITER_NUMBER_MAX];
+      fwrite(s, zsv_writer_format_f64(jv_number_value(value), s), 1, f);
     }
     jv_free(value);
     return 1;
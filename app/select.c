@@ -81,6 +81,9 @@ struct zsv_select_data {
   zsv_parser parser;
   unsigned int errcount;
 
+  const char *input_path;
+  struct zsv_index *index; // see zsv_select_seek()
+
   unsigned int output_col_index; // num of cols printed in current row
   size_t file_row_count;
   size_t header_rows_processed;
@@ -128,6 +131,7 @@ struct zsv_select_data {
   struct {
     size_t *offsets;
     size_t count;
+    size_t record_length;
   } fixed;
 
   unsigned char whitspace_clean_flags;
@@ -144,7 +148,8 @@ struct zsv_select_data {
   unsigned char any_clean:1;
 #define ZSV_SELECT_DISTINCT_MERGE 2
   unsigned char distinct:2; // 1 = ignore subsequent cols, ZSV_SELECT_DISTINCT_MERGE = merge subsequent cols (first non-null value)
-  unsigned char _:5;
+  unsigned char raw_rows:1; // all columns are output in order, and unchanged unless trimmed
+  unsigned char _:4;
 };
 
 enum zsv_select_column_index_selection_type {
@@ -428,8 +433,29 @@ static double demo_random_bw_1_and_100() {
 #endif
 }
 
+// zsv_select_output_raw_row(): copy the row whole if it is output unchanged. return 1 if done
+static char zsv_select_output_raw_row(struct zsv_select_data *data) {
+  if(zsv_column_count(data->parser) != data->output_cols_count)
+    return 0;
+  struct zsv_cell row = zsv_get_row_raw(data->parser);
+  if(!row.str || row.quoted)
+    return 0;
+  if(!data->no_trim_whitespace) {
+    for(unsigned int i = 0; i < data->output_cols_count; i++) {
+      struct zsv_cell cell = zsv_get_cell(data->parser, i);
+      if(cell.len && (isspace(cell.str[0]) || isspace(cell.str[cell.len - 1])))
+        return 0;
+    }
+  }
+  zsv_writer_raw_row(data->csv_writer, row.str, row.len);
+  return 1;
+}
+
 // zsv_select_output_row(): output row data
 static void zsv_select_output_data_row(struct zsv_select_data *data) {
+  if(data->raw_rows && zsv_select_output_raw_row(data))
+    return;
+
   unsigned int cnt = data->output_cols_count;
   char first = 1;
   if(data->prepend_line_number) {
@@ -506,10 +532,43 @@ static void zsv_select_print_header_row(struct zsv_select_data *data) {
   }
 }
 
+// zsv_select_set_projection(): tell the parser to skip columns we will not output
+static int zsv_select_set_projection(struct zsv_select_data *data) {
+  if(data->search_strings) // search checks every column
+    return 0;
+
+  size_t n = 0;
+  for(unsigned int i = 0; i < data->output_cols_count; i++) {
+    n++;
+    for(struct zsv_select_uint_list *ix = data->out2in[i].merge.indexes; ix; ix = ix->next)
+      n++;
+  }
+  unsigned *indexes = calloc(n ? n : 1, sizeof(*indexes));
+  if(!indexes)
+    return zsv_printerr(1, "Out of memory!\n");
+
+  n = 0;
+  for(unsigned int i = 0; i < data->output_cols_count; i++) {
+    indexes[n++] = data->out2in[i].ix;
+    for(struct zsv_select_uint_list *ix = data->out2in[i].merge.indexes; ix; ix = ix->next)
+      indexes[n++] = ix->value;
+  }
+  int err = n && zsv_set_projection(data->parser, indexes, n) != zsv_status_ok;
+  free(indexes);
+  return err;
+}
+
 static void zsv_select_header_finish(struct zsv_select_data *data) {
-  if(zsv_select_set_output_columns(data))
+  if(zsv_select_set_output_columns(data) || zsv_select_set_projection(data))
     data->cancelled = 1;
   else {
+    // trimming is the only cleaning that a row can be checked for cheaply. Malformed
+    // utf8 repaired by the parser leaves no raw row (see zsv_get_row_raw()), so
+    // malformed_utf8_replace is only still set here if select repairs cells itself
+    data->raw_rows = !data->prepend_line_number && data->distinct != ZSV_SELECT_DISTINCT_MERGE
+      && !data->malformed_utf8_replace && !data->clean_white && !data->embedded_lineend;
+    for(unsigned int i = 0; i < data->output_cols_count && data->raw_rows; i++)
+      data->raw_rows = data->out2in[i].ix == i;
     zsv_select_print_header_row(data);
     zsv_set_row_handler(data->parser, zsv_select_data_row);
   }
@@ -571,6 +630,7 @@ const char *zsv_select_usage_msg[] =
    "Options:",
    "  -b, --with-bom : output with BOM",
    "  --fixed <offset1,offset2,offset3>: parse as fixed-width text; use given comma-separated list of positive integers for cell end indexes",
+   "  --record-length <n>: with --fixed, parse as records of n bytes each, with no row delimiter",
 #ifndef ZSV_CLI
    "  -v, --verbose: verbose output",
 #endif
@@ -609,6 +669,8 @@ const char *zsv_select_usage_msg[] =
    "                          defaults to " ZSV_ROW_MAX_SIZE_DEFAULT_S ", min " ZSV_ROW_MAX_SIZE_MIN_S ")",
 #endif
    "  -o <output filename>: name of file to save output to",
+   "  --async-write: write output from a separate thread, so that slow output does not stall parsing",
+   "  --write-buff-size <n>: size of the output buffer, in bytes",
    NULL
   };
 
@@ -617,10 +679,25 @@ static void zsv_select_usage() {
     fprintf(stdout, "%s\n", zsv_select_usage_msg[i]);
 }
 
+// zsv_select_seek(): if the input has an index (see `zsv index`), start at the
+// indexed row nearest to the first data row we will output
+static void zsv_select_seek(struct zsv_select_data *data) {
+  if(!(data->index = zsv_index_load(data->input_path, &data->opts))
+     || zsv_set_index(data->parser, data->index) != zsv_status_ok)
+    return;
+  size_t row = zsv_index_seek(data->parser, data->skip_data_rows + 1);
+  if(row) {
+    data->skip_data_rows -= row - 1;
+    data->data_row_count = row - 1;
+  }
+}
+
 static void zsv_select_cleanup(struct zsv_select_data *data) {
   if(data->opts.stream && data->opts.stream != stdin)
     fclose(data->opts.stream);
 
+  zsv_index_delete(data->index);
+
   zsv_writer_delete(data->csv_writer);
 
   zsv_select_search_str_delete(data->search_strings);
@@ -696,6 +773,11 @@ int MAIN(int argc, const char *argv[]) {
             }
           }
         }
+      } else if(!strcmp(argv[arg_i], "--record-length")) {
+        if(++arg_i >= argc || atol(argv[arg_i]) < 1)
+          err = zsv_printerr(1, "%s option requires a positive integer value", argv[arg_i-1]);
+        else
+          data.fixed.record_length = (size_t)atol(argv[arg_i]);
       } else if(!strcmp(argv[arg_i], "--distinct"))
         data.distinct = 1;
       else if(!strcmp(argv[arg_i], "--merge"))
@@ -709,6 +791,13 @@ int MAIN(int argc, const char *argv[]) {
           err = zsv_printerr(1, "Unable to open for writing: %s", argv[arg_i]);
         else if(data.opts.verbose)
           fprintf(stderr, "Opened %s for write\n", argv[arg_i]);
+      } else if(!strcmp(argv[arg_i], "--async-write"))
+        writer_opts.async = 1;
+      else if(!strcmp(argv[arg_i], "--write-buff-size")) {
+        if(++arg_i >= argc || atol(argv[arg_i]) < 1)
+          err = zsv_printerr(1, "--write-buff-size requires a positive integer value");
+        else
+          writer_opts.buffsize = (size_t)atol(argv[arg_i]);
       } else if(!strcmp(argv[arg_i], "-u") || !strcmp(argv[arg_i], "--malformed-utf8-replacement")) {
         if(++arg_i >= argc)
           err = zsv_printerr(1, "-u option requires parameter");
@@ -805,6 +894,8 @@ int MAIN(int argc, const char *argv[]) {
         err = zsv_printerr(1, "Input file was specified, cannot also read: %s", argv[arg_i]);
       else if(!(data.opts.stream = fopen(argv[arg_i], "rb")))
         err = zsv_printerr(1, "Could not open for reading: %s", argv[arg_i]);
+      else
+        data.input_path = argv[arg_i];
     }
 
     if(data.sample_pct)
@@ -813,6 +904,9 @@ int MAIN(int argc, const char *argv[]) {
     if(data.use_header_indexes && !err)
       err = zsv_select_check_exclusions_are_indexes(&data);
 
+    if(data.fixed.record_length && !data.fixed.count && !err)
+      err = zsv_printerr(1, "--record-length requires --fixed");
+
     if(!data.opts.stream) {
 #ifdef NO_STDIN
       err = zsv_printerr(1, "Please specify an input file");
@@ -829,6 +923,8 @@ int MAIN(int argc, const char *argv[]) {
         data.col_argc = argc - col_index_arg_i;
       }
 
+      if(!writer_opts.stream || writer_opts.stream == stdout)
+        zsv_writer_opts_stdout_fd(&writer_opts);
       data.header_names = calloc(data.opts.max_columns, sizeof(*data.header_names));
       data.out2in = calloc(data.opts.max_columns, sizeof(*data.out2in));
       data.csv_writer = zsv_writer_new(&writer_opts);
@@ -838,6 +934,12 @@ int MAIN(int argc, const char *argv[]) {
         data.opts.insert_header_row = insert_header_row;
         zsv_parser handle = data.parser = zsv_new(&data.opts);
         if(handle) {
+          // malformed utf8 is repaired by the parser, except in fixed-width mode
+          if(data.malformed_utf8_replace && !data.fixed.count) {
+            zsv_set_malformed_utf8_replace(handle, *data.malformed_utf8_replace);
+            data.malformed_utf8_replace = NULL;
+          }
+
           // all done with
           data.any_clean = data.malformed_utf8_replace
             || !data.no_trim_whitespace
@@ -845,14 +947,16 @@ int MAIN(int argc, const char *argv[]) {
             || data.embedded_lineend;
 
           // set to fixed if applicable
-          if(data.fixed.count && zsv_set_fixed_offsets(handle, data.fixed.count,
-                                                       data.fixed.offsets)
-             != zsv_status_ok)
+          if(data.fixed.count && (zsv_set_fixed_offsets(handle, data.fixed.count,
+                                                        data.fixed.offsets) != zsv_status_ok
+                                  || (data.fixed.record_length
+                                      && zsv_set_fixed_record_length(handle, data.fixed.record_length)
+                                      != zsv_status_ok)))
             data.cancelled = 1;
 
-          // create a local csv writer buff quoted values
-          unsigned char writer_buff[512];
-          zsv_writer_set_temp_buff(data.csv_writer, writer_buff, sizeof(writer_buff));
+          if(data.skip_data_rows && data.input_path && !data.fixed.count
+             && !data.skip_rows && data.header_depth == 1 && !insert_header_row)
+            zsv_select_seek(&data);
 
           // process the input data
           zsv_handle_ctrl_c_signal();
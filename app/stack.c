@@ -109,7 +109,8 @@ struct zsv_stack_input_file {
   size_t header_row_end_offset; // location in buff at which the data row begins
   struct zsv_stack_data *ctx;
   unsigned char headers_done:1;
-  unsigned char _:7;
+  unsigned char identity_map:1; // each output column is the input column in the same position
+  unsigned char _:6;
 };
 
 struct zsv_stack_data {
@@ -125,6 +126,7 @@ struct zsv_stack_data {
   int err;
 
   zsv_csv_writer csv_writer;
+  zsv_parser parser; // one parser, reset for each input
 };
 
 static struct zsv_stack_input_file **
@@ -151,13 +153,13 @@ static void zsv_stack_input_files_delete(struct zsv_stack_input_file *list) {
       fclose(e->f);
     if(e->output_column_map)
       free(e->output_column_map);
-    zsv_delete(e->parser);
     free(e);
   }
 }
 
 static void zsv_stack_cleanup(struct zsv_stack_data *data) {
   zsv_stack_input_files_delete(data->inputs);
+  zsv_delete(data->parser);
   zsv_stack_colname_tree_delete(&data->colnames);
   zsv_writer_delete(data->csv_writer);
 }
@@ -218,29 +220,63 @@ static void zsv_stack_header_cell_wrapper(void *ctx, unsigned char *restrict utf
 }
 */
 
+// align the input's columns with the output columns
+static void zsv_stack_map_columns(struct zsv_stack_input_file *input) {
+  struct zsv_stack_data *d = input->ctx;
+  size_t cols_used = zsv_column_count(input->parser);
+  size_t map_size = d->colnames_count + cols_used; // each column adds at most one output column
+  if(!map_size)
+    return;
+  if(!(input->output_column_map = calloc(map_size, sizeof(*input->output_column_map))))
+    d->err = 1;
+  else {
+    input->output_column_map_size = map_size;
+    // assign column indexes to global columns
+    for(unsigned col_ix = 0; col_ix < cols_used; col_ix++) {
+      struct zsv_cell cell = zsv_get_cell_unescaped(input->parser, col_ix);
+      size_t output_ix = zsv_stack_consolidate_header(d, cell.str, cell.len);
+      if(output_ix)
+        input->output_column_map[output_ix - 1] = col_ix + 1;
+    }
+  }
+}
+
 static void zsv_stack_header_row(void *ctx) {
   struct zsv_stack_input_file *input = ctx;
   if(!input->headers_done
      && !zsv_row_is_blank(input->parser)) { // skip any blank leading rows
     input->headers_done = 1;
+    zsv_stack_map_columns(input);
     zsv_abort(input->parser);
   }
 }
 
 static void zsv_stack_data_row(void *ctx) {
   struct zsv_stack_input_file *input = ctx;
+  size_t colnames_count = input->ctx->colnames_count;
   if(!input->headers_done) {
     input->headers_done = 1;
+    input->identity_map = input->output_column_map_size >= colnames_count;
+    for(size_t i = 0; i < colnames_count && input->identity_map; i++)
+      input->identity_map = input->output_column_map[i] == i + 1;
     return;
   }
   if(!zsv_row_is_blank(input->parser)) {
-    size_t colnames_count = input->ctx->colnames_count;
+    if(input->identity_map && zsv_column_count(input->parser) == colnames_count) {
+      // the row is output unchanged, so copy it whole if it is CSV as-is
+      struct zsv_cell row = zsv_get_row_raw(input->parser);
+      if(row.str && !row.quoted) {
+        zsv_writer_raw_row(input->ctx->csv_writer, row.str, row.len);
+        return;
+      }
+    }
     for(unsigned i = 0; i < colnames_count; i++) {
       size_t raw_ix_plus_1;
       if(i < input->output_column_map_size &&
          ((raw_ix_plus_1 = input->output_column_map[i]))) {
         struct zsv_cell cell = zsv_get_cell(input->parser, raw_ix_plus_1 - 1);
-        zsv_writer_cell(input->ctx->csv_writer, !i, cell.str, cell.len, cell.quoted);
+        zsv_writer_cell(input->ctx->csv_writer, !i, cell.str, cell.len,
+                        (cell.quoted & ZSV_PARSER_QUOTE_RAW) ? 0 : cell.quoted);
       } else
         zsv_writer_cell(input->ctx->csv_writer, !i, 0x0, 0, 0);
     }
@@ -306,19 +342,27 @@ int MAIN(int argc, const char *argv[]) {
       }
     }
 
-    // collect all header names so we can line them up
-    unsigned i = 0;
-    for(struct zsv_stack_input_file *input = data.inputs; !data.err && input; input = input->next, i++) {
-      struct zsv_opts opts = zsv_get_default_opts();
-      opts.row = zsv_stack_header_row;
-      opts.ctx = input;
-      opts.delimiter = delimiter;
-
+    // collect all header names so we can line them up. header names of each
+    // input are consolidated into a single list, and output->input column
+    // mappings assigned, as soon as its header row is parsed (see
+    // zsv_stack_map_columns()), so one parser can be reset for each input
+    struct zsv_opts opts = zsv_get_default_opts();
+    opts.row = zsv_stack_header_row;
+    opts.delimiter = delimiter;
+    opts.lazy_dequote = 1; // data cells are only copied to the output (see zsv_stack_data_row())
+    for(struct zsv_stack_input_file *input = data.inputs; !data.err && input; input = input->next) {
        // to do: max_cell_size
-      opts.stream = input->f;
-      if(!(input->parser = zsv_new(&opts)))
+      if(!data.parser) {
+        opts.ctx = input;
+        opts.stream = input->f;
+        if(!(data.parser = zsv_new(&opts)))
+          data.err = 1;
+      } else if(zsv_reset(data.parser, input->f) != zsv_status_ok)
         data.err = 1;
-      else {
+      if(!data.err) {
+        input->parser = data.parser;
+        zsv_set_row_handler(data.parser, zsv_stack_header_row);
+        zsv_set_context(data.parser, input);
         zsv_handle_ctrl_c_signal();
         enum zsv_status status;
         while(!data.err
@@ -328,51 +372,6 @@ int MAIN(int argc, const char *argv[]) {
       }
     }
 
-    // we have read the header row of each input, so:
-    // - consolidate a column header names into a single list
-    // - assign output->input column mappings for each input
-
-    // first, get maximum size of consolidated cols, which is just the sum of the column count
-    // of all inputs
-    size_t max_columns_count = 0;
-    for(struct zsv_stack_input_file *input = data.inputs; !data.err && input; input = input->next)
-      max_columns_count += zsv_column_count(input->parser); // zsv_row_cells_count(input->row);
-
-    // next, for each input, align the input columns with the output columns
-    for(struct zsv_stack_input_file *input = data.inputs; input && !data.err; input = input->next) {
-      if(max_columns_count) {
-        if(!(input->output_column_map = calloc(max_columns_count,
-                                               sizeof(*input->output_column_map))))
-          data.err = 1;
-        else {
-          input->output_column_map_size = max_columns_count;
-          // assign column indexes to global columns
-          size_t cols_used = zsv_column_count(input->parser);
-          for(unsigned col_ix = 0; col_ix < cols_used; col_ix++) {
-            struct zsv_cell cell = zsv_get_cell(input->parser, col_ix);
-            size_t output_ix = zsv_stack_consolidate_header(&data, cell.str, cell.len);
-            if(output_ix)
-              input->output_column_map[output_ix - 1] = col_ix + 1;
-          }
-        }
-      }
-      zsv_delete(input->parser);
-    }
-
-    // not necessary, but free up unused memory by resizing each input's output_column_map
-    for(struct zsv_stack_input_file *input = data.inputs; input && !data.err; input = input->next) {
-      if(!data.colnames_count) {
-        if(input->output_column_map) {
-          free(input->output_column_map);
-          input->output_column_map = NULL;
-        }
-      } else {
-        size_t *resized = realloc(input->output_column_map, data.colnames_count * sizeof(*resized));
-        if(resized)
-          input->output_column_map = resized;
-      }
-    }
-
     // print headers
     for(struct zsv_stack_colname *e = data.first_colname; !data.err && e; e = e->next) {
       const unsigned char *name = e->orig_name ? e->orig_name : e->name ? e->name : (const unsigned char *)"";
@@ -380,27 +379,21 @@ int MAIN(int argc, const char *argv[]) {
     }
 
     // process data
-    for(struct zsv_stack_input_file *input = data.inputs; input && !data.err; input = input->next, i++) {
+    for(struct zsv_stack_input_file *input = data.inputs; input && !data.err; input = input->next) {
       if(input->headers_done) {
-        struct zsv_opts opts = zsv_get_default_opts();
-        opts.row = zsv_stack_data_row;
-        opts.ctx = input;
-        if(delimiter == '\t')
-          opts.delimiter = delimiter;
-
-        rewind(input->f);
         input->headers_done = 0;
-        opts.stream = input->f;
-        if(!(input->parser = zsv_new(&opts)))
+        // reset before rewinding: this stops any read-ahead of the header pass
+        if(zsv_reset(data.parser, input->f) != zsv_status_ok)
           data.err = 1;
         else {
-         enum zsv_status status = zsv_status_ok;
-         while(status == zsv_status_ok && !data.err
-               && (status = zsv_parse_more(input->parser)) == zsv_status_ok)
-           ;
-         zsv_finish(input->parser);
-         zsv_delete(input->parser);
-         input->parser = NULL;
+          rewind(input->f);
+          zsv_set_row_handler(data.parser, zsv_stack_data_row);
+          zsv_set_context(data.parser, input);
+          enum zsv_status status = zsv_status_ok;
+          while(status == zsv_status_ok && !data.err
+                && (status = zsv_parse_more(data.parser)) == zsv_status_ok)
+            ;
+          zsv_finish(data.parser);
         }
       }
     }
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+/*
+ * Print every cell of a file, parsed either from a stream with zsv_parse_more()
+ * or from memory with zsv_parse_buffer() in chunks of a given size, so that the
+ * two can be compared. Each cell is printed as <length>:<bytes>| and each row
+ * ends with a newline
+ *
+ * Usage: parse_buffer <file> [chunk size]
+ *   If no chunk size is given, zsv_parse_more() is used
+ */
+
+#include <zsv.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void row(void *ctx) {
+  zsv_parser parser = ctx;
+  size_t n = zsv_column_count(parser);
+  for(size_t i = 0; i < n; i++) {
+    struct zsv_cell c = zsv_get_cell(parser, i);
+    printf("%zu:", c.len);
+    fwrite(c.str, 1, c.len, stdout);
+    printf("|");
+  }
+  printf("\n");
+}
+
+static enum zsv_status parse_stream(zsv_parser parser) {
+  enum zsv_status stat;
+  while((stat = zsv_parse_more(parser)) == zsv_status_ok)
+    ;
+  if(stat == zsv_status_no_more_input)
+    stat = zsv_finish(parser);
+  return stat;
+}
+
+static enum zsv_status parse_chunks(zsv_parser parser, const unsigned char *buff, size_t len, size_t chunk) {
+  enum zsv_status stat = zsv_status_ok;
+  size_t offset = 0;
+  do {
+    size_t n = len - offset > chunk ? chunk : len - offset;
+    stat = zsv_parse_buffer(parser, buff + offset, n, offset + n == len);
+    offset += n;
+  } while(stat == zsv_status_ok && offset < len);
+  return stat;
+}
+
+int main(int argc, const char *argv[]) {
+  if(argc < 2) {
+    fprintf(stderr, "Usage: %s <file> [chunk size]\n", argv[0]);
+    return 1;
+  }
+  size_t chunk = argc > 2 ? strtoul(argv[2], NULL, 10) : 0;
+
+  FILE *f = fopen(argv[1], "rb");
+  if(!f) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  unsigned char *buff = NULL;
+  size_t len = 0;
+  if(chunk) {
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    len = size > 0 ? (size_t)size : 0;
+    if(!(buff = malloc(len ? len : 1)) || fread(buff, 1, len, f) != len) {
+      fprintf(stderr, "Unable to read %s\n", argv[1]);
+      free(buff);
+      fclose(f);
+      return 1;
+    }
+  }
+
+  struct zsv_opts opts = { 0 };
+  opts.row = row;
+  if(!chunk)
+    opts.stream = f;
+  zsv_parser parser = zsv_new(&opts);
+  if(!parser) {
+    fprintf(stderr, "Unable to initialize parser\n");
+    free(buff);
+    fclose(f);
+    return 1;
+  }
+  zsv_set_context(parser, parser);
+
+  enum zsv_status stat = chunk ? parse_chunks(parser, buff, len, chunk) : parse_stream(parser);
+  zsv_delete(parser);
+  free(buff);
+  fclose(f);
+  if(stat != zsv_status_ok && stat != zsv_status_no_more_input) {
+    fprintf(stderr, "%s\n", zsv_parse_status_desc(stat));
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,19 @@
+#!/bin/sh
+
+# a few short rows, then one row of about 80k with quoted and embedded commas
+echo 'a,b,c'
+echo '1,2,3'
+printf 'x,"'
+i=0;
+while [ $i -lt 4000 ] ; do
+    printf 'aa""bb,cc '
+    i=$(($i+1))
+done
+printf '",'
+i=0;
+while [ $i -lt 4000 ] ; do
+    printf 'dddddddddd'
+    i=$(($i+1))
+done
+echo ''
+echo '4,5,6'
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+/*
+ * Write numbers with zsv_writer_cell_i64(), zsv_writer_cell_f64() and
+ * zsv_writer_cell_zu(), one row per value, each after a label cell
+ *
+ * Usage: writer_numbers [output buffer size]
+ */
+
+#include <zsv/utils/writer.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+int main(int argc, const char *argv[]) {
+  struct zsv_csv_writer_options opts = zsv_writer_get_default_opts();
+  if(argc > 1)
+    opts.buffsize = strtoul(argv[1], NULL, 10);
+  zsv_csv_writer w = zsv_writer_new(&opts);
+  if(!w)
+    return 1;
+
+  static const int64_t i64s[] = { 0, 1, -1, 9, 10, 99, 100, -100, 1234567890123456789LL, INT64_MAX, INT64_MIN };
+  for(size_t i = 0; i < sizeof(i64s) / sizeof(*i64s); i++) {
+    zsv_writer_cell_s(w, 1, (const unsigned char *)"i64", 0);
+    zsv_writer_cell_i64(w, 0, i64s[i]);
+  }
+
+  static const size_t zus[] = { 0, 7, 4294967296ULL };
+  for(size_t i = 0; i < sizeof(zus) / sizeof(*zus); i++) {
+    zsv_writer_cell_s(w, 1, (const unsigned char *)"zu", 0);
+    zsv_writer_cell_zu(w, 0, zus[i]);
+  }
+
+  const double f64s[] = {
+    0.0, -0.0, 1.0, -3.0, 100.0, 1e15, 9007199254740992.0, 18014398509481984.0,
+    0.1, 0.3, 0.1 + 0.2, 1.0 / 3, -2.5, 123.456,
+    1e20, 1e21, 1.5e21, 1e-6, 1e-7, 1.5e-7,
+    5e-324, 2.2250738585072014e-308, 1.7976931348623157e308,
+    INFINITY, -INFINITY, NAN
+  };
+  for(size_t i = 0; i < sizeof(f64s) / sizeof(*f64s); i++) {
+    zsv_writer_cell_s(w, 1, (const unsigned char *)"f64", 0);
+    zsv_writer_cell_f64(w, 0, f64s[i]);
+  }
+
+  zsv_writer_delete(w);
+  return 0;
+}
@@ -102,6 +102,32 @@ int zsv_args_to_opts(int argc, const char *argv[],
     if(argv[i][1] != '-') {
       if(!argv[i][2] && strchr(short_args, argv[i][1]))
         arg = argv[i][1];
+    } else if(!strcmp(argv[i] + 2, "structural-index")) { /* long option only */
+      opts_out->structural_index = 1;
+      continue;
+    } else if(!strcmp(argv[i] + 2, "sniff")) { /* long option only */
+      opts_out->sniff = 1;
+      continue;
+    } else if(!strcmp(argv[i] + 2, "stats")) { /* long option only */
+      opts_out->stats = 1;
+      continue;
+    } else if(!strcmp(argv[i] + 2, "read-ahead")) { /* long option only */
+      if(++i >= argc)
+        err = fprintf(stderr, "Error: option %s requires a value\n", argv[i-1]);
+      else if(atol(argv[i]) < 1)
+        err = fprintf(stderr, "Error: read-ahead may not be less than 1 (got %s)\n", argv[i]);
+      else
+        opts_out->readahead_depth = atol(argv[i]);
+      continue;
+    } else if(!strcmp(argv[i] + 2, "max-buff-size")) { /* long option only */
+      if(++i >= argc)
+        err = fprintf(stderr, "Error: option %s requires a value\n", argv[i-1]);
+      else if(atol(argv[i]) < ZSV_MIN_SCANNER_BUFFSIZE)
+        err = fprintf(stderr, "Error: max buff size may not be less than %u (got %s)\n",
+                      ZSV_MIN_SCANNER_BUFFSIZE, argv[i]);
+      else
+        opts_out->max_buffsize = atol(argv[i]);
+      continue;
     } else
       arg = short_args[str_array_index_of(long_args, argv[i] + 2)];
 
@@ -11,21 +11,7 @@
 #include <ctype.h>
 #include <string.h>
 #include <stdlib.h>
-
-///
-/* return 0 on eof, +1 on error, > 0 if valid utf8 first byte read */
-static inline char UTF8_charLenC_noerr(int c) {
-  char len;
-  if(c == EOF) len = 0;
-  else if(!(c & 128)) len = 1;
-  else if((c & 224) == 192) len = 2; /* 110xxxxx */
-  else if((c & 240) == 224) len = 3; /* 1110xxxx */
-  else if((c & 248) == 240) len = 4; /* 11110xxx */
-  else if((c & 252) == 248) len = 5; /* 111110xx */
-  else if((c & 254) == 252) len = 6; /* 1111110x */
-  else len = 1; // error, but we are going to ignore and just call it a 1-byte char
-  return len;
-}
+#include <stdint.h>
 
 static struct zsv_csv_writer_options zsv_csv_writer_default_opts = { 0 };
 static char zsv_writer_default_opts_initd = 0;
@@ -43,6 +29,31 @@ struct zsv_csv_writer_options zsv_writer_get_default_opts() {
   return zsv_csv_writer_default_opts;
 }
 
+#define ZSV_WRITER_VEC_SIZE 16
+
+/**
+ * Return non-zero if a value must be quoted, i.e. if it contains a comma,
+ * double-quote or row end. All bytes are checked, so that a malformed UTF-8
+ * lead byte cannot hide one of them. The fixed-size loop is vectorized by the
+ * compiler
+ */
+static inline char zsv_csv_needs_quote(const unsigned char *s, size_t len) {
+  size_t i = 0;
+  for(; len - i >= ZSV_WRITER_VEC_SIZE; i += ZSV_WRITER_VEC_SIZE) {
+    unsigned char found = 0;
+    for(int j = 0; j < ZSV_WRITER_VEC_SIZE; j++) {
+      unsigned char c = s[i + j];
+      found |= (c == ',') | (c == '"') | (c == '\n') | (c == '\r');
+    }
+    if(found)
+      return 1;
+  }
+  for(; i < len; i++)
+    if(s[i] == ',' || s[i] == '"' || s[i] == '\n' || s[i] == '\r')
+      return 1;
+  return 0;
+}
+
 // zsv_csv_quote() returns:
 //   NULL if no quoting needed
 //   buff if buff size was large enough to hold result
@@ -51,60 +62,77 @@ struct zsv_csv_writer_options zsv_writer_get_default_opts() {
 unsigned char *zsv_csv_quote(const unsigned char *utf8_value,
                              size_t len,
                              unsigned char *buff, size_t buffsize) {
-  char need = 0;
-  unsigned quotes = 0;
-  char clen;
-  for(unsigned int i = 0; i < len; i+=clen) {
-    if((clen = UTF8_charLenC_noerr(utf8_value[i])) == 1)
-      switch(utf8_value[i]) {
-      case ',':
-      case '\n':
-      case '\r':
-        need = 1;
-        break;
-      case '"':
-        need = 1;
-        quotes++;
-        break;
-      }
-  }
-  if(!need)
+  if(!zsv_csv_needs_quote(utf8_value, len))
     return NULL;
 
+  const unsigned char *end = utf8_value + len;
+  size_t quotes = 0;
+  for(const unsigned char *q = utf8_value; (q = memchr(q, '"', end - q)); q++)
+    quotes++;
+
   unsigned char *target;
-  unsigned mem_length = len + quotes + 3; // str + 2 quotes + terminating null
+  size_t mem_length = len + quotes + 3; // str + 2 quotes + terminating null
   if(mem_length < buffsize)
     target = buff;
   else
     target = malloc(mem_length * sizeof(*target));
 
   if(target) {
-    *target = '"';
-    if(!quotes)
-      memcpy(target + 1, utf8_value, len);
-    else {
-      for(unsigned int i = 0, j = 0; i < len; i+=clen, j += clen) {
-        if(utf8_value[i] == '"')
-          target[++j] = '"';
-        clen = UTF8_charLenC_noerr(utf8_value[i]);
-        if(i + clen > len) // safety in case of invalid utf8 input
-          clen = len - i;
-        memcpy(target + 1 + j, utf8_value + i, clen);
-      }
+    unsigned char *t = target;
+    *t++ = '"';
+    const unsigned char *s = utf8_value;
+    for(const unsigned char *q; (q = memchr(s, '"', end - s)); s = q + 1) {
+      memcpy(t, s, q + 1 - s); // up to and including the quote, which is then doubled
+      t += q + 1 - s;
+      *t++ = '"';
     }
-    target[mem_length - 2] = '"';
-    target[mem_length - 1] = '\0';
+    memcpy(t, s, end - s);
+    t += end - s;
+    *t++ = '"';
+    *t = '\0';
   }
   return target;
 }
 
 #define ZSV_OUTPUT_BUFF_SIZE 65536*4
 
+#ifndef _WIN32
+# define ZSV_WRITER_HAVE_FD
+#endif
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__) && !defined(ZSV_NO_THREADS)
+# define ZSV_WRITER_HAVE_ASYNC
+# include <pthread.h>
+
+/*
+ * Asynchronous output (see zsv_csv_writer_options.async): buffers are filled
+ * in turn, and each full buffer is queued for a writer thread. If all buffers
+ * are queued, the producer waits for the oldest to be written, so at most
+ * ZSV_WRITER_ASYNC_BUFFERS - 1 buffers are pending at any time
+ */
+#define ZSV_WRITER_ASYNC_BUFFERS 3
+
+struct zsv_writer_async {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond; // signaled when a buffer is queued or written, or on exit
+  char *buffs[ZSV_WRITER_ASYNC_BUFFERS];
+  size_t lengths[ZSV_WRITER_ASYNC_BUFFERS];
+  unsigned head;  // oldest queued buffer
+  unsigned count; // number of queued buffers, including one being written
+  char done;
+};
+#endif
+
 struct zsv_output_buff {
-  char *buff; // will be ZSV_OUTPUT_BUFF_SIZE. to do: option to modify buff size
+  char *buff;
+  size_t size; // size of buff
   size_t (*write)(const void *restrict, size_t size, size_t nitems, void *restrict stream);
   void *stream;
   size_t used;
+#ifdef ZSV_WRITER_HAVE_ASYNC
+  struct zsv_writer_async *async; // if non-NULL, full buffers are written by a separate thread
+#endif
 };
 
 struct zsv_writer_data {
@@ -121,19 +149,180 @@ struct zsv_writer_data {
   unsigned char _:6;
 };
 
-#include <unistd.h> // write
+#ifdef ZSV_WRITER_HAVE_FD
+#include <errno.h>
+#include <unistd.h> // write, isatty
+#include <sys/uio.h> // writev
+
+size_t zsv_writer_fd_write(const void *restrict buff, size_t size, size_t nitems, void *restrict stream) {
+  int fd = (int)(intptr_t)stream;
+  const char *s = buff;
+  size_t left = size * nitems;
+  while(left) {
+    ssize_t n = write(fd, s, left);
+    if(n < 0) {
+      if(errno == EINTR)
+        continue;
+      break;
+    }
+    s += n;
+    left -= (size_t)n;
+  }
+  return size ? (size * nitems - left) / size : 0;
+}
+
+/**
+ * Write the buffer followed by s, in one writev(2) call unless it writes
+ * only part of them
+ */
+static void zsv_writer_fd_writev(struct zsv_output_buff *b, const unsigned char *s, size_t n) {
+  int fd = (int)(intptr_t)b->stream;
+  struct iovec iov[2] = { { b->buff, b->used }, { (void *)s, n } };
+  ssize_t written;
+  while((written = writev(fd, iov, 2)) < 0 && errno == EINTR)
+    ;
+  size_t done = written > 0 ? (size_t)written : 0;
+  if(done < b->used) {
+    zsv_writer_fd_write(b->buff + done, b->used - done, 1, b->stream);
+    done = b->used;
+  }
+  if(done - b->used < n)
+    zsv_writer_fd_write(s + (done - b->used), n - (done - b->used), 1, b->stream);
+  b->used = 0;
+}
+#endif
+
+#ifdef ZSV_WRITER_HAVE_ASYNC
+static void *zsv_writer_async_main(void *ctx) {
+  struct zsv_output_buff *b = ctx;
+  struct zsv_writer_async *a = b->async;
+  pthread_mutex_lock(&a->mutex);
+  for(;;) {
+    while(!a->count && !a->done)
+      pthread_cond_wait(&a->cond, &a->mutex);
+    if(!a->count)
+      break;
+    unsigned i = a->head;
+    pthread_mutex_unlock(&a->mutex);
+    b->write(a->buffs[i], a->lengths[i], 1, b->stream);
+    pthread_mutex_lock(&a->mutex);
+    a->head = (i + 1) % ZSV_WRITER_ASYNC_BUFFERS;
+    a->count--;
+    pthread_cond_broadcast(&a->cond);
+  }
+  pthread_mutex_unlock(&a->mutex);
+  return NULL;
+}
 
+/**
+ * Queue the current buffer to be written, and continue with the next one once
+ * it is free. If wait_all is set, also wait until all queued buffers are written
+ */
+static void zsv_writer_async_submit(struct zsv_output_buff *b, char wait_all) {
+  struct zsv_writer_async *a = b->async;
+  pthread_mutex_lock(&a->mutex);
+  if(b->used) {
+    unsigned i = (a->head + a->count) % ZSV_WRITER_ASYNC_BUFFERS;
+    a->lengths[i] = b->used;
+    a->count++;
+    pthread_cond_broadcast(&a->cond);
+    b->used = 0;
+  }
+  while(a->count == ZSV_WRITER_ASYNC_BUFFERS || (wait_all && a->count))
+    pthread_cond_wait(&a->cond, &a->mutex);
+  b->buff = a->buffs[(a->head + a->count) % ZSV_WRITER_ASYNC_BUFFERS];
+  pthread_mutex_unlock(&a->mutex);
+}
+
+/**
+ * Start the writer thread. Return 0 on success, in which case b->buff is
+ * owned by the queue
+ */
+static int zsv_writer_async_new(struct zsv_output_buff *b) {
+  struct zsv_writer_async *a = calloc(1, sizeof(*a));
+  if(!a)
+    return 1;
+  a->buffs[0] = b->buff;
+  for(unsigned i = 1; i < ZSV_WRITER_ASYNC_BUFFERS; i++) {
+    if(!(a->buffs[i] = malloc(b->size))) {
+      while(--i)
+        free(a->buffs[i]);
+      free(a);
+      return 1;
+    }
+  }
+  pthread_mutex_init(&a->mutex, NULL);
+  pthread_cond_init(&a->cond, NULL);
+  b->async = a;
+  if(pthread_create(&a->thread, NULL, zsv_writer_async_main, b)) {
+    b->async = NULL;
+    pthread_mutex_destroy(&a->mutex);
+    pthread_cond_destroy(&a->cond);
+    for(unsigned i = 1; i < ZSV_WRITER_ASYNC_BUFFERS; i++)
+      free(a->buffs[i]);
+    free(a);
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * Write any remaining output, stop the writer thread and free its buffers
+ */
+static void zsv_writer_async_delete(struct zsv_output_buff *b) {
+  struct zsv_writer_async *a = b->async;
+  zsv_writer_async_submit(b, 1);
+  pthread_mutex_lock(&a->mutex);
+  a->done = 1;
+  pthread_cond_broadcast(&a->cond);
+  pthread_mutex_unlock(&a->mutex);
+  pthread_join(a->thread, NULL);
+  pthread_mutex_destroy(&a->mutex);
+  pthread_cond_destroy(&a->cond);
+  for(unsigned i = 0; i < ZSV_WRITER_ASYNC_BUFFERS; i++)
+    free(a->buffs[i]);
+  free(a);
+  b->async = NULL;
+  b->buff = NULL;
+}
+#endif
 
 static inline void zsv_output_buff_flush(struct zsv_output_buff *b) {
+#ifdef ZSV_WRITER_HAVE_ASYNC
+  if(b->async) {
+    zsv_writer_async_submit(b, 0);
+    return;
+  }
+#endif
   b->write(b->buff, b->used, 1, b->stream);
   b->used = 0;
 }
 
 static inline void zsv_output_buff_write(struct zsv_output_buff *b, const unsigned char *s, size_t n) {
   if(n) {
-    if(n + b->used > ZSV_OUTPUT_BUFF_SIZE) {
+    if(n + b->used > b->size) {
+#ifdef ZSV_WRITER_HAVE_FD
+      if(n > b->size && b->write == zsv_writer_fd_write
+# ifdef ZSV_WRITER_HAVE_ASYNC
+         && !b->async
+# endif
+         ) { // n too big, so write it directly, after the buffer, in one call
+        zsv_writer_fd_writev(b, s, n);
+        return;
+      }
+#endif
       zsv_output_buff_flush(b);
-      if(n > ZSV_OUTPUT_BUFF_SIZE) { // n too big, so write directly
+#ifdef ZSV_WRITER_HAVE_ASYNC
+      if(b->async) {
+        // output must stay in order, so copy a large value through the queue
+        for(; n > b->size; s += b->size, n -= b->size) {
+          memcpy(b->buff, s, b->size);
+          b->used = b->size;
+          zsv_output_buff_flush(b);
+        }
+      } else
+#endif
+      if(n > b->size) { // n too big, so write directly
         b->write(s, n, 1, b->stream);
         return;
       }
@@ -144,24 +333,60 @@ static inline void zsv_output_buff_write(struct zsv_output_buff *b, const unsign
   }
 }
 
+/**
+ * Write a value in double-quotes, doubling any double-quotes in it, straight
+ * into the output buffer
+ */
+static inline void zsv_output_buff_write_quoted(struct zsv_output_buff *b, const unsigned char *s, size_t n) {
+  const unsigned char *end = s + n;
+  zsv_output_buff_write(b, (const unsigned char *)"\"", 1);
+  for(const unsigned char *q; (q = memchr(s, '"', end - s)); s = q + 1) {
+    zsv_output_buff_write(b, s, q + 1 - s);
+    zsv_output_buff_write(b, (const unsigned char *)"\"", 1);
+  }
+  zsv_output_buff_write(b, s, end - s);
+  zsv_output_buff_write(b, (const unsigned char *)"\"", 1);
+}
+
 void zsv_writer_set_temp_buff(zsv_csv_writer w, unsigned char *buff,
                                 size_t buffsize) {
   w->buff = buff;
   w->buffsize = buffsize;
 }
 
+char zsv_writer_opts_stdout_fd(struct zsv_csv_writer_options *opts) {
+#ifdef ZSV_WRITER_HAVE_FD
+  if(!isatty(STDOUT_FILENO)) {
+    fflush(stdout); // anything already written with stdio comes first
+    opts->use_fd = 1;
+    opts->fd = STDOUT_FILENO;
+    return 1;
+  }
+#else
+  (void)opts;
+#endif
+  return 0;
+}
+
 zsv_csv_writer zsv_writer_new(struct zsv_csv_writer_options *opts) {
   struct zsv_writer_data *w = calloc(1, sizeof(*w));
   if(w) {
-    if(!(w->out.buff = malloc(ZSV_OUTPUT_BUFF_SIZE))) {
+    w->out.size = opts && opts->buffsize ? opts->buffsize : ZSV_OUTPUT_BUFF_SIZE;
+    if(!(w->out.buff = malloc(w->out.size))) {
       free(w); // out of memory!
-      return w;
+      return NULL;
     }
 
     if(!opts) {
       w->out.write = (size_t (*)(const void * restrict,  size_t,  size_t,  void * restrict))fwrite;
       w->out.stream = stdout;
     } else {
+#ifdef ZSV_WRITER_HAVE_FD
+      if(opts->use_fd) {
+        w->out.write = zsv_writer_fd_write;
+        w->out.stream = (void *)(intptr_t)opts->fd;
+      } else
+#endif
       if(opts->write) {
         w->out.write = opts->write;
         w->out.stream = opts->stream;
@@ -173,6 +398,10 @@ zsv_csv_writer zsv_writer_new(struct zsv_csv_writer_options *opts) {
       w->with_bom = opts->with_bom;
       w->table_init = opts->table_init;
       w->table_init_ctx = opts->table_init_ctx;
+#ifdef ZSV_WRITER_HAVE_ASYNC
+      if(opts->async && zsv_writer_async_new(&w->out))
+        fprintf(stderr, "Unable to start writer thread; writing synchronously\n");
+#endif
     }
   }
   return w;
@@ -180,6 +409,13 @@ zsv_csv_writer zsv_writer_new(struct zsv_csv_writer_options *opts) {
 
 enum zsv_writer_status zsv_writer_flush(zsv_csv_writer w) {
   if(!w) return zsv_writer_status_missing_handle;
+#ifdef ZSV_WRITER_HAVE_ASYNC
+  if(w->out.async) {
+    // as when synchronous, all output is written on return
+    zsv_writer_async_submit(&w->out, 1);
+    return zsv_writer_status_ok;
+  }
+#endif
   zsv_output_buff_flush(&w->out);
   return zsv_writer_status_ok;
 }
@@ -187,6 +423,11 @@ enum zsv_writer_status zsv_writer_flush(zsv_csv_writer w) {
 enum zsv_writer_status zsv_writer_delete(zsv_csv_writer w) {
   if(!w) return zsv_writer_status_missing_handle;
 
+#ifdef ZSV_WRITER_HAVE_ASYNC
+  if(w->out.async)
+    zsv_writer_async_delete(&w->out);
+  else
+#endif
   zsv_output_buff_flush(&w->out);
   if(w->started)
     w->out.write("\n", 1, 1, w->out.stream);
@@ -197,37 +438,362 @@ enum zsv_writer_status zsv_writer_delete(zsv_csv_writer w) {
   return zsv_writer_status_ok;
 }
 
+static inline void zsv_writer_start(struct zsv_writer_data *w) {
+  if(w->table_init)
+    w->table_init(w->table_init_ctx);
+  if(w->with_bom)
+    zsv_output_buff_write(&w->out, (const unsigned char *)"\xef\xbb\xbf", 3);
+  w->started = 1;
+}
+
+static inline void zsv_writer_cell_start(struct zsv_writer_data *w, char new_row) {
+  if(!w->started)
+    zsv_writer_start(w);
+  else if(new_row)
+    zsv_output_buff_write(&w->out, (const unsigned char *)"\n", 1);
+  else
+    zsv_output_buff_write(&w->out, (const unsigned char *)",", 1);
+}
+
 enum zsv_writer_status zsv_writer_cell(zsv_csv_writer w, char new_row,
                                            const unsigned char *s, size_t len,
                                            char check_if_needs_quoting) {
   if(!w) return zsv_writer_status_missing_handle;
-  if(!w->started) {
-    if(w->table_init)
-      w->table_init(w->table_init_ctx);
-    if(w->with_bom)
-      zsv_output_buff_write(&w->out, (const unsigned char *)"\xef\xbb\xbf", 3);
-    w->started = 1;
-  } else if(new_row)
-    zsv_output_buff_write(&w->out, (const unsigned char *)"\n", 1);
-  else
-    zsv_output_buff_write(&w->out, (const unsigned char *)",", 1);
+  zsv_writer_cell_start(w, new_row);
 
   if(len) {
-    if(check_if_needs_quoting) {
-      unsigned char *quoted_s = zsv_csv_quote(s, len, w->buff, w->buffsize);
-      if(!quoted_s)
-        zsv_output_buff_write(&w->out, s, len);
-      else {
-        zsv_output_buff_write(&w->out, quoted_s, strlen((char *)quoted_s));
-        if(!(w->buff && quoted_s == w->buff))
-          free(quoted_s);
-      }
-    } else
+    if(check_if_needs_quoting && zsv_csv_needs_quote(s, len))
+      zsv_output_buff_write_quoted(&w->out, s, len);
+    else
       zsv_output_buff_write(&w->out, s, len);
   }
   return zsv_writer_status_ok;
 }
 
+enum zsv_writer_status zsv_writer_raw_row(zsv_csv_writer w, const unsigned char *s, size_t len) {
+  if(!w) return zsv_writer_status_missing_handle;
+  if(!w->started)
+    zsv_writer_start(w);
+  else
+    zsv_output_buff_write(&w->out, (const unsigned char *)"\n", 1);
+  zsv_output_buff_write(&w->out, s, len);
+  return zsv_writer_status_ok;
+}
+
+/*
+ * Number formatting
+ *
+ * Integers are written two digits at a time, from a table. Doubles are
+ * written with the fewest digits that read back as the same value, using
+ * Grisu2 (Loitsch, "Printing Floating-Point Numbers Quickly and Accurately
+ * with Integers", 2010), which needs only 64-bit integer arithmetic. In rare
+ * cases, Grisu2 may produce one more digit than the shortest, but its output
+ * always reads back as the same value
+ */
+
+static const char zsv_writer_digit_pairs[201] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+static size_t zsv_writer_format_u64(uint64_t u, char *buff) {
+  char s[20];
+  char *end = s + sizeof(s);
+  char *p = end;
+  while(u >= 100) {
+    unsigned i = (unsigned)(u % 100) * 2;
+    u /= 100;
+    p -= 2;
+    memcpy(p, zsv_writer_digit_pairs + i, 2);
+  }
+  if(u >= 10) {
+    p -= 2;
+    memcpy(p, zsv_writer_digit_pairs + u * 2, 2);
+  } else
+    *--p = (char)('0' + u);
+  memcpy(buff, p, end - p);
+  return end - p;
+}
+
+size_t zsv_writer_format_i64(int64_t i, char *buff) {
+  if(i < 0) {
+    *buff = '-';
+    return 1 + zsv_writer_format_u64(0 - (uint64_t)i, buff + 1);
+  }
+  return zsv_writer_format_u64((uint64_t)i, buff);
+}
+
+// a floating-point value f * 2^e, with a 64-bit significand
+struct zsv_diyfp {
+  uint64_t f;
+  int e;
+};
+
+static inline struct zsv_diyfp zsv_diyfp_mul(struct zsv_diyfp x, struct zsv_diyfp y) {
+  // upper 64 bits of the 128-bit product, rounded
+  uint64_t a = x.f >> 32, b = x.f & 0xFFFFFFFF, c = y.f >> 32, d = y.f & 0xFFFFFFFF;
+  uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+  uint64_t mid = (bd >> 32) + (ad & 0xFFFFFFFF) + (bc & 0xFFFFFFFF) + (1U << 31);
+  struct zsv_diyfp r = { ac + (ad >> 32) + (bc >> 32) + (mid >> 32), x.e + y.e + 64 };
+  return r;
+}
+
+static inline struct zsv_diyfp zsv_diyfp_normalize(struct zsv_diyfp x) {
+  while(!(x.f >> 63)) {
+    x.f <<= 1;
+    x.e--;
+  }
+  return x;
+}
+
+// 10^k as a normalized diyfp, for k = -300, -292, ..., 340
+static const struct {
+  uint64_t f;
+  int e;
+  int k;
+} zsv_grisu_cached_powers[] = {
+  { 0xAB70FE17C79AC6CA, -1060, -300 },
+  { 0xFF77B1FCBEBCDC4F, -1034, -292 },
+  { 0xBE5691EF416BD60C, -1007, -284 },
+  { 0x8DD01FAD907FFC3C, -980, -276 },
+  { 0xD3515C2831559A83, -954, -268 },
+  { 0x9D71AC8FADA6C9B5, -927, -260 },
+  { 0xEA9C227723EE8BCB, -901, -252 },
+  { 0xAECC49914078536D, -874, -244 },
+  { 0x823C12795DB6CE57, -847, -236 },
+  { 0xC21094364DFB5637, -821, -228 },
+  { 0x9096EA6F3848984F, -794, -220 },
+  { 0xD77485CB25823AC7, -768, -212 },
+  { 0xA086CFCD97BF97F4, -741, -204 },
+  { 0xEF340A98172AACE5, -715, -196 },
+  { 0xB23867FB2A35B28E, -688, -188 },
+  { 0x84C8D4DFD2C63F3B, -661, -180 },
+  { 0xC5DD44271AD3CDBA, -635, -172 },
+  { 0x936B9FCEBB25C996, -608, -164 },
+  { 0xDBAC6C247D62A584, -582, -156 },
+  { 0xA3AB66580D5FDAF6, -555, -148 },
+  { 0xF3E2F893DEC3F126, -529, -140 },
+  { 0xB5B5ADA8AAFF80B8, -502, -132 },
+  { 0x87625F056C7C4A8B, -475, -124 },
+  { 0xC9BCFF6034C13053, -449, -116 },
+  { 0x964E858C91BA2655, -422, -108 },
+  { 0xDFF9772470297EBD, -396, -100 },
+  { 0xA6DFBD9FB8E5B88F, -369, -92 },
+  { 0xF8A95FCF88747D94, -343, -84 },
+  { 0xB94470938FA89BCF, -316, -76 },
+  { 0x8A08F0F8BF0F156B, -289, -68 },
+  { 0xCDB02555653131B6, -263, -60 },
+  { 0x993FE2C6D07B7FAC, -236, -52 },
+  { 0xE45C10C42A2B3B06, -210, -44 },
+  { 0xAA242499697392D3, -183, -36 },
+  { 0xFD87B5F28300CA0E, -157, -28 },
+  { 0xBCE5086492111AEB, -130, -20 },
+  { 0x8CBCCC096F5088CC, -103, -12 },
+  { 0xD1B71758E219652C, -77, -4 },
+  { 0x9C40000000000000, -50, 4 },
+  { 0xE8D4A51000000000, -24, 12 },
+  { 0xAD78EBC5AC620000, 3, 20 },
+  { 0x813F3978F8940984, 30, 28 },
+  { 0xC097CE7BC90715B3, 56, 36 },
+  { 0x8F7E32CE7BEA5C70, 83, 44 },
+  { 0xD5D238A4ABE98068, 109, 52 },
+  { 0x9F4F2726179A2245, 136, 60 },
+  { 0xED63A231D4C4FB27, 162, 68 },
+  { 0xB0DE65388CC8ADA8, 189, 76 },
+  { 0x83C7088E1AAB65DB, 216, 84 },
+  { 0xC45D1DF942711D9A, 242, 92 },
+  { 0x924D692CA61BE758, 269, 100 },
+  { 0xDA01EE641A708DEA, 295, 108 },
+  { 0xA26DA3999AEF774A, 322, 116 },
+  { 0xF209787BB47D6B85, 348, 124 },
+  { 0xB454E4A179DD1877, 375, 132 },
+  { 0x865B86925B9BC5C2, 402, 140 },
+  { 0xC83553C5C8965D3D, 428, 148 },
+  { 0x952AB45CFA97A0B3, 455, 156 },
+  { 0xDE469FBD99A05FE3, 481, 164 },
+  { 0xA59BC234DB398C25, 508, 172 },
+  { 0xF6C69A72A3989F5C, 534, 180 },
+  { 0xB7DCBF5354E9BECE, 561, 188 },
+  { 0x88FCF317F22241E2, 588, 196 },
+  { 0xCC20CE9BD35C78A5, 614, 204 },
+  { 0x98165AF37B2153DF, 641, 212 },
+  { 0xE2A0B5DC971F303A, 667, 220 },
+  { 0xA8D9D1535CE3B396, 694, 228 },
+  { 0xFB9B7CD9A4A7443C, 720, 236 },
+  { 0xBB764C4CA7A44410, 747, 244 },
+  { 0x8BAB8EEFB6409C1A, 774, 252 },
+  { 0xD01FEF10A657842C, 800, 260 },
+  { 0x9B10A4E5E9913129, 827, 268 },
+  { 0xE7109BFBA19C0C9D, 853, 276 },
+  { 0xAC2820D9623BF429, 880, 284 },
+  { 0x80444B5E7AA7CF85, 907, 292 },
+  { 0xBF21E44003ACDD2D, 933, 300 },
+  { 0x8E679C2F5E44FF8F, 960, 308 },
+  { 0xD433179D9C8CB841, 986, 316 },
+  { 0x9E19DB92B4E31BA9, 1013, 324 },
+  { 0xEB96BF6EBADF77D9, 1039, 332 },
+  { 0xAF87023B9BF0EE6B, 1066, 340 },
+};
+
+#define ZSV_GRISU_MIN_DEC_EXP -300
+#define ZSV_GRISU_DEC_EXP_STEP 8
+#define ZSV_GRISU_ALPHA -60
+#define ZSV_GRISU_GAMMA -32
+
+/**
+ * Move the last digit of buff towards the value w, which is dist below the
+ * upper bound of the digits, while the digits stay within the bounds
+ */
+static inline void zsv_grisu_round(char *buff, size_t len, uint64_t dist, uint64_t delta,
+                                   uint64_t rest, uint64_t ten_k) {
+  while(rest < dist && delta - rest >= ten_k
+        && (rest + ten_k < dist || dist - rest > rest + ten_k - dist)) {
+    buff[len - 1]--;
+    rest += ten_k;
+  }
+}
+
+/**
+ * Write the decimal digits of a positive, finite double to buff
+ * @return the number of digits; the value is digits * 10^(*exp10)
+ */
+static size_t zsv_grisu2(double value, char *buff, int *exp10) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint64_t F = bits & ((1ULL << 52) - 1);
+  int E = (int)(bits >> 52) & 0x7FF;
+  struct zsv_diyfp v = { F, 1 - 1075 };
+  if(E) {
+    v.f = F + (1ULL << 52);
+    v.e = E - 1075;
+  }
+
+  // the bounds halfway to the neighboring doubles
+  struct zsv_diyfp m_plus = { 2 * v.f + 1, v.e - 1 };
+  struct zsv_diyfp m_minus = { 2 * v.f - 1, v.e - 1 };
+  if(F == 0 && E > 1) { // the lower neighbor is closer
+    m_minus.f = 4 * v.f - 1;
+    m_minus.e = v.e - 2;
+  }
+  m_plus = zsv_diyfp_normalize(m_plus);
+  m_minus.f <<= m_minus.e - m_plus.e;
+  m_minus.e = m_plus.e;
+  v = zsv_diyfp_normalize(v);
+
+  // scale by a cached power of ten so the exponent is in [alpha, gamma]
+  int f = ZSV_GRISU_ALPHA - m_plus.e - 1;
+  int k = (f * 78913) / (1 << 18) + (f > 0); // ceil(f * log10(2))
+  int index = (-ZSV_GRISU_MIN_DEC_EXP + k + (ZSV_GRISU_DEC_EXP_STEP - 1)) / ZSV_GRISU_DEC_EXP_STEP;
+  struct zsv_diyfp c = { zsv_grisu_cached_powers[index].f, zsv_grisu_cached_powers[index].e };
+  *exp10 = -zsv_grisu_cached_powers[index].k;
+
+  struct zsv_diyfp w = zsv_diyfp_mul(v, c);
+  struct zsv_diyfp w_minus = zsv_diyfp_mul(m_minus, c);
+  struct zsv_diyfp w_plus = zsv_diyfp_mul(m_plus, c);
+  // narrow the bounds by one unit to allow for the error of the products
+  uint64_t upper = w_plus.f - 1;
+  uint64_t delta = upper - (w_minus.f + 1);
+  uint64_t dist = upper - w.f;
+
+  // generate digits of the upper bound until they are within delta of it
+  int shift = -w_plus.e;
+  uint64_t one = 1ULL << shift;
+  uint32_t p1 = (uint32_t)(upper >> shift);
+  uint64_t p2 = upper & (one - 1);
+
+  uint32_t pow10 = 1;
+  int n = 1;
+  while(n < 10 && p1 >= pow10 * 10) {
+    pow10 *= 10;
+    n++;
+  }
+
+  size_t len = 0;
+  while(n > 0) {
+    buff[len++] = (char)('0' + p1 / pow10);
+    p1 %= pow10;
+    n--;
+    uint64_t rest = ((uint64_t)p1 << shift) + p2;
+    if(rest <= delta) {
+      *exp10 += n;
+      zsv_grisu_round(buff, len, dist, delta, rest, (uint64_t)pow10 << shift);
+      return len;
+    }
+    pow10 /= 10;
+  }
+  int m = 0;
+  do {
+    p2 *= 10;
+    buff[len++] = (char)('0' + (p2 >> shift));
+    p2 &= one - 1;
+    m++;
+    delta *= 10;
+    dist *= 10;
+  } while(p2 > delta);
+  *exp10 -= m;
+  zsv_grisu_round(buff, len, dist, delta, p2, one);
+  return len;
+}
+
+size_t zsv_writer_format_f64(double d, char *buff) {
+  char *s = buff;
+  if(d != d) {
+    memcpy(s, "nan", 3);
+    return 3;
+  }
+  if(d < 0 || (d == 0 && 1 / d < 0)) {
+    *s++ = '-';
+    d = -d;
+  }
+  if(d == 0) {
+    *s++ = '0';
+    return s - buff;
+  }
+  if(d > 1.7976931348623157e308) {
+    memcpy(s, "inf", 3);
+    return s + 3 - buff;
+  }
+  if(d < 9007199254740992.0 && d == (double)(uint64_t)d) // integer that is exact
+    return s + zsv_writer_format_u64((uint64_t)d, s) - buff;
+
+  int exp10;
+  size_t len = zsv_grisu2(d, s, &exp10);
+  int n = (int)len + exp10; // 10^(n-1) <= d < 10^n
+
+  // fixed notation from 1e-6 up to 1e21, as in JavaScript; otherwise exponential
+  if((int)len <= n && n <= 21) { // digits000
+    memset(s + len, '0', n - len);
+    return s + n - buff;
+  }
+  if(0 < n && n <= 21) { // dig.its
+    memmove(s + n + 1, s + n, len - n);
+    s[n] = '.';
+    return s + len + 1 - buff;
+  }
+  if(-6 < n && n <= 0) { // 0.000digits
+    memmove(s + 2 - n, s, len);
+    s[0] = '0';
+    s[1] = '.';
+    memset(s + 2, '0', -n);
+    return s + 2 - n + len - buff;
+  }
+  if(len > 1) { // d.igitse+XX
+    memmove(s + 2, s + 1, len - 1);
+    s[1] = '.';
+    s += len + 1;
+  } else
+    s++;
+  *s++ = 'e';
+  int e = n - 1;
+  if(e < 0) {
+    *s++ = '-';
+    e = -e;
+  } else
+    *s++ = '+';
+  s += zsv_writer_format_u64((uint64_t)e, s);
+  return s - buff;
+}
+
 enum zsv_writer_status zsv_writer_cell_Lf(zsv_csv_writer w, char new_row, const char *fmt_spec,
                                               long double ldbl) {
   char s[128];
@@ -246,12 +812,55 @@ enum zsv_writer_status zsv_writer_cell_Lf(zsv_csv_writer w, char new_row, const
   return zsv_writer_status_error;
 }
 
+/**
+ * Return space for ZSV_WRITER_NUMBER_MAX bytes at the end of the output
+ * buffer, flushing it first if needed, or NULL if the buffer is too small
+ */
+static inline char *zsv_output_buff_reserve(struct zsv_output_buff *b) {
+  if(b->size < ZSV_WRITER_NUMBER_MAX)
+    return NULL;
+  if(b->used + ZSV_WRITER_NUMBER_MAX > b->size)
+    zsv_output_buff_flush(b);
+  return b->buff + b->used;
+}
+
+enum zsv_writer_status zsv_writer_cell_i64(zsv_csv_writer w, char new_row, int64_t i) {
+  if(!w) return zsv_writer_status_missing_handle;
+  zsv_writer_cell_start(w, new_row);
+  char *s = zsv_output_buff_reserve(&w->out);
+  if(s)
+    w->out.used += zsv_writer_format_i64(i, s);
+  else {
+    char tmp[ZSV_WRITER_NUMBER_MAX];
+    zsv_output_buff_write(&w->out, (const unsigned char *)tmp, zsv_writer_format_i64(i, tmp));
+  }
+  return zsv_writer_status_ok;
+}
+
+enum zsv_writer_status zsv_writer_cell_f64(zsv_csv_writer w, char new_row, double d) {
+  if(!w) return zsv_writer_status_missing_handle;
+  zsv_writer_cell_start(w, new_row);
+  char *s = zsv_output_buff_reserve(&w->out);
+  if(s)
+    w->out.used += zsv_writer_format_f64(d, s);
+  else {
+    char tmp[ZSV_WRITER_NUMBER_MAX];
+    zsv_output_buff_write(&w->out, (const unsigned char *)tmp, zsv_writer_format_f64(d, tmp));
+  }
+  return zsv_writer_status_ok;
+}
+
 enum zsv_writer_status zsv_writer_cell_zu(zsv_csv_writer w, char new_row, size_t zu) {
-  char s[64];
-  int n = snprintf(s, sizeof(s), "%zu", zu);
-  if(n < 1 || n >= (int)sizeof(s))
-    n = 0; // unexpected overflow
-  return zsv_writer_cell(w, new_row, (unsigned char *)s, n, 0);
+  if(!w) return zsv_writer_status_missing_handle;
+  zsv_writer_cell_start(w, new_row);
+  char *s = zsv_output_buff_reserve(&w->out);
+  if(s)
+    w->out.used += zsv_writer_format_u64(zu, s);
+  else {
+    char tmp[ZSV_WRITER_NUMBER_MAX];
+    zsv_output_buff_write(&w->out, (const unsigned char *)tmp, zsv_writer_format_u64(zu, tmp));
+  }
+  return zsv_writer_status_ok;
 }
 
 enum zsv_writer_status zsv_writer_cell_s(zsv_csv_writer w, char new_row,
@@ -20,6 +20,8 @@
 #define ZSV_MIN_SCANNER_BUFFSIZE 4096
 #define ZSV_DEFAULT_SCANNER_BUFFSIZE (1<<18) // 256k
 
+#define ZSV_INDEX_INTERVAL_DEFAULT 1000 // rows between index entries (see zsv_index_build())
+
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
 #define ZSV_EXPORT EMSCRIPTEN_KEEPALIVE
@@ -48,6 +50,30 @@ char zsv_row_is_blank(zsv_parser parser);
 ZSV_EXPORT
 struct zsv_cell zsv_get_cell(zsv_parser parser, size_t ix);
 
+/**
+ * Same as zsv_get_cell(), except that if the cell value was left in raw form
+ * (see zsv_opts.lazy_dequote), return an unescaped copy. The copy remains valid
+ * until the row handler returns
+ */
+ZSV_EXPORT
+struct zsv_cell zsv_get_cell_unescaped(zsv_parser parser, size_t ix);
+
+/**
+ * Get the current row's bytes as they appear in the input, including any
+ * quotes and delimiters but not the row end. The returned quoted flags are
+ * those of all the row's cells combined, plus ZSV_PARSER_QUOTE_NEEDED if the
+ * delimiter is not a comma, so if they are zero, the row is valid CSV as-is
+ * and identical to its cells joined with commas. Call from a row handler; the
+ * bytes remain valid until it returns
+ *
+ * @return the row, or a cell with a NULL str if its bytes are not available
+ *         e.g. because a cell was unescaped or repaired in place, the row was
+ *         truncated, columns were skipped (see zsv_set_projection()) or rows
+ *         are parsed with zsv_parse_parallel()
+ */
+ZSV_EXPORT
+struct zsv_cell zsv_get_row_raw(zsv_parser parser);
+
 ZSV_EXPORT
 void zsv_set_row_handler(zsv_parser, void (*row)(void *ctx));
 
@@ -60,10 +86,172 @@ void zsv_set_input(zsv_parser, void *in);
 ZSV_EXPORT
 zsv_parser zsv_new(struct zsv_opts *opts);
 
+/**
+ * Create a parser that reads the file at the given path by mapping it into
+ * memory and scanning the mapping directly, without copying it to a buffer.
+ * Rows may be of any length (max_row_size is ignored), and cell values point
+ * into the mapping, except for cells that contain escaped quotes, which are
+ * copied (valid until the next call to zsv_parse_more())
+ *
+ * opts->stream and opts->read are ignored. If the file is not a regular file
+ * or cannot be mapped, it is read as a stream as with zsv_new(). In either case,
+ * the file is closed by zsv_delete()
+ *
+ * @param path file to read
+ * @param opts parser options, as with zsv_new()
+ * @return parser, or NULL on error
+ */
+ZSV_EXPORT
+zsv_parser zsv_new_mmap(const char *path, struct zsv_opts *opts);
+
+struct zsv_file_reader;
+
+/**
+ * Open a file for reading with zsv_file_reader_read(), which can be used as
+ * the parser's read function:
+ *   opts.read = zsv_file_reader_read;
+ *   opts.stream = zsv_file_reader_new(path, 0, 0, 0);
+ *
+ * On Linux, the reader uses io_uring to keep up to `queue_depth` reads of
+ * `block_size` bytes in flight, which can be significantly faster than fread()
+ * on devices that need parallel requests to reach full bandwidth (e.g. NVMe).
+ * If io_uring is not available, or the file is not a regular file, the file is
+ * read with pread() / read()
+ *
+ * Not available on Windows
+ *
+ * @param path        file to read
+ * @param queue_depth maximum number of reads in flight, or 0 for the default (8)
+ * @param block_size  size of each read, rounded up to a multiple of 4096,
+ *                    or 0 for the default (128k)
+ * @param direct      if non-zero, try to bypass the page cache (O_DIRECT)
+ * @return reader, or NULL on error. Free with zsv_file_reader_delete()
+ */
+ZSV_EXPORT
+struct zsv_file_reader *zsv_file_reader_new(const char *path, unsigned queue_depth,
+                                            size_t block_size, char direct);
+
+ZSV_EXPORT
+size_t zsv_file_reader_read(void *buff, size_t size, size_t count, void *reader);
+
+ZSV_EXPORT
+void zsv_file_reader_delete(struct zsv_file_reader *reader);
+
 ZSV_EXPORT enum zsv_status zsv_parse_more(zsv_parser parser);
 
+/**
+ * Parse the entire input using multiple threads. Each thread scans a separate
+ * byte range of the input; row and cell handlers are still called from the
+ * calling thread, in input order, with the same values as zsv_parse_more()
+ * would produce. Rows are not subject to the row size limit of the parser buffer
+ *
+ * Requires a seekable file stream and the default read function. In any other
+ * case (or if threads are not supported), this is equivalent to calling
+ * zsv_parse_more() until it no longer returns zsv_status_ok
+ *
+ * As with zsv_parse_more(), call zsv_finish() when done
+ *
+ * @param parser   parser handle, which must not yet have parsed any input
+ * @param nthreads number of threads to use, or 0 for one per available CPU
+ * @return zsv_status_no_more_input on success, else an error or cancellation status
+ */
+ZSV_EXPORT enum zsv_status zsv_parse_parallel(zsv_parser parser, unsigned nthreads);
+
+struct zsv_index;
+
+/**
+ * Build a row index of a file, and save it as <filename>.zsvidx. The index
+ * holds the offset of every `interval`th row, the header row, and the
+ * delimiter and quote options the file was parsed with
+ *
+ * @param filename file to index
+ * @param opts     parser options. Handlers, insert_header_row and max_rows are ignored
+ * @param interval number of rows between index entries, or 0 for the default
+ *                 (ZSV_INDEX_INTERVAL_DEFAULT)
+ * @return status code
+ */
+ZSV_EXPORT enum zsv_status zsv_index_build(const char *filename, const struct zsv_opts *opts,
+                                           size_t interval);
+
+/**
+ * Load the index of a file saved by zsv_index_build(), if there is one and it
+ * is still valid i.e. the file has the same size and modification time, and
+ * opts specifies the same delimiter and quote options
+ *
+ * @return index, or NULL. Free with zsv_index_delete()
+ */
+ZSV_EXPORT struct zsv_index *zsv_index_load(const char *filename, const struct zsv_opts *opts);
+
+ZSV_EXPORT void zsv_index_delete(struct zsv_index *ix);
+
+/**
+ * @return total number of rows in the indexed file, including the header row
+ */
+ZSV_EXPORT size_t zsv_index_row_count(const struct zsv_index *ix);
+
+/**
+ * Use an index with a parser that reads the indexed file. Must be called before
+ * any input is parsed, and the index must remain valid until the parser is
+ * deleted. zsv_parse_parallel() then splits the file at indexed rows
+ *
+ * @param parser parser created with zsv_new() whose stream is the indexed file
+ * @param ix     index loaded with zsv_index_load()
+ * @return status code
+ */
+ZSV_EXPORT enum zsv_status zsv_set_index(zsv_parser parser, struct zsv_index *ix);
+
+/**
+ * Start parsing at the indexed row nearest to, but not after, the given row,
+ * where row 0 is the first row of the file. Unless insert_header_row was set,
+ * the header row is still parsed first. Must be called after zsv_set_index()
+ * and before any input is parsed
+ *
+ * @param parser parser handle
+ * @param row    row to seek to
+ * @return the row that parsing will start at, after the header row. If 0, the
+ *         input is read from the start
+ */
+ZSV_EXPORT size_t zsv_index_seek(zsv_parser parser, size_t row);
+
+/**
+ * Reset the parser to parse a new input from its start, as a new parser with
+ * the same options and handlers would, but without reallocating its buffer and
+ * cells array. Settings such as zsv_set_projection() and
+ * zsv_set_fixed_offsets() are kept, but any index set with zsv_set_index() is
+ * unset. zsv_finish() may be called again for the new input. Cannot be used
+ * with a parser created by zsv_new_mmap() or used with zsv_parse_buffer()
+ *
+ * @param parser     parser handle
+ * @param new_stream stream passed to opts.read (or to fread() if that is not
+ *                   set, in which case NULL means stdin)
+ */
+ZSV_EXPORT enum zsv_status zsv_reset(zsv_parser parser, void *new_stream);
+
+/**
+ * Continue parsing from another input, after zsv_parse_more() has returned
+ * zsv_status_no_more_input, so that several files are parsed as one stream of
+ * rows. The last row of the current input is output first if it did not end
+ * with a row delimiter, so rows never span inputs. A BOM at the start of the
+ * new input is skipped. Unlike with zsv_reset(), row counts and
+ * zsv_cum_scanned_length() carry on and insert_header_row is not inserted
+ * again. Call zsv_finish() after the last input. If it was called before, as
+ * zsv_parse_batch() does at the end of each input, parsing simply continues
+ * and zsv_finish() is then called again at the end of the new input
+ *
+ * @param parser       parser handle
+ * @param f_next_input stream of the next input (see zsv_reset())
+ */
 ZSV_EXPORT enum zsv_status zsv_next_input(zsv_parser parser, void *f_next_input);
 
+/**
+ * Replace malformed UTF-8 in cell values. Input is validated a buffer at a
+ * time, so only the rare cell that contains malformed bytes is repaired. Does
+ * not apply to fixed-width mode
+ *
+ * @param parser parser handle
+ * @param value  byte to replace each malformed byte with, or 0 to remove them
+ * @return status code
+ */
 ZSV_EXPORT enum zsv_status zsv_set_malformed_utf8_replace(zsv_parser parser, unsigned char value);
 ZSV_EXPORT enum zsv_status zsv_set_scan_filter(zsv_parser parser,
                                                size_t (*filter)(void *ctx,
@@ -81,13 +269,125 @@ ZSV_EXPORT enum zsv_status zsv_set_scan_filter(zsv_parser parser,
  */
 ZSV_EXPORT enum zsv_status zsv_set_fixed_offsets(zsv_parser parser, size_t count, size_t *offsets);
 
+/**
+ * Parse fixed-width input as records of a fixed length with no row delimiter,
+ * such as mainframe extracts, instead of as lines. Rows are then found by
+ * arithmetic alone, without scanning for newlines. A final record that is
+ * shorter than record_length is returned as a short row. Must be called after
+ * zsv_set_fixed_offsets() and before parsing begins
+ *
+ * @return status code
+ * @param parser        parser handle
+ * @param record_length length of each record, at most the buffer size, or 0
+ *                      to go back to newline-delimited rows
+ */
+ZSV_EXPORT enum zsv_status zsv_set_fixed_record_length(zsv_parser parser, size_t record_length);
+
+/**
+ * Guess the column offsets of fixed-width text from a sample of its lines. A
+ * column ends where a byte position that is blank (a space) on every line is
+ * followed by one that is not, and the last column ends at the end of the
+ * longest line. Leading blanks belong to the first column, so columns of
+ * right-aligned values start after the previous column's trailing blanks
+ *
+ * @param buff        sample, starting at the start of a line
+ * @param len         length of the sample
+ * @param offsets     receives up to max_offsets cell-end offsets, in the form
+ *                    that zsv_set_fixed_offsets() accepts
+ * @param max_offsets size of offsets
+ * @return number of columns found, which may exceed max_offsets, or 0 if the
+ *         sample has no lines
+ */
+ZSV_EXPORT size_t zsv_detect_fixed_offsets(const unsigned char *buff, size_t len,
+                                           size_t *offsets, size_t max_offsets);
+
+/**
+ * As zsv_detect_fixed_offsets(), for a file. A large file is not read in full:
+ * instead, sample_blocks blocks spread evenly across it, including its first
+ * and last, are sampled. If the file is not seekable, only its start is used
+ *
+ * @param filename      file to sample
+ * @param sample_blocks number of blocks to sample, or 0 for the default (16)
+ * @return number of columns found, or 0 on error or if the file has no lines
+ */
+ZSV_EXPORT size_t zsv_detect_fixed_offsets_file(const char *filename, size_t sample_blocks,
+                                                size_t *offsets, size_t max_offsets);
+
+/**
+ * Limit cell processing to the given columns. The scanner still finds the
+ * boundaries of every cell, so column positions do not change, but cells in
+ * other columns are not unquoted or passed to the cell handler, and are
+ * returned by zsv_get_cell() as empty. This can be much faster when only a few
+ * of many columns are needed
+ *
+ * May be called at any time, including from a row handler, and applies from
+ * the next cell parsed
+ *
+ * @param parser  parser handle
+ * @param indexes 0-based indexes of the columns to process, or NULL to process
+ *                all columns again
+ * @param n       number of indexes
+ * @return status code
+ */
+ZSV_EXPORT enum zsv_status zsv_set_projection(zsv_parser parser, const unsigned *indexes, size_t n);
+
+/**
+ * Parse the next block of rows and return them as flat arrays, as an
+ * alternative to a row handler and one call to zsv_get_cell() per cell.
+ * Replaces the parser's row handler and context, so zsv_parse_more() and
+ * zsv_finish() should not also be called
+ *
+ * The returned arrays and cell contents remain valid until the next call to
+ * zsv_parse_batch()
+ *
+ * In fixed-width mode without a cell handler, rows are added to the batch
+ * straight from the fixed offsets, and with zsv_set_fixed_record_length(), all
+ * complete records in each buffer are added at once
+ *
+ * @param parser   parser handle
+ * @param out      receives the rows
+ * @param max_rows maximum number of rows to return, or 0 for no limit. Fewer rows
+ *                 may be returned, but never zero rows with zsv_status_ok
+ * @return zsv_status_ok, or zsv_status_no_more_input after all rows have been
+ *         returned, or another status on error or cancellation
+ */
+ZSV_EXPORT enum zsv_status zsv_parse_batch(zsv_parser parser, struct zsv_row_batch *out, size_t max_rows);
+
 ZSV_EXPORT size_t zsv_filter_write(void *FILEp, unsigned char *buff, size_t bytes_read);
 
-// zsv_parse_string(): *utf8 may not overlap w parser buffer!
+/**
+ * Parse a string, copying it through the parser's buffer as if it had been
+ * read from the parser's input stream. May be called more than once, followed
+ * by zsv_finish()
+ *
+ * *utf8 may not overlap w parser buffer!
+ */
 ZSV_EXPORT enum zsv_status zsv_parse_string(zsv_parser parser,
                                             const unsigned char *restrict utf8,
                                             size_t len);
 
+/**
+ * Parse data that is already in memory, without copying it to the parser's
+ * buffer. Data may be passed in any number of chunks, which need not end at a
+ * row boundary; only a row that spans two chunks is copied. The last chunk
+ * must be passed with is_final set, after which the parser is finished and
+ * zsv_finish() need not be called
+ *
+ * The data is never modified: cells that must be unquoted are copied to
+ * memory owned by the parser, as with zsv_new_mmap(). Cells passed to the row
+ * handler point into the caller's chunk, so it must remain valid until this
+ * call returns. A parser that uses zsv_parse_buffer() may not also read from
+ * a stream or use a filter
+ *
+ * @param parser   parser handle
+ * @param buff     next chunk of data
+ * @param len      length of the chunk, which may be 0
+ * @param is_final non-zero if this is the last chunk
+ * @return status code
+ */
+ZSV_EXPORT enum zsv_status zsv_parse_buffer(zsv_parser parser, const unsigned char *buff, size_t len,
+                                            char is_final);
+
 // return a ptr to remaining (unparsed) buffer and length remaining
 ZSV_EXPORT unsigned char *zsv_remaining_buffer(zsv_parser parser, size_t *len);
 
@@ -112,6 +412,34 @@ ZSV_EXPORT size_t zsv_scanned_length(zsv_parser);
  */
 ZSV_EXPORT size_t zsv_cum_scanned_length(zsv_parser parser);
 
+/**
+ * Get the parser's counters so far, for tuning buffer sizes or finding out
+ * what makes an input slow to parse. Counters are only kept if the library is
+ * built with ZSV_STATS defined, and are otherwise all zero, except for
+ * overflow_rows which is always kept. After zsv_parse_parallel(), the cell
+ * counts include any chunks that had to be parsed again, and read and scan
+ * times are those of the parallel phases
+ */
+ZSV_EXPORT struct zsv_stats zsv_get_stats(zsv_parser parser);
+
+/**
+ * Guess the dialect of CSV data from a sample, such as the first block of a
+ * file: the delimiter (comma, tab, pipe or semicolon, whichever gives the most
+ * rows the same number of cells), whether double-quotes are used for quoting,
+ * whether it starts with a BOM and whether the first row is a header. Only
+ * complete rows are used, so the sample should hold at least a few of them;
+ * at most the first 64k of it is examined
+ *
+ * @param buff sample data
+ * @param len  length of the sample
+ * @param opts optional. if non-NULL and a delimiter was found, its delimiter
+ *             and no_quotes are set to those detected
+ * @return     the detected dialect. If no candidate delimiter is found,
+ *             delimiter is that of opts (or comma if opts is NULL), and
+ *             columns is 1
+ */
+ZSV_EXPORT struct zsv_dialect zsv_sniff(const unsigned char *buff, size_t len, struct zsv_opts *opts);
+
 /**
  * Create a zsv_opts structure and return its handle. This is only necessary in
  * environments where structures cannot be directly instantiated such as web
@@ -51,6 +51,7 @@ struct zsv_cell {
 #  define ZSV_PARSER_QUOTE_CLOSED   2 /* value was quoted */
 #  define ZSV_PARSER_QUOTE_NEEDED   4 /* value contains delimiter or dbl-quote */
 #  define ZSV_PARSER_QUOTE_EMBEDDED 8 /* value contains dbl-quote */
+#  define ZSV_PARSER_QUOTE_RAW     16 /* value is still in CSV form (see zsv_opts.lazy_dequote) */
   /**
    * quoted flags enable additional efficiency, in particular when input data will
    * be output as text (csv, json etc), by indicating whether the cell contents may
@@ -61,6 +62,54 @@ struct zsv_cell {
   char quoted;
 };
 
+/**
+ * Structure for returning a block of parsed rows as flat arrays (see zsv_parse_batch())
+ *
+ * The cells of row r are cells row_starts[r] through row_starts[r+1] - 1. Cell i
+ * has contents at base + cell_offsets[i], length cell_lengths[i] and quoted flags
+ * cell_quoted[i]. Offsets are relative to base even for the occasional cell that
+ * is not stored after it in memory (offset arithmetic wraps)
+ */
+struct zsv_row_batch {
+  size_t row_count;
+  const size_t *row_starts; /* row_count + 1 entries */
+  const unsigned char *base;
+  const size_t *cell_offsets;
+  const size_t *cell_lengths;
+  const char *cell_quoted;
+};
+
+/**
+ * Parser counters (see zsv_get_stats()). These are only kept if the library is
+ * built with ZSV_STATS defined (configure --enable-stats, or make ZSV_STATS=1)
+ * and are otherwise all zero
+ */
+struct zsv_stats {
+  size_t rows;
+  size_t cells;
+  size_t quoted_cells;         /* cells that were enclosed in double-quotes */
+  size_t embedded_quote_cells; /* quoted cells that contained an escaped double-quote */
+  size_t dequote_bytes_moved;  /* bytes moved in place to remove quotes */
+  size_t shifts;               /* partial rows moved to the start of the buffer before a read */
+  size_t shift_bytes;          /* total size of those partial rows */
+  size_t overflow_rows;        /* rows that had more than opts.max_columns cells */
+  size_t truncated_rows;       /* rows that did not fit in the buffer */
+  double read_seconds;         /* time spent reading input */
+  double scan_seconds;         /* time spent scanning, including in row and cell handlers */
+};
+
+/**
+ * Dialect guessed from a sample of the data (see zsv_sniff())
+ */
+struct zsv_dialect {
+  char delimiter;  /* one of ',', '\t', '|' or ';' */
+  char no_quotes;  /* 1 if double-quotes appear to be ordinary characters */
+  char has_bom;    /* 1 if the sample starts with a UTF-8 byte order mark */
+  char has_header; /* 1 if the first row looks like column names */
+  size_t columns;  /* number of columns in most rows of the sample */
+  size_t rows;     /* number of complete rows in the sample */
+};
+
 typedef size_t (*zsv_generic_write)(const void * restrict,  size_t,  size_t,  void * restrict);
 typedef size_t (*zsv_generic_read)(void * restrict, size_t n, size_t size, void * restrict);
 
@@ -118,7 +167,10 @@ struct zsv_opts {
   size_t buffsize;
 
   /**
-   * maximum number of columns to parse. defaults to 1024
+   * maximum number of columns to parse. defaults to 1024. Memory for cells is
+   * allocated as needed, so a large value costs nothing for narrower data. Any
+   * further columns are ignored, and the number of rows affected is reported
+   * once when parsing finishes
    *
    * cli option: -c,--max-column-count
    */
@@ -132,6 +184,16 @@ struct zsv_opts {
    */
   unsigned max_row_size;
 
+  /**
+   * max_buffsize: if greater than buffsize, a row that does not fit in the
+   * buffer causes the buffer to be doubled in size, up to max_buffsize, instead
+   * of being truncated. Rows that do not fit in max_buffsize are still truncated
+   * defaults to 0 (no growth)
+   *
+   * cli option: --max-buff-size <N>
+   */
+  size_t max_buffsize;
+
   /**
    * delimiter: typically a comma or tab
    * can be any char other than newline, form feed or quote
@@ -150,12 +212,69 @@ struct zsv_opts {
    */
   char no_quotes;
 
+  /**
+   * sniff: if non-zero, guess the delimiter and whether quotes are used from
+   * the first buffer of input (see zsv_sniff()), and set delimiter and
+   * no_quotes accordingly before any of it is parsed. If no candidate delimiter
+   * is found, delimiter and no_quotes are left as they are
+   * defaults to 0
+   *
+   * cli option: --sniff
+   */
+  char sniff;
+
+  /**
+   * structural_index: if non-zero, use the experimental two-stage scanner, which
+   * first indexes the quote, delimiter and row-end positions of each 64-byte block
+   * and then emits cells from the index. This can be faster for data with many
+   * quoted values. Output is the same as with the default scanner
+   * defaults to 0
+   *
+   * cli option: --structural-index
+   */
+  char structural_index;
+
+  /**
+   * lazy_dequote: if non-zero, quoted values that contain escaped double-quotes
+   * (e.g. "a""b") are returned exactly as in the input, including the surrounding
+   * quotes, and with the ZSV_PARSER_QUOTE_RAW flag set, instead of being unescaped
+   * in place. Use zsv_get_cell_unescaped() to get the unescaped value, or output
+   * the raw value as-is when writing CSV
+   * defaults to 0
+   */
+  char lazy_dequote;
+
+  /**
+   * readahead_depth: if non-zero, read input in a separate thread, up to this
+   * many blocks ahead of the parser, so that reading and parsing overlap. This
+   * can be faster for slow input such as a pipe or network file. Rows remain
+   * valid until the next call to zsv_parse_more(), as without read-ahead.
+   * Ignored on platforms without thread support
+   * defaults to 0
+   *
+   * cli option: --read-ahead <N>
+   */
+  unsigned readahead_depth;
+
+  /**
+   * readahead_block_size: size of each read-ahead block (see readahead_depth)
+   * defaults to buffsize
+   */
+  size_t readahead_block_size;
+
   /**
    * flag to print more verbose messages to the console
    * cli option: -v,--verbose
    */
   char verbose;
 
+  /**
+   * stats: if non-zero, print the parser's counters (see zsv_get_stats()) to
+   * stderr when the parser is deleted
+   * cli option: --stats
+   */
+  char stats;
+
   /**
    * if the actual data does not have a header row with column names, the caller
    * should provide one (in CSV format) which will be treated as if it was the
@@ -105,11 +105,14 @@ struct zsv_ext_callbacks {
    * fetch options from execution context. used to fetch just the ctx-related parser
    * opts, including any of the below if specified by the user when zsv was invoked:
    *     -B,--buff-size <N>
+   *     --max-buff-size <N>
    *     -c,--max-column-count <N>
    *     -r,--max-row-size <N>
    *     -t,--tab-delim
    *     -O,--other-delim <C>
    *     -q,--no-quote
+   *     --structural-index
+   *     --read-ahead <N>
    *     -v,--verbose
    *
    * @param ctx execution context
@@ -143,6 +146,12 @@ struct zsv_ext_callbacks {
    * }
    * ```
    */
+
+  /**
+   * Parse the next block of rows as flat arrays, as an alternative to a row
+   * handler. See zsv_parse_batch()
+   */
+  enum zsv_status (*parse_batch)(zsv_parser parser, struct zsv_row_batch *out, size_t max_rows);
 };
 
 /** @} */
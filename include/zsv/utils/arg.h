@@ -49,11 +49,14 @@ void zsv_set_default_completed_callback(zsv_completed_callback cb, void *ctx);
  * with processed args stripped out. Initializes opts_out with
  * `zsv_get_default_opts()`, then with the below common options if present:
  *     -B,--buff-size <N>
+ *     --max-buff-size <N>
  *     -c,--max-column-count <N>
  *     -r,--max-row-size <N>
  *     -t,--tab-delim
  *     -O,--other-delim <C>
  *     -q,--no-quote
+ *     --structural-index
+ *     --read-ahead <N>
  *     -v,--verbose
  *
  * @param  argc     count of args to process
@@ -10,6 +10,7 @@
 #define ZSV_WRITER_H
 
 #include <stdio.h>
+#include <stdint.h>
 
 /*** csv writer ***/
 struct zsv_csv_writer_options {
@@ -18,11 +19,44 @@ struct zsv_csv_writer_options {
   void *stream;
   void (*table_init)(void *);
   void *table_init_ctx;
+  size_t buffsize; // size of the output buffer. if 0, the default (256k) is used
+
+  /*
+   * if set, full output buffers are written by a separate thread while the
+   * next buffer is filled, so that slow output does not stall parsing. Up to
+   * two full buffers may be pending; once both are, the writer waits for one to
+   * be written. zsv_writer_flush() and zsv_writer_delete() still return only
+   * once all output is written. Ignored if threads are not supported
+   */
+  char async;
+
+  /*
+   * if use_fd is set, output is written to fd with write(2), straight from the
+   * output buffer, instead of being copied again into a stdio buffer, and write
+   * and stream are ignored. Not supported on Windows
+   */
+  char use_fd;
+  int fd;
 };
 
 void zsv_writer_set_default_opts(struct zsv_csv_writer_options opts);
 struct zsv_csv_writer_options zsv_writer_get_default_opts();
 
+/**
+ * Set opts to write to stdout with write(2) (see use_fd) if stdout is not a
+ * terminal, i.e. is a file or pipe
+ * @return non-zero if set
+ */
+char zsv_writer_opts_stdout_fd(struct zsv_csv_writer_options *opts);
+
+#ifndef _WIN32
+/**
+ * fwrite()-compatible function that writes to the file descriptor given as
+ * stream, cast to intptr_t
+ */
+size_t zsv_writer_fd_write(const void *restrict buff, size_t size, size_t nitems, void *restrict stream);
+#endif
+
 enum zsv_writer_status {
   zsv_writer_status_ok = 0,
   zsv_writer_status_error,
@@ -38,6 +72,10 @@ enum zsv_writer_status zsv_writer_delete(zsv_csv_writer w);
 
 enum zsv_writer_status zsv_writer_flush(zsv_csv_writer w);
 
+/**
+ * Kept for compatibility: quoted values are now escaped straight into the
+ * output buffer, so the temp buffer is no longer used
+ */
 void zsv_writer_set_temp_buff(zsv_csv_writer w, unsigned char *buff,
                                 size_t buffsize);
 
@@ -45,6 +83,13 @@ enum zsv_writer_status zsv_writer_cell(zsv_csv_writer, char new_row,
                                            const unsigned char *s, size_t len,
                                            char check_if_needs_quoting);
 
+/**
+ * Write a row that is already CSV, as-is, in one copy, e.g. the bytes of an
+ * input row that needs no change (see zsv_get_row_raw()). s may also hold
+ * several rows, each ended by a single \n except the last
+ */
+enum zsv_writer_status zsv_writer_raw_row(zsv_csv_writer w, const unsigned char *s, size_t len);
+
 unsigned char *zsv_writer_str_to_csv(const unsigned char *s, size_t len);
 
 /*
@@ -67,4 +112,25 @@ enum zsv_writer_status zsv_writer_cell_Lf(zsv_csv_writer w, char new_row,
                                                      const char *fmt_spec, // provide X in %XLf e.g. ".2" or ""
                                                      long double ldbl);
 
+/*
+ * zsv_writer_cell_i64 and zsv_writer_cell_f64 format their value straight
+ * into the output buffer, without snprintf. A double is written with the
+ * fewest digits that read back as the same value, in fixed notation from 1e-6
+ * up to 1e21 and otherwise as e.g. 1.5e+21
+ */
+enum zsv_writer_status zsv_writer_cell_i64(zsv_csv_writer w, char new_row, int64_t i);
+
+enum zsv_writer_status zsv_writer_cell_f64(zsv_csv_writer w, char new_row, double d);
+
+// max length of a number formatted by zsv_writer_format_i64() or zsv_writer_format_f64()
+#define ZSV_WRITER_NUMBER_MAX 32
+
+/**
+ * Format a number as zsv_writer_cell_i64() or zsv_writer_cell_f64() does,
+ * into buff, which must hold at least ZSV_WRITER_NUMBER_MAX bytes
+ * @return length written (not NUL-terminated)
+ */
+size_t zsv_writer_format_i64(int64_t i, char *buff);
+size_t zsv_writer_format_f64(double d, char *buff);
+
 #endif
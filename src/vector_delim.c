@@ -14,36 +14,289 @@
 
 #define clear_lowest_bit(n) (n & (n - 1)) // _blsr_u64(n) // seems to be same speed as x = x & (x - 1)
 
-// vec_delims: return bitfield of next 32 bytes that contain at least 1 token
-static inline int vec_delims(const unsigned char *s, size_t n,
-                             zsv_uc_vector *char_match1,
-                             zsv_uc_vector *char_match2,
-                             zsv_uc_vector *char_match3,
-                             zsv_uc_vector *char_match4,
-                             unsigned int *maskp
-                             ) {
-  zsv_uc_vector* pSrc1 = (zsv_uc_vector *)s;
-  zsv_uc_vector str_simd;
-
-  unsigned j = n / sizeof(str_simd); // VECTOR_BYTES;
-  unsigned int mask = 0;
-  unsigned total_bytes = 0;
-
-  for(unsigned i = 0; i < j; i++) {
-    // memcpy(&str_simd, pSrc1 + i, VECTOR_BYTES); -- will bus error on clang+BSD
-    memcpy(&str_simd, s + i*sizeof(str_simd), sizeof(str_simd));
-    zsv_uc_vector vtmp = str_simd == *char_match1;
-    vtmp += (str_simd == *char_match2);
-    vtmp += (str_simd == *char_match3);
-    vtmp += (str_simd == *char_match4);
-    mask = movemask_pseudo(vtmp);
+/*
+ * vec_delims_xxx(): find the first block of ZSV_VEC_BYTES_xxx bytes, starting at s,
+ * that contains at least one of the 4 token chars. If found, set *maskp to the
+ * bitfield of the matching positions in that block and return the block's offset
+ * from s. Otherwise, return the number of bytes checked (the number of whole
+ * blocks in n) and leave *maskp unchanged
+ *
+ * vec_classify_xxx(): for the 64 bytes starting at s, set the bitfields of the
+ * positions of the quote char, the delimiter and row-end chars (\n or \r)
+ *
+ * vec_prefix_xor_xxx(): set each bit to the xor of itself and all lower bits,
+ * which turns a bitfield of quote positions into one of in-quote positions
+ *
+ * One kernel is compiled for each instruction set that the compiler can target;
+ * the best one supported by the host cpu is chosen at run time (see
+ * zsv_scan_kernel_select())
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define ZSV_VEC_X86
+# include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+# define ZSV_VEC_NEON
+# include <arm_neon.h>
+#endif
+
+/* generic: 4 x 64-bit words (SWAR) per block */
+#define ZSV_VEC_BYTES_generic 32
+
+#define ZSV_SWAR_ONES 0x0101010101010101ULL
+#define ZSV_SWAR_LOW7 0x7f7f7f7f7f7f7f7fULL
+
+// set the high bit of each byte in w that is equal to the corresponding byte in c
+static inline uint64_t zsv_swar_eq(uint64_t w, uint64_t c) {
+  uint64_t x = w ^ c;
+  return ~(((x & ZSV_SWAR_LOW7) + ZSV_SWAR_LOW7) | x | ZSV_SWAR_LOW7);
+}
+
+static inline size_t vec_delims_generic(const unsigned char *s, size_t n,
+                                        unsigned char c1, unsigned char c2,
+                                        unsigned char c3, unsigned char c4,
+                                        uint64_t *maskp) {
+  uint64_t v1 = c1 * ZSV_SWAR_ONES, v2 = c2 * ZSV_SWAR_ONES;
+  uint64_t v3 = c3 * ZSV_SWAR_ONES, v4 = c4 * ZSV_SWAR_ONES;
+  size_t total_bytes = 0;
+  for(; total_bytes + ZSV_VEC_BYTES_generic <= n; total_bytes += ZSV_VEC_BYTES_generic) {
+    uint64_t mask = 0;
+    for(int k = 0; k < 4; k++) {
+      uint64_t w;
+      memcpy(&w, s + total_bytes + k * 8, 8);
+      uint64_t m = zsv_swar_eq(w, v1) | zsv_swar_eq(w, v2) | zsv_swar_eq(w, v3) | zsv_swar_eq(w, v4);
+      if(m) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        // gather the high bit of each byte into the low 8 bits
+        mask |= (((m >> 7) * 0x0102040810204080ULL) >> 56) << (k * 8);
+#else
+        for(int b = 0; b < 8; b++)
+          if(s[total_bytes + k * 8 + b] == c1 || s[total_bytes + k * 8 + b] == c2
+             || s[total_bytes + k * 8 + b] == c3 || s[total_bytes + k * 8 + b] == c4)
+            mask |= 1ULL << (k * 8 + b);
+#endif
+      }
+    }
     if(LIKELY(mask != 0)) { // check if we found one of the 4 chars
       *maskp = mask;
       return total_bytes;
-    } else {
-      // not found, moving to next chunk
-      total_bytes += sizeof(*pSrc1);
     }
   }
   return total_bytes; // nothing found in entire buffer
 }
+
+static inline void vec_classify_generic(const unsigned char *s, unsigned char delimiter,
+                                        uint64_t *quotes, uint64_t *delims, uint64_t *ends) {
+  uint64_t q = 0, d = 0, e = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  uint64_t qt_v = '"' * ZSV_SWAR_ONES, dl_v = delimiter * ZSV_SWAR_ONES;
+  uint64_t nl_v = '\n' * ZSV_SWAR_ONES, cr_v = '\r' * ZSV_SWAR_ONES;
+  for(int k = 0; k < 8; k++) {
+    uint64_t w;
+    memcpy(&w, s + k * 8, 8);
+    q |= ((((zsv_swar_eq(w, qt_v) >> 7) * 0x0102040810204080ULL) >> 56) << (k * 8));
+    d |= ((((zsv_swar_eq(w, dl_v) >> 7) * 0x0102040810204080ULL) >> 56) << (k * 8));
+    e |= ((((zsv_swar_eq(w, nl_v) | zsv_swar_eq(w, cr_v)) >> 7) * 0x0102040810204080ULL) >> 56) << (k * 8);
+  }
+#else
+  for(int k = 0; k < 64; k++) {
+    q |= (uint64_t)(s[k] == '"') << k;
+    d |= (uint64_t)(s[k] == delimiter) << k;
+    e |= (uint64_t)(s[k] == '\n' || s[k] == '\r') << k;
+  }
+#endif
+  *quotes = q;
+  *delims = d;
+  *ends = e;
+}
+
+static inline uint64_t vec_prefix_xor_generic(uint64_t x) {
+  x ^= x << 1;
+  x ^= x << 2;
+  x ^= x << 4;
+  x ^= x << 8;
+  x ^= x << 16;
+  x ^= x << 32;
+  return x;
+}
+
+#ifdef ZSV_VEC_X86
+
+#ifdef __x86_64__
+/* carry-less multiplication by all-ones computes the prefix xor in one instruction */
+__attribute__((target("pclmul")))
+static inline uint64_t zsv_prefix_xor_clmul(uint64_t x) {
+  __m128i v = _mm_clmulepi64_si128(_mm_set_epi64x(0, (long long)x), _mm_set1_epi8((char)0xFF), 0);
+  return (uint64_t)_mm_cvtsi128_si64(v);
+}
+# define ZSV_VEC_HAVE_CLMUL
+#else
+# define zsv_prefix_xor_clmul vec_prefix_xor_generic
+#endif
+
+#define ZSV_VEC_BYTES_sse2 16
+__attribute__((target("sse2")))
+static inline size_t vec_delims_sse2(const unsigned char *s, size_t n,
+                                     unsigned char c1, unsigned char c2,
+                                     unsigned char c3, unsigned char c4,
+                                     uint64_t *maskp) {
+  __m128i v1 = _mm_set1_epi8((char)c1), v2 = _mm_set1_epi8((char)c2);
+  __m128i v3 = _mm_set1_epi8((char)c3), v4 = _mm_set1_epi8((char)c4);
+  size_t total_bytes = 0;
+  for(; total_bytes + ZSV_VEC_BYTES_sse2 <= n; total_bytes += ZSV_VEC_BYTES_sse2) {
+    __m128i str_simd = _mm_loadu_si128((const __m128i *)(s + total_bytes));
+    __m128i vtmp = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(str_simd, v1), _mm_cmpeq_epi8(str_simd, v2)),
+                                _mm_or_si128(_mm_cmpeq_epi8(str_simd, v3), _mm_cmpeq_epi8(str_simd, v4)));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(vtmp);
+    if(LIKELY(mask != 0)) {
+      *maskp = mask;
+      return total_bytes;
+    }
+  }
+  return total_bytes;
+}
+
+__attribute__((target("sse2")))
+static inline void vec_classify_sse2(const unsigned char *s, unsigned char delimiter,
+                                     uint64_t *quotes, uint64_t *delims, uint64_t *ends) {
+  __m128i qt_v = _mm_set1_epi8('"'), dl_v = _mm_set1_epi8((char)delimiter);
+  __m128i nl_v = _mm_set1_epi8('\n'), cr_v = _mm_set1_epi8('\r');
+  uint64_t q = 0, d = 0, e = 0;
+  for(int k = 0; k < 4; k++) {
+    __m128i str_simd = _mm_loadu_si128((const __m128i *)(s + k * 16));
+    q |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(str_simd, qt_v)) << (k * 16);
+    d |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(str_simd, dl_v)) << (k * 16);
+    e |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(str_simd, nl_v),
+                                                            _mm_cmpeq_epi8(str_simd, cr_v))) << (k * 16);
+  }
+  *quotes = q;
+  *delims = d;
+  *ends = e;
+}
+
+#define vec_prefix_xor_sse2 vec_prefix_xor_generic
+
+#define ZSV_VEC_BYTES_avx2 32
+__attribute__((target("avx2")))
+static inline size_t vec_delims_avx2(const unsigned char *s, size_t n,
+                                     unsigned char c1, unsigned char c2,
+                                     unsigned char c3, unsigned char c4,
+                                     uint64_t *maskp) {
+  __m256i v1 = _mm256_set1_epi8((char)c1), v2 = _mm256_set1_epi8((char)c2);
+  __m256i v3 = _mm256_set1_epi8((char)c3), v4 = _mm256_set1_epi8((char)c4);
+  size_t total_bytes = 0;
+  for(; total_bytes + ZSV_VEC_BYTES_avx2 <= n; total_bytes += ZSV_VEC_BYTES_avx2) {
+    __m256i str_simd = _mm256_loadu_si256((const __m256i *)(s + total_bytes));
+    __m256i vtmp = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(str_simd, v1),
+                                                   _mm256_cmpeq_epi8(str_simd, v2)),
+                                   _mm256_or_si256(_mm256_cmpeq_epi8(str_simd, v3),
+                                                   _mm256_cmpeq_epi8(str_simd, v4)));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(vtmp);
+    if(LIKELY(mask != 0)) {
+      *maskp = mask;
+      return total_bytes;
+    }
+  }
+  return total_bytes;
+}
+
+__attribute__((target("avx2")))
+static inline void vec_classify_avx2(const unsigned char *s, unsigned char delimiter,
+                                     uint64_t *quotes, uint64_t *delims, uint64_t *ends) {
+  __m256i qt_v = _mm256_set1_epi8('"'), dl_v = _mm256_set1_epi8((char)delimiter);
+  __m256i nl_v = _mm256_set1_epi8('\n'), cr_v = _mm256_set1_epi8('\r');
+  uint64_t q = 0, d = 0, e = 0;
+  for(int k = 0; k < 2; k++) {
+    __m256i str_simd = _mm256_loadu_si256((const __m256i *)(s + k * 32));
+    q |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(str_simd, qt_v)) << (k * 32);
+    d |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(str_simd, dl_v)) << (k * 32);
+    e |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(str_simd, nl_v),
+                                                                  _mm256_cmpeq_epi8(str_simd, cr_v))) << (k * 32);
+  }
+  *quotes = q;
+  *delims = d;
+  *ends = e;
+}
+
+#define vec_prefix_xor_avx2 zsv_prefix_xor_clmul
+
+#define ZSV_VEC_BYTES_avx512 64
+__attribute__((target("avx512f,avx512bw")))
+static inline size_t vec_delims_avx512(const unsigned char *s, size_t n,
+                                       unsigned char c1, unsigned char c2,
+                                       unsigned char c3, unsigned char c4,
+                                       uint64_t *maskp) {
+  __m512i v1 = _mm512_set1_epi8((char)c1), v2 = _mm512_set1_epi8((char)c2);
+  __m512i v3 = _mm512_set1_epi8((char)c3), v4 = _mm512_set1_epi8((char)c4);
+  size_t total_bytes = 0;
+  for(; total_bytes + ZSV_VEC_BYTES_avx512 <= n; total_bytes += ZSV_VEC_BYTES_avx512) {
+    __m512i str_simd = _mm512_loadu_si512((const void *)(s + total_bytes));
+    uint64_t mask = _mm512_cmpeq_epi8_mask(str_simd, v1) | _mm512_cmpeq_epi8_mask(str_simd, v2)
+      | _mm512_cmpeq_epi8_mask(str_simd, v3) | _mm512_cmpeq_epi8_mask(str_simd, v4);
+    if(LIKELY(mask != 0)) {
+      *maskp = mask;
+      return total_bytes;
+    }
+  }
+  return total_bytes;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline void vec_classify_avx512(const unsigned char *s, unsigned char delimiter,
+                                       uint64_t *quotes, uint64_t *delims, uint64_t *ends) {
+  __m512i str_simd = _mm512_loadu_si512((const void *)s);
+  *quotes = _mm512_cmpeq_epi8_mask(str_simd, _mm512_set1_epi8('"'));
+  *delims = _mm512_cmpeq_epi8_mask(str_simd, _mm512_set1_epi8((char)delimiter));
+  *ends = _mm512_cmpeq_epi8_mask(str_simd, _mm512_set1_epi8('\n'))
+    | _mm512_cmpeq_epi8_mask(str_simd, _mm512_set1_epi8('\r'));
+}
+
+#define vec_prefix_xor_avx512 zsv_prefix_xor_clmul
+#endif /* ZSV_VEC_X86 */
+
+#ifdef ZSV_VEC_NEON
+#define ZSV_VEC_BYTES_neon 16
+
+// bitfield of the non-zero bytes of v, each of which must be 0 or 0xFF
+static inline uint64_t zsv_neon_movemask(uint8x16_t v) {
+  static const uint8_t bits[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+  v = vandq_u8(v, vld1q_u8(bits));
+  return (uint64_t)vaddv_u8(vget_low_u8(v)) | ((uint64_t)vaddv_u8(vget_high_u8(v)) << 8);
+}
+
+static inline size_t vec_delims_neon(const unsigned char *s, size_t n,
+                                     unsigned char c1, unsigned char c2,
+                                     unsigned char c3, unsigned char c4,
+                                     uint64_t *maskp) {
+  uint8x16_t v1 = vdupq_n_u8(c1), v2 = vdupq_n_u8(c2), v3 = vdupq_n_u8(c3), v4 = vdupq_n_u8(c4);
+  size_t total_bytes = 0;
+  for(; total_bytes + ZSV_VEC_BYTES_neon <= n; total_bytes += ZSV_VEC_BYTES_neon) {
+    uint8x16_t str_simd = vld1q_u8(s + total_bytes);
+    uint8x16_t vtmp = vorrq_u8(vorrq_u8(vceqq_u8(str_simd, v1), vceqq_u8(str_simd, v2)),
+                               vorrq_u8(vceqq_u8(str_simd, v3), vceqq_u8(str_simd, v4)));
+    if(LIKELY(vmaxvq_u8(vtmp) != 0)) {
+      *maskp = zsv_neon_movemask(vtmp);
+      return total_bytes;
+    }
+  }
+  return total_bytes;
+}
+
+static inline void vec_classify_neon(const unsigned char *s, unsigned char delimiter,
+                                     uint64_t *quotes, uint64_t *delims, uint64_t *ends) {
+  uint8x16_t qt_v = vdupq_n_u8('"'), dl_v = vdupq_n_u8(delimiter);
+  uint8x16_t nl_v = vdupq_n_u8('\n'), cr_v = vdupq_n_u8('\r');
+  uint64_t q = 0, d = 0, e = 0;
+  for(int k = 0; k < 4; k++) {
+    uint8x16_t str_simd = vld1q_u8(s + k * 16);
+    q |= zsv_neon_movemask(vceqq_u8(str_simd, qt_v)) << (k * 16);
+    d |= zsv_neon_movemask(vceqq_u8(str_simd, dl_v)) << (k * 16);
+    e |= zsv_neon_movemask(vorrq_u8(vceqq_u8(str_simd, nl_v), vceqq_u8(str_simd, cr_v))) << (k * 16);
+  }
+  *quotes = q;
+  *delims = d;
+  *ends = e;
+}
+
+#define vec_prefix_xor_neon vec_prefix_xor_generic
+#endif /* ZSV_VEC_NEON */
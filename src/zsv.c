@@ -24,21 +24,63 @@ const char *zsv_lib_version() {
   return VERSION;
 }
 
+static void zsv_scan_insert_string(struct zsv_scanner *scanner) {
+  size_t len = strlen(scanner->insert_string);
+  if(len > scanner->buff.size)
+    len = scanner->buff.size - 1; // to do: throw an error instead
+  memcpy(scanner->buff.buff + scanner->partial_row_length, scanner->insert_string, len);
+  if(scanner->buff.buff[len] != '\n')
+    scanner->buff.buff[len] = '\n';
+  zsv_scan(scanner, scanner->buff.buff, len + 1);
+  scanner->insert_string = NULL;
+}
+
+#include "zsv_sniff.c"
+#include "zsv_mmap.c"
+#include "zsv_readahead.c"
+#include "zsv_file_reader.c"
+#include "zsv_batch.c"
+
+/**
+ * Double the buffer size, up to opts.max_buffsize, so that a row that fills
+ * the buffer can be completed. Return 0 on success
+ */
+static int zsv_grow_buffer(struct zsv_scanner *scanner) {
+  size_t size = scanner->buff.size;
+  if(size >= scanner->opts.max_buffsize)
+    return 1;
+  size_t new_size = size > scanner->opts.max_buffsize / 2 ? scanner->opts.max_buffsize : size * 2;
+  unsigned char *buff = malloc(new_size);
+  if(!buff) {
+    fprintf(stderr, "Out of memory!\n");
+    return 1;
+  }
+  memcpy(buff, scanner->buff.buff, scanner->partial_row_length);
+
+  // cells already parsed in the partial row point into the old buffer
+  for(size_t i = 0; i < scanner->row.used; i++)
+    scanner->row.cells[i].str = buff + (scanner->row.cells[i].str - scanner->buff.buff);
+  if(scanner->free_buff)
+    free(scanner->buff.buff);
+  scanner->free_buff = 1;
+  scanner->buff.buff = buff;
+  scanner->buff.size = new_size;
+  return 0;
+}
+
 ZSV_EXPORT
 enum zsv_status zsv_parse_more(struct zsv_scanner *scanner) {
+  if(scanner->buff_readonly)
+    return zsv_mmap_parse_more(scanner);
   if(scanner->insert_string) {
-    size_t len = strlen(scanner->insert_string);
-    if(len > scanner->buff.size)
-      len = scanner->buff.size - 1; // to do: throw an error instead
-    memcpy(scanner->buff.buff + scanner->partial_row_length, scanner->insert_string, len);
-    if(scanner->buff.buff[len] != '\n')
-      scanner->buff.buff[len] = '\n';
-    zsv_scan(scanner, scanner->buff.buff, len + 1);
-    scanner->insert_string = NULL;
+    // the inserted row is complete and is not part of the input, so nothing of it is kept
+    zsv_scan_insert_string(scanner);
+    scanner->old_bytes_read = scanner->row_start = scanner->cell_start = 0;
+    scanner->scanned_length = 0;
   }
   // if this is not the first parse call, we might have a partial
-  // row at the end of our buffer that must be moved
-  scanner->last = '\0';
+  // row at the end of our buffer that must be moved. otherwise, keep the
+  // last char from before, in case zsv_parse_string() is called again
   if(scanner->old_bytes_read) {
     scanner->last = scanner->buff.buff[scanner->old_bytes_read-1];
     if(scanner->row_start < scanner->old_bytes_read) {
@@ -49,7 +91,11 @@ enum zsv_status zsv_parse_more(struct zsv_scanner *scanner) {
       else
         memmove(scanner->buff.buff, scanner->buff.buff + scanner->row_start, len);
       scanner->partial_row_length = len;
+      ZSV_STATS_ADD(scanner, shifts, 1);
+      ZSV_STATS_ADD(scanner, shift_bytes, len);
+      scanner->cum_scanned_length += scanner->row_start;
     } else {
+      scanner->cum_scanned_length += scanner->old_bytes_read;
       scanner->cell_start = 0;
       scanner->row_start = 0;
       zsv_clear_cell(scanner);
@@ -62,11 +108,14 @@ enum zsv_status zsv_parse_more(struct zsv_scanner *scanner) {
     scanner->old_bytes_read = 0;
   }
 
-  scanner->cum_scanned_length += scanner->scanned_length;
   size_t capacity = scanner->buff.size - scanner->partial_row_length;
+  if(VERY_UNLIKELY(capacity == 0) && !zsv_grow_buffer(scanner))
+    capacity = scanner->buff.size - scanner->partial_row_length;
 
   if(VERY_UNLIKELY(capacity == 0)) { // our row size was too small to fit a single row of data
     fprintf(stderr, "Warning: row truncated\n");
+    ZSV_STATS_ADD(scanner, truncated_rows, 1);
+    scanner->raw_row_modified = 1;
     if(scanner->mode == ZSV_MODE_FIXED) {
       if(VERY_UNLIKELY(row_fx(scanner, scanner->buff.buff, 0, scanner->buff.size)))
         return zsv_status_cancelled;
@@ -80,13 +129,17 @@ enum zsv_status zsv_parse_more(struct zsv_scanner *scanner) {
     scanner->opts.row = zsv_throwaway_row;
     scanner->opts.ctx = scanner;
 
+    scanner->cum_scanned_length += scanner->partial_row_length;
     scanner->partial_row_length = 0;
     capacity = scanner->buff.size;
   }
 
   size_t bytes_read;
+  char first_read = 0;
 
+  ZSV_STATS_TIMER_START(read_start);
   if(UNLIKELY(!scanner->checked_bom)) {
+    first_read = 1;
 
 #ifdef ZSV_EXTRAS
     // initialize progress timer
@@ -96,19 +149,22 @@ enum zsv_status zsv_parse_more(struct zsv_scanner *scanner) {
 
     size_t bom_len = strlen(ZSV_BOM);
     scanner->checked_bom = 1;
-    if(scanner->read(scanner->buff.buff, 1, bom_len, scanner->in) == bom_len
-       && !memcmp(scanner->buff.buff, ZSV_BOM, bom_len)) {
+    size_t n = scanner->read(scanner->buff.buff, 1, bom_len, scanner->in);
+    if(n == bom_len && !memcmp(scanner->buff.buff, ZSV_BOM, bom_len)) {
       // have bom. disregard what we just read
       bytes_read = scanner->read(scanner->buff.buff, 1, capacity, scanner->in);
       scanner->had_bom = 1;
     } else // no BOM. keep the bytes we just read
-      bytes_read = bom_len + scanner->read(scanner->buff.buff + bom_len, 1, capacity - bom_len, scanner->in);
+      bytes_read = n + scanner->read(scanner->buff.buff + n, 1, capacity - n, scanner->in);
   } else // already checked bom. read as usual
     bytes_read = scanner->read(scanner->buff.buff + scanner->partial_row_length, 1,
                                capacity, scanner->in);
+  ZSV_STATS_TIMER_STOP(scanner, read_ns, read_start);
   if(UNLIKELY(scanner->filter != NULL))
     bytes_read = scanner->filter(scanner->filter_ctx,
                                  scanner->buff.buff + scanner->partial_row_length, bytes_read);
+  if(UNLIKELY(first_read))
+    zsv_scanner_sniff(scanner, scanner->buff.buff + scanner->partial_row_length, bytes_read);
   if(VERY_LIKELY(bytes_read))
     return zsv_scan(scanner, scanner->buff.buff, bytes_read);
   scanner->scanned_length = scanner->partial_row_length;
@@ -159,8 +215,58 @@ struct zsv_cell zsv_get_cell(zsv_parser parser, size_t ix) {
   return c;
 }
 
+ZSV_EXPORT
+struct zsv_cell zsv_get_cell_unescaped(zsv_parser parser, size_t ix) {
+  struct zsv_cell c = zsv_get_cell(parser, ix);
+  if(LIKELY(!(c.quoted & ZSV_PARSER_QUOTE_RAW)))
+    return c;
+
+  // c.str is a quoted value with embedded "" pairs
+  unsigned char *s = zsv_arena_alloc(&parser->unescaped, c.len);
+  if(!s) {
+    c.len = 0;
+    return c;
+  }
+  parser->have_unescaped = 1;
+  size_t n = 0;
+  for(size_t i = 1; i + 1 < c.len; i++) {
+    s[n++] = c.str[i];
+    if(c.str[i] == '"' && c.str[i+1] == '"')
+      i++;
+  }
+  c.str = s;
+  c.len = n;
+  c.quoted &= ~ZSV_PARSER_QUOTE_RAW;
+  return c;
+}
+
+ZSV_EXPORT
+struct zsv_cell zsv_get_row_raw(zsv_parser parser) {
+  struct zsv_cell c = { 0, 0, 0 };
+  if(!parser->scan_buff || parser->raw_row_modified)
+    return c;
+
+  // a row of another dialect is not CSV as-is
+  unsigned char quoted = parser->mode != ZSV_MODE_DELIM || parser->opts.delimiter != ',' ? ZSV_PARSER_QUOTE_NEEDED : 0;
+  for(size_t i = 0; i < parser->row.used; i++) {
+    if(parser->projection && !parser->projection[i])
+      return c; // quoting of a skipped cell is not known
+    quoted |= parser->row.cells[i].quoted;
+  }
+  c.str = parser->scan_buff + parser->row_start;
+  c.len = parser->scanned_length - parser->row_start;
+  c.quoted = quoted;
+  return c;
+}
+
 ZSV_EXPORT
 void zsv_set_input(zsv_parser parser, void *in) {
+#ifdef ZSV_HAVE_READAHEAD
+  if(parser->readahead) {
+    parser->readahead->in = in;
+    return;
+  }
+#endif
   parser->in = in;
 }
 
@@ -189,16 +295,27 @@ ZSV_EXPORT enum zsv_status zsv_set_fixed_offsets(zsv_parser parser, size_t count
     fprintf(stderr, "Scanner mode cannot be changed after parsing has begun\n");
     return zsv_status_invalid_option;
   }
+  if(count > parser->row.allocated && zsv_row_reserve(parser, count)) {
+    fprintf(stderr, "Fixed offset count %zu exceeds max column count %u\n", count, parser->opts.max_columns);
+    return zsv_status_invalid_option;
+  }
 
   free(parser->fixed.offsets);
+  free(parser->fixed.cell_starts);
+  free(parser->fixed.cell_lengths);
   parser->fixed.offsets = calloc(count, sizeof(*parser->fixed.offsets));
-  if(!parser->fixed.offsets) {
+  parser->fixed.cell_starts = calloc(count, sizeof(*parser->fixed.cell_starts));
+  parser->fixed.cell_lengths = calloc(count, sizeof(*parser->fixed.cell_lengths));
+  if(!parser->fixed.offsets || !parser->fixed.cell_starts || !parser->fixed.cell_lengths) {
     fprintf(stderr, "Out of memory!\n");
     return zsv_status_memory;
   }
   parser->fixed.count = count;
-  for(unsigned i = 0; i < count; i++)
+  for(unsigned i = 0; i < count; i++) {
     parser->fixed.offsets[i] = offsets[i];
+    parser->fixed.cell_starts[i] = i ? offsets[i-1] : 0;
+    parser->fixed.cell_lengths[i] = offsets[i] - parser->fixed.cell_starts[i];
+  }
 
   parser->mode = ZSV_MODE_FIXED;
 
@@ -207,6 +324,55 @@ ZSV_EXPORT enum zsv_status zsv_set_fixed_offsets(zsv_parser parser, size_t count
   return zsv_status_ok;
 }
 
+ZSV_EXPORT enum zsv_status zsv_set_fixed_record_length(zsv_parser parser, size_t record_length) {
+  if(parser->mode != ZSV_MODE_FIXED) {
+    fprintf(stderr, "Fixed record length requires fixed offsets to be set first\n");
+    return zsv_status_invalid_option;
+  }
+  if(record_length > parser->buff.size) {
+    fprintf(stderr, "Record length %zu exceeds total buffer size %zu\n", record_length, parser->buff.size);
+    return zsv_status_invalid_option;
+  }
+  if(parser->cum_scanned_length) {
+    fprintf(stderr, "Scanner mode cannot be changed after parsing has begun\n");
+    return zsv_status_invalid_option;
+  }
+  if(record_length && record_length < parser->fixed.offsets[parser->fixed.count - 1])
+    fprintf(stderr, "Warning: record length %zu is less than the last offset %u\n",
+            record_length, parser->fixed.offsets[parser->fixed.count - 1]);
+  parser->fixed.record_length = record_length;
+  zsv_scanner_select_scan(parser, &parser->opts);
+  return zsv_status_ok;
+}
+
+ZSV_EXPORT
+enum zsv_status zsv_set_malformed_utf8_replace(zsv_parser parser, unsigned char value) {
+  parser->utf8_check = 1;
+  parser->utf8_replace = value;
+  return zsv_status_ok;
+}
+
+ZSV_EXPORT
+enum zsv_status zsv_set_projection(zsv_parser parser, const unsigned *indexes, size_t n) {
+  if(!indexes) {
+    free(parser->projection);
+    parser->projection = NULL;
+    return zsv_status_ok;
+  }
+
+  // sized for max_columns, so that it need not grow with the cells array
+  if(!parser->projection
+     && !(parser->projection = malloc(parser->opts.max_columns * sizeof(*parser->projection)))) {
+    fprintf(stderr, "Out of memory!\n");
+    return zsv_status_memory;
+  }
+  memset(parser->projection, 0, parser->opts.max_columns * sizeof(*parser->projection));
+  for(size_t i = 0; i < n; i++)
+    if(indexes[i] < parser->opts.max_columns)
+      parser->projection[indexes[i]] = 1;
+  return zsv_status_ok;
+}
+
 // to do: simplify. do not require buff or buffsize
 ZSV_EXPORT
 zsv_parser zsv_new(struct zsv_opts *opts) {
@@ -225,7 +391,8 @@ zsv_parser zsv_new(struct zsv_opts *opts) {
   }
   struct zsv_scanner *scanner = calloc(1, sizeof(*scanner));
   if(scanner) {
-    if(zsv_scanner_init(scanner, opts)) {
+    if(zsv_scanner_init(scanner, opts)
+       || (opts->readahead_depth && zsv_readahead_new(scanner))) {
       zsv_delete(scanner);
       scanner = NULL;
     }
@@ -233,41 +400,58 @@ zsv_parser zsv_new(struct zsv_opts *opts) {
   return scanner;
 }
 
-ZSV_EXPORT
-enum zsv_status zsv_finish(struct zsv_scanner *scanner) {
-  enum zsv_status stat = zsv_status_ok;
-  if(!scanner->abort) {
-    if(scanner->mode == ZSV_MODE_FIXED) {
-      if(scanner->partial_row_length)
-        return row_fx(scanner, scanner->buff.buff, 0, scanner->partial_row_length);
-      return zsv_status_ok;
-    }
+/**
+ * Output the last row of the input, if it did not end with a row delimiter
+ */
+static enum zsv_status zsv_finish_input(struct zsv_scanner *scanner) {
+  if(scanner->abort)
+    return zsv_status_cancelled;
+  scanner->scan_buff = scanner->buff.buff;
+  if(scanner->mode == ZSV_MODE_FIXED) {
+    scanner->scanned_length = scanner->partial_row_length;
+    if(scanner->partial_row_length && row_fx(scanner, scanner->buff.buff, 0, scanner->partial_row_length))
+      return zsv_status_cancelled;
+    return zsv_status_ok;
+  }
 
-    if((scanner->quoted & ZSV_PARSER_QUOTE_UNCLOSED)
-       && scanner->partial_row_length > scanner->cell_start + 1) {
-      int quote = '"';
-      scanner->quoted |= ZSV_PARSER_QUOTE_CLOSED;
-      scanner->quoted -= ZSV_PARSER_QUOTE_UNCLOSED;
-      if(scanner->last == quote)
-        scanner->quote_close_position = scanner->partial_row_length - scanner->cell_start;
-      else {
-        scanner->quote_close_position = scanner->partial_row_length - scanner->cell_start + 1;
-        scanner->scanned_length++;
-      }
+  if((scanner->quoted & ZSV_PARSER_QUOTE_UNCLOSED)
+     && scanner->partial_row_length > scanner->cell_start + 1) {
+    int quote = '"';
+    scanner->raw_row_modified = 1; // the row's bytes lack the closing quote
+    scanner->quoted |= ZSV_PARSER_QUOTE_CLOSED;
+    scanner->quoted -= ZSV_PARSER_QUOTE_UNCLOSED;
+    if(scanner->last == quote)
+      scanner->quote_close_position = scanner->partial_row_length - scanner->cell_start;
+    else {
+      scanner->quote_close_position = scanner->partial_row_length - scanner->cell_start + 1;
+      scanner->scanned_length++;
     }
   }
 
+  if(VERY_UNLIKELY(scanner->utf8_check) && scanner->scanned_length > scanner->cell_start) {
+    // a sequence cut off at the end of the input is now malformed
+    scanner->utf8_end = scanner->buff.buff + scanner->scanned_length;
+    scanner->utf8_malformed = zsv_utf8_find_malformed(scanner->buff.buff + scanner->cell_start,
+                                                      scanner->utf8_end, 0);
+  }
+  if(scanner->scanned_length > scanner->cell_start)
+    cell_dl(scanner, scanner->buff.buff + scanner->cell_start,
+            scanner->scanned_length - scanner->cell_start, 1);
+  if(scanner->have_cell)
+    if(row_dl(scanner))
+      return zsv_status_cancelled;
+  return zsv_status_ok;
+}
+
+ZSV_EXPORT
+enum zsv_status zsv_finish(struct zsv_scanner *scanner) {
+  enum zsv_status stat = zsv_status_ok;
   if(!scanner->finished) {
     scanner->finished = 1;
-    if(!scanner->abort) {
-      if(scanner->scanned_length > scanner->cell_start)
-        cell_dl(scanner, scanner->buff.buff + scanner->cell_start,
-                scanner->scanned_length - scanner->cell_start, 1);
-      if(scanner->have_cell)
-        if(row_dl(scanner))
-          stat = zsv_status_cancelled;
-    } else
-      stat = zsv_status_cancelled;
+    stat = zsv_finish_input(scanner);
+    if(scanner->row.overflow_rows)
+      fprintf(stderr, "Warning: %zu row(s) had more than the max of %u columns (up to %zu); extra columns were ignored\n",
+              scanner->row.overflow_rows, scanner->opts.max_columns, scanner->row.overflow_max);
 #ifdef ZSV_EXTRAS
     if(scanner->opts.completed.callback)
       scanner->opts.completed.callback(scanner->opts.completed.ctx, stat);
@@ -276,9 +460,154 @@ enum zsv_status zsv_finish(struct zsv_scanner *scanner) {
   return stat;
 }
 
+/**
+ * Clear the state of the scan, and the buffer's contents, so that the next
+ * zsv_parse_more() starts a new input
+ */
+static void zsv_clear_scan(struct zsv_scanner *scanner) {
+  scanner->last = '\0';
+  scanner->cell_start = scanner->row_start = 0;
+  scanner->quote_close_position = 0;
+  scanner->waiting_for_end = 0;
+  scanner->quote_pending = 0;
+  zsv_clear_cell(scanner);
+  scanner->row.used = scanner->row.overflow = 0;
+  scanner->scanned_length = scanner->partial_row_length = scanner->old_bytes_read = 0;
+  scanner->have_cell = 0;
+  scanner->utf8_malformed = NULL;
+  zsv_arena_reset(&scanner->arena);
+  if(scanner->have_unescaped) {
+    zsv_arena_reset(&scanner->unescaped);
+    scanner->have_unescaped = 0;
+  }
+  // fixed-width input is not checked for a bom (see zsv_set_fixed_offsets())
+  scanner->checked_bom = scanner->mode == ZSV_MODE_FIXED;
+  scanner->had_bom = 0;
+}
+
+/**
+ * Read further input from stream, with read-ahead if so configured
+ */
+static enum zsv_status zsv_set_stream(struct zsv_scanner *scanner, void *stream) {
+  zsv_readahead_delete(scanner);
+  scanner->opts.stream = stream;
+  scanner->in = stream;
+  if(!scanner->opts.read) {
+    scanner->read = (zsv_generic_read)fread;
+    if(!stream)
+      scanner->in = stdin;
+  } else
+    scanner->read = scanner->opts.read;
+  if(scanner->opts.readahead_depth)
+    return zsv_readahead_new(scanner);
+  return zsv_status_ok;
+}
+
+/**
+ * Return non-zero, with a message, if the parser's input cannot be replaced
+ */
+static int zsv_input_fixed(struct zsv_scanner *scanner, const char *what) {
+  if(scanner->buff_readonly || scanner->own_stream || scanner->caller_buff) {
+    fprintf(stderr, "%s cannot be used with a memory-mapped file or with zsv_parse_buffer()\n", what);
+    return 1;
+  }
+  return 0;
+}
+
+ZSV_EXPORT
+enum zsv_status zsv_reset(zsv_parser parser, void *new_stream) {
+  if(zsv_input_fixed(parser, "zsv_reset()"))
+    return zsv_status_invalid_option;
+  if(parser->opts.row == zsv_throwaway_row) {
+    parser->opts.row = parser->row_orig;
+    parser->opts.ctx = parser->row_ctx_orig;
+  }
+  zsv_clear_scan(parser);
+  parser->cum_scanned_length = 0;
+  parser->row.overflow_rows = parser->row.overflow_max = 0;
+  parser->insert_string = parser->opts.insert_header_row;
+#ifdef ZSV_EXTRAS
+  parser->progress.cum_row_count = 0;
+#endif
+  parser->index = NULL;
+  parser->seeked = 0;
+  parser->finished = 0;
+  parser->abort = 0;
+  zsv_batch_reset(parser);
+  return zsv_set_stream(parser, new_stream);
+}
+
+ZSV_EXPORT
+enum zsv_status zsv_next_input(zsv_parser parser, void *f_next_input) {
+  if(zsv_input_fixed(parser, "zsv_next_input()"))
+    return zsv_status_invalid_option;
+  if(parser->finished) {
+    // zsv_finish() e.g. from zsv_parse_batch() has output the last row, and reported any overflow
+    parser->finished = 0;
+    parser->row.overflow_rows = parser->row.overflow_max = 0;
+  } else {
+    enum zsv_status stat = zsv_finish_input(parser);
+    if(stat != zsv_status_ok)
+      return stat;
+  }
+
+  // all of the input has now been scanned, so offsets carry on from its end
+  parser->cum_scanned_length += parser->scanned_length + (parser->had_bom ? strlen(ZSV_BOM) : 0);
+  zsv_clear_scan(parser);
+  zsv_batch_reset(parser);
+  return zsv_set_stream(parser, f_next_input);
+}
+
+ZSV_EXPORT
+struct zsv_stats zsv_get_stats(zsv_parser parser) {
+  struct zsv_stats stats = { 0 };
+#ifdef ZSV_STATS
+  stats.rows = parser->stats.rows;
+  stats.cells = parser->stats.cells;
+  stats.quoted_cells = parser->stats.quoted_cells;
+  stats.embedded_quote_cells = parser->stats.embedded_quote_cells;
+  stats.dequote_bytes_moved = parser->stats.dequote_bytes_moved;
+  stats.shifts = parser->stats.shifts;
+  stats.shift_bytes = parser->stats.shift_bytes;
+  stats.truncated_rows = parser->stats.truncated_rows;
+  stats.read_seconds = parser->stats.read_ns / 1e9;
+  stats.scan_seconds = parser->stats.scan_ns / 1e9;
+#endif
+  stats.overflow_rows = parser->row.overflow_rows;
+  return stats;
+}
+
+static void zsv_print_stats(zsv_parser parser) {
+#ifdef ZSV_STATS
+  struct zsv_stats stats = zsv_get_stats(parser);
+  fprintf(stderr, "Parser stats:\n"
+          "  rows: %zu\n"
+          "  cells: %zu\n"
+          "  quoted cells: %zu\n"
+          "  cells with embedded quotes: %zu\n"
+          "  bytes moved by dequoting: %zu\n"
+          "  partial row shifts: %zu (%zu bytes)\n"
+          "  overflowed rows: %zu\n"
+          "  truncated rows: %zu\n"
+          "  read time: %.3fs\n"
+          "  scan time: %.3fs\n",
+          stats.rows, stats.cells, stats.quoted_cells, stats.embedded_quote_cells,
+          stats.dequote_bytes_moved, stats.shifts, stats.shift_bytes,
+          stats.overflow_rows, stats.truncated_rows,
+          stats.read_seconds, stats.scan_seconds);
+#else
+  (void)(parser);
+  fprintf(stderr, "Parser stats are not available: rebuild with ZSV_STATS=1\n");
+#endif
+}
+
 ZSV_EXPORT
 enum zsv_status zsv_delete(zsv_parser parser) {
   if(parser) {
+    if(parser->opts.stats)
+      zsv_print_stats(parser);
+    zsv_readahead_delete(parser);
+    zsv_mmap_delete(parser);
     if(parser->free_buff && parser->buff.buff)
       free(parser->buff.buff);
 
@@ -286,6 +615,11 @@ enum zsv_status zsv_delete(zsv_parser parser) {
       free(parser->row.cells);
 
     free(parser->fixed.offsets);
+    free(parser->fixed.cell_starts);
+    free(parser->fixed.cell_lengths);
+    free(parser->projection);
+    zsv_arena_delete(&parser->unescaped);
+    zsv_batch_delete(parser);
 
     free(parser);
   }
@@ -333,3 +667,8 @@ ZSV_EXPORT
 size_t zsv_cum_scanned_length(zsv_parser parser) {
   return parser->cum_scanned_length + parser->scanned_length + (parser->had_bom ? strlen(ZSV_BOM) : 0);
 }
+
+#include "zsv_buffer.c"
+#include "zsv_fixed_detect.c"
+#include "zsv_index.c"
+#include "zsv_parallel.c"
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+/*
+ * Batch row delivery (see zsv_parse_batch())
+ *
+ * The row handler is replaced with zsv_batch_row(), which appends each row's
+ * cells to flat arrays. All rows parsed in one call to zsv_parse_more() stay
+ * valid until the next call, so zsv_parse_batch() only parses more once every
+ * row collected from the last call has been handed out
+ */
+
+#include <stdint.h>
+
+struct zsv_batch {
+  size_t *row_starts; // row_count + 1 entries
+  size_t rows_allocated;
+  size_t row_count;
+  size_t next_row; // next row to return
+
+  size_t *cell_offsets;
+  size_t *cell_lengths;
+  char *cell_quoted;
+  size_t cells_allocated;
+  size_t cell_count;
+
+  const unsigned char *base;
+  enum zsv_status stat; // status to return once all collected rows are returned
+  char err;
+};
+
+static int zsv_batch_grow(void **p, size_t n, size_t size) {
+  void *tmp = realloc(*p, n * size);
+  if(!tmp)
+    return 1;
+  *p = tmp;
+  return 0;
+}
+
+/**
+ * Make room for the given number of additional rows and cells
+ * @return non-zero if out of memory
+ */
+static int zsv_batch_reserve(struct zsv_batch *b, size_t rows, size_t cells) {
+  if(VERY_UNLIKELY(b->row_count + rows + 1 > b->rows_allocated)) {
+    size_t rows_allocated = b->rows_allocated ? b->rows_allocated * 2 : 1024;
+    while(rows_allocated < b->row_count + rows + 1)
+      rows_allocated *= 2;
+    if(zsv_batch_grow((void **)&b->row_starts, rows_allocated, sizeof(*b->row_starts)))
+      return 1;
+    b->rows_allocated = rows_allocated;
+  }
+  if(VERY_UNLIKELY(b->cell_count + cells > b->cells_allocated)) {
+    size_t cells_allocated = b->cells_allocated ? b->cells_allocated * 2 : 16384;
+    while(cells_allocated < b->cell_count + cells)
+      cells_allocated *= 2;
+    if(zsv_batch_grow((void **)&b->cell_offsets, cells_allocated, sizeof(*b->cell_offsets))
+       || zsv_batch_grow((void **)&b->cell_lengths, cells_allocated, sizeof(*b->cell_lengths))
+       || zsv_batch_grow((void **)&b->cell_quoted, cells_allocated, sizeof(*b->cell_quoted)))
+      return 1;
+    b->cells_allocated = cells_allocated;
+  }
+  return 0;
+}
+
+static void zsv_batch_row(void *ctx) {
+  struct zsv_scanner *scanner = ctx;
+  struct zsv_batch *b = scanner->batch;
+  size_t n = scanner->row.used;
+
+  if(VERY_UNLIKELY(zsv_batch_reserve(b, 1, n)))
+    goto no_memory;
+
+  if(!b->base)
+    b->base = scanner->buff.buff;
+  uintptr_t base = (uintptr_t)b->base;
+  size_t *offsets = b->cell_offsets + b->cell_count;
+  size_t *lengths = b->cell_lengths + b->cell_count;
+  char *quoted = b->cell_quoted + b->cell_count;
+  for(size_t i = 0; i < n; i++) {
+    const struct zsv_cell *c = &scanner->row.cells[i];
+    offsets[i] = (uintptr_t)c->str - base;
+    lengths[i] = c->len;
+    quoted[i] = c->quoted;
+  }
+  b->row_starts[b->row_count] = b->cell_count;
+  b->cell_count += n;
+  b->row_starts[++b->row_count] = b->cell_count;
+  return;
+
+no_memory:
+  fprintf(stderr, "Out of memory!\n");
+  b->err = 1;
+  scanner->abort = 1;
+}
+
+/**
+ * Append count fixed-width rows of row_length bytes each, starting at
+ * buff + row_start, directly from the precomputed cell starts and lengths
+ * instead of one row at a time through the row handler. Cells of rows as long
+ * as the last offset are simply the table shifted by the row position, which
+ * the compiler vectorizes; only a short row needs its cells cut off
+ *
+ * @return non-zero if parsing should stop
+ */
+static char zsv_batch_fixed_rows(struct zsv_scanner *scanner, unsigned char *buff,
+                                 size_t row_start, size_t row_length, size_t count) {
+  struct zsv_batch *b = scanner->batch;
+  const size_t n = scanner->fixed.count;
+  if(VERY_UNLIKELY(zsv_batch_reserve(b, count, n * count))) {
+    fprintf(stderr, "Out of memory!\n");
+    b->err = 1;
+    scanner->abort = 1;
+    return 1;
+  }
+
+  if(!b->base)
+    b->base = scanner->buff.buff;
+  const size_t *starts = scanner->fixed.cell_starts;
+  const size_t *lengths = scanner->fixed.cell_lengths;
+  size_t at = (uintptr_t)(buff + row_start) - (uintptr_t)b->base;
+  char full = row_length >= scanner->fixed.offsets[n - 1];
+  for(size_t r = 0; r < count; r++, at += row_length) {
+    size_t *offsets = b->cell_offsets + b->cell_count;
+    size_t *cell_lengths = b->cell_lengths + b->cell_count;
+    if(VERY_LIKELY(full)) {
+      for(size_t i = 0; i < n; i++)
+        offsets[i] = at + starts[i];
+      memcpy(cell_lengths, lengths, n * sizeof(*lengths));
+    } else {
+      for(size_t i = 0; i < n; i++) {
+        size_t start = starts[i] < row_length ? starts[i] : row_length;
+        size_t end = scanner->fixed.offsets[i] < row_length ? scanner->fixed.offsets[i] : row_length;
+        offsets[i] = at + start;
+        cell_lengths[i] = end - start;
+      }
+    }
+    memset(b->cell_quoted + b->cell_count, 1, n);
+    b->row_starts[b->row_count] = b->cell_count;
+    b->cell_count += n;
+    b->row_starts[++b->row_count] = b->cell_count;
+  }
+  ZSV_STATS_ADD(scanner, cells, n * count);
+  ZSV_STATS_ADD(scanner, rows, count);
+  return scanner->abort;
+}
+
+static void zsv_batch_delete(struct zsv_scanner *scanner) {
+  struct zsv_batch *b = scanner->batch;
+  if(b) {
+    free(b->row_starts);
+    free(b->cell_offsets);
+    free(b->cell_lengths);
+    free(b->cell_quoted);
+    free(b);
+    scanner->batch = NULL;
+  }
+}
+
+// see zsv_reset()
+static void zsv_batch_reset(struct zsv_scanner *scanner) {
+  struct zsv_batch *b = scanner->batch;
+  if(b) {
+    b->row_count = b->cell_count = b->next_row = 0;
+    b->base = NULL;
+    b->stat = zsv_status_ok;
+    b->err = 0;
+  }
+}
+
+ZSV_EXPORT
+enum zsv_status zsv_parse_batch(zsv_parser parser, struct zsv_row_batch *out, size_t max_rows) {
+  struct zsv_batch *b = parser->batch;
+  if(!b) {
+    if(!(b = parser->batch = calloc(1, sizeof(*b)))) {
+      fprintf(stderr, "Out of memory!\n");
+      return zsv_status_memory;
+    }
+    parser->opts.row = zsv_batch_row;
+    parser->opts.ctx = parser;
+  }
+
+  while(b->next_row == b->row_count) {
+    if(b->stat != zsv_status_ok) {
+      memset(out, 0, sizeof(*out));
+      return b->stat;
+    }
+    b->row_count = b->cell_count = b->next_row = 0;
+    b->base = NULL;
+
+    enum zsv_status stat = zsv_parse_more(parser);
+    if(stat == zsv_status_no_more_input) {
+      stat = zsv_finish(parser);
+      if(stat == zsv_status_ok)
+        stat = zsv_status_no_more_input;
+    }
+    b->stat = b->err ? zsv_status_memory : stat;
+  }
+
+  size_t n = b->row_count - b->next_row;
+  if(max_rows && n > max_rows)
+    n = max_rows;
+  out->row_count = n;
+  out->row_starts = b->row_starts + b->next_row;
+  out->base = b->base;
+  out->cell_offsets = b->cell_offsets;
+  out->cell_lengths = b->cell_lengths;
+  out->cell_quoted = b->cell_quoted;
+  b->next_row += n;
+  return zsv_status_ok;
+}
@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+/*
+ * Parsing of data that is already in memory (see zsv_parse_buffer() and
+ * zsv_parse_string())
+ *
+ * zsv_parse_buffer() scans each chunk in place, as a read-only buffer in the
+ * same way as zsv_new_mmap(), so cells that must be modified to remove quotes
+ * are copied to the arena and the caller's memory is never written to. Only a
+ * partial row at the end of a chunk is copied, unmodified, to our own buffer.
+ * When the next chunk arrives, as much of it as fits is appended to that row,
+ * which is then scanned from its start, since its cells pointed into the
+ * previous chunk. If the row is still not complete, later chunks are appended
+ * and scanned as zsv_parse_more() would. Once the row is complete, scanning
+ * continues in place at the next row of the chunk
+ */
+
+/**
+ * Set up the scanner to scan len bytes at buff from the start of a row, where
+ * last is the char that preceded buff
+ */
+static void zsv_buffer_restart(struct zsv_scanner *scanner, const unsigned char *buff,
+                               size_t len, unsigned char last) {
+  scanner->buff.buff = (unsigned char *)buff;
+  scanner->readonly_end = buff + len;
+  scanner->last = last;
+  scanner->partial_row_length = scanner->old_bytes_read = 0;
+  scanner->row_start = scanner->cell_start = scanner->scanned_length = 0;
+  scanner->row.used = scanner->row.overflow = 0;
+  scanner->have_cell = 0;
+  scanner->waiting_for_end = 0;
+  scanner->quote_pending = 0;
+  zsv_clear_cell(scanner);
+  zsv_arena_reset(&scanner->arena);
+}
+
+/**
+ * Grow our own buffer, keeping the carried partial row. Return 0 on success
+ */
+static int zsv_buffer_grow(struct zsv_scanner *scanner) {
+  unsigned char *buff = scanner->buff.buff;
+  size_t used = scanner->row.used; // cells parsed so far don't point into our buffer
+  scanner->buff.buff = scanner->mmap.work_buff;
+  scanner->buff.size = scanner->mmap.work_size;
+  scanner->partial_row_length = scanner->carry.length;
+  scanner->row.used = 0;
+  int err = zsv_grow_buffer(scanner);
+  scanner->row.used = used;
+  scanner->mmap.work_buff = scanner->buff.buff;
+  scanner->mmap.work_size = scanner->buff.size;
+  scanner->buff.buff = buff;
+  return err;
+}
+
+/**
+ * Output the row parsed so far, and throw away the rest of it, as
+ * zsv_parse_more() does when a row does not fit in the buffer
+ */
+static enum zsv_status zsv_buffer_truncate(struct zsv_scanner *scanner) {
+  fprintf(stderr, "Warning: row truncated\n");
+  ZSV_STATS_ADD(scanner, truncated_rows, 1);
+  scanner->raw_row_modified = 1;
+  if(scanner->mode == ZSV_MODE_FIXED) {
+    if(VERY_UNLIKELY(row_fx(scanner, scanner->buff.buff, scanner->row_start, scanner->old_bytes_read)))
+      return zsv_status_cancelled;
+  } else if(VERY_UNLIKELY(row_dl(scanner)))
+    return zsv_status_cancelled;
+
+  scanner->row_orig = scanner->opts.row;
+  scanner->row_ctx_orig = scanner->opts.ctx;
+  scanner->opts.row = zsv_throwaway_row;
+  scanner->opts.ctx = scanner;
+  return zsv_status_ok;
+}
+
+ZSV_EXPORT
+enum zsv_status zsv_parse_buffer(zsv_parser scanner, const unsigned char *buff, size_t len,
+                                 char is_final) {
+  enum zsv_status stat;
+  if(VERY_UNLIKELY(!scanner->caller_buff)) {
+    if(scanner->buff_readonly || scanner->checked_bom) {
+      fprintf(stderr, "zsv_parse_buffer() cannot be used after other input has been parsed\n");
+      return zsv_status_invalid_option;
+    }
+    if(scanner->filter) {
+      fprintf(stderr, "zsv_parse_buffer() cannot be used with a filter\n");
+      return zsv_status_invalid_option;
+    }
+
+#ifdef ZSV_EXTRAS
+    if(scanner->opts.progress.seconds_interval)
+      scanner->progress.last_time = time(NULL);
+#endif
+
+    if(scanner->insert_string)
+      zsv_scan_insert_string(scanner);
+
+    // keep our own buffer for partial rows. zsv_mmap_delete() restores it
+    scanner->mmap.work_buff = scanner->buff.buff;
+    scanner->mmap.work_size = scanner->buff.size;
+
+    // a bom may be split across chunks, so hold back what may be the start of one
+    size_t bom_len = strlen(ZSV_BOM);
+    size_t held = scanner->carry.length;
+    while(held < bom_len && len && *buff == (unsigned char)ZSV_BOM[held]) {
+      scanner->mmap.work_buff[held++] = *buff++;
+      len--;
+    }
+    if(held == bom_len) {
+      scanner->had_bom = 1;
+      held = 0;
+    } else if(!len && !is_final) {
+      scanner->carry.length = held;
+      return zsv_status_ok;
+    }
+    scanner->carry.length = held; // not a bom after all, so it is data
+    scanner->checked_bom = 1;
+    zsv_scanner_sniff(scanner, buff, len);
+    scanner->buff_readonly = 1;
+    scanner->caller_buff = 1;
+  }
+
+  while(scanner->carry.length) {
+    // append as much as fits to the partial row
+    unsigned char *own = scanner->mmap.work_buff;
+    size_t carried = scanner->carry.length;
+    size_t n = scanner->mmap.work_size - carried;
+    if(n > len)
+      n = len;
+    memcpy(own + carried, buff, n);
+    if(scanner->carry.scanned) {
+      // continue the scan of the row where it left off
+      scanner->partial_row_length = carried;
+      scanner->old_bytes_read = 0;
+      scanner->readonly_end = own + carried + n;
+      stat = zsv_scan(scanner, own, n);
+    } else {
+      zsv_buffer_restart(scanner, own, carried + n, scanner->carry.last);
+      stat = zsv_scan(scanner, own, carried + n);
+    }
+    if(stat != zsv_status_ok)
+      return stat;
+
+    if(scanner->row_start >= carried) {
+      // the row is complete. continue in place at the next row
+      size_t offset = scanner->row_start - carried;
+      scanner->carry.last = own[scanner->row_start - 1];
+      scanner->carry.length = 0;
+      scanner->cum_scanned_length += scanner->row_start;
+      buff += offset;
+      len -= offset;
+      break;
+    }
+
+    scanner->carry.length = carried + n;
+    scanner->carry.scanned = 1;
+    buff += n;
+    len -= n;
+    if(!len) {
+      if(!is_final)
+        return zsv_status_ok;
+      zsv_scan_rebase(scanner);
+      return zsv_finish(scanner);
+    }
+
+    // our buffer is full. cells of the row may point into it, so rescan after growing
+    scanner->carry.scanned = 0;
+    if(zsv_buffer_grow(scanner)) {
+      if((stat = zsv_buffer_truncate(scanner)) != zsv_status_ok)
+        return stat;
+      scanner->carry.last = own[carried + n - 1];
+      scanner->carry.length = 0;
+      scanner->cum_scanned_length += carried + n;
+    }
+  }
+
+  zsv_buffer_restart(scanner, buff, len, scanner->carry.last);
+  if(len && (stat = zsv_scan(scanner, (unsigned char *)buff, len)) != zsv_status_ok)
+    return stat;
+
+  if(is_final) {
+    scanner->cum_scanned_length += scanner->row_start;
+    zsv_scan_rebase(scanner);
+    return zsv_finish(scanner);
+  }
+
+  // keep the partial row at the end for the next chunk
+  size_t partial = len - scanner->row_start;
+  if(partial) {
+    while(scanner->mmap.work_size < partial && !zsv_buffer_grow(scanner))
+      ;
+    if(scanner->mmap.work_size < partial) {
+      scanner->carry.last = buff[len - 1];
+      scanner->cum_scanned_length += len;
+      return zsv_buffer_truncate(scanner);
+    }
+    memcpy(scanner->mmap.work_buff, buff + scanner->row_start, partial);
+    scanner->carry.length = partial;
+    scanner->carry.scanned = 0;
+  }
+  if(len && scanner->row_start)
+    scanner->carry.last = buff[scanner->row_start - 1];
+  scanner->cum_scanned_length += scanner->row_start;
+  return zsv_status_ok;
+}
+
+struct zsv_string_reader {
+  const unsigned char *s;
+  size_t len;
+};
+
+static size_t zsv_string_read(void *buff, size_t n, size_t size, void *in) {
+  struct zsv_string_reader *r = in;
+  size_t len = n * size;
+  if(len > r->len)
+    len = r->len;
+  memcpy(buff, r->s, len);
+  r->s += len;
+  r->len -= len;
+  return len;
+}
+
+// zsv_parse_string(): *utf8 may not overlap w scanner buffer!
+ZSV_EXPORT
+enum zsv_status zsv_parse_string(struct zsv_scanner *scanner,
+                                 const unsigned char *utf8,
+                                 size_t len) {
+  struct zsv_string_reader r = { utf8, len };
+  size_t (*read)(void *, size_t, size_t, void *) = scanner->read;
+  void *in = scanner->in;
+  enum zsv_status stat;
+
+  scanner->read = zsv_string_read;
+  scanner->in = &r;
+  while((stat = zsv_parse_more(scanner)) == zsv_status_ok)
+    ;
+  scanner->read = read;
+  scanner->in = in;
+  return stat == zsv_status_no_more_input ? zsv_status_ok : stat;
+}
@@ -0,0 +1,419 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+/*
+ * File reader for use as zsv_opts.read (see zsv_file_reader_new())
+ *
+ * On Linux, the reader keeps queue_depth reads of block_size bytes in flight
+ * using io_uring, each into its own registered (fixed) buffer. Blocks are
+ * consumed in file order and each is resubmitted for the next unread offset
+ * as soon as it has been copied out, so the device always has up to
+ * queue_depth requests outstanding
+ *
+ * If io_uring is not available (older kernels, or disabled e.g. by seccomp),
+ * or a request fails, the reader falls back to pread(). Setting the
+ * environment variable ZSV_FILE_READER to "pread" forces the fallback, e.g.
+ * for testing
+ *
+ * io_uring is used via its system calls directly, so that liburing is not
+ * required
+ */
+
+#if defined(__linux__) && !defined(ZSV_NO_IO_URING) && __has_include(<linux/io_uring.h>)
+# define ZSV_HAVE_IO_URING
+# include <linux/io_uring.h>
+# include <sys/syscall.h>
+# include <sys/uio.h>
+#endif
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+# define ZSV_HAVE_FILE_READER
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <errno.h>
+#endif
+
+#ifdef ZSV_HAVE_FILE_READER
+
+#define ZSV_FILE_READER_ALIGN 4096 // O_DIRECT buffer, offset and length alignment
+
+#ifndef ZSV_FILE_READER_QUEUE_DEPTH_DEFAULT
+#define ZSV_FILE_READER_QUEUE_DEPTH_DEFAULT 8
+#endif
+
+#ifndef ZSV_FILE_READER_BLOCK_SIZE_DEFAULT
+#define ZSV_FILE_READER_BLOCK_SIZE_DEFAULT (128 * 1024)
+#endif
+
+#ifdef ZSV_HAVE_IO_URING
+#define ZSV_FILE_READER_SLOT_IDLE 0 // nothing left to read into this slot
+#define ZSV_FILE_READER_SLOT_IN_FLIGHT 1
+#define ZSV_FILE_READER_SLOT_DONE 2
+
+struct zsv_file_reader_slot {
+  unsigned char *buff;
+  off_t offset;
+  int result; // bytes read, or -errno
+  char state;
+};
+
+struct zsv_uring {
+  int fd;
+  unsigned *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_ring, *cq_ring;
+  size_t sq_ring_size, cq_ring_size, sqes_size;
+};
+#endif
+
+struct zsv_file_reader {
+  int fd;
+  off_t size;          // file size at open
+  off_t offset;        // next offset to read (pread), or to submit (io_uring)
+  size_t block_size;
+  unsigned queue_depth;
+
+#ifdef ZSV_HAVE_IO_URING
+  struct zsv_uring ring;
+  struct zsv_file_reader_slot *slots;
+  unsigned head;       // slot holding the next data to return
+  size_t head_pos;     // bytes of the head slot already returned
+  unsigned in_flight;  // number of submitted reads not yet completed
+#endif
+
+  char direct;         // fd was opened with O_DIRECT
+  char use_uring;
+  char not_seekable;   // not a regular file; use read() instead of pread()
+};
+
+#ifdef ZSV_HAVE_IO_URING
+
+static int zsv_uring_init(struct zsv_uring *ring, unsigned entries) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+  if(ring->fd < 0)
+    return -1;
+
+  ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if(p.features & IORING_FEAT_SINGLE_MMAP) {
+    if(ring->cq_ring_size > ring->sq_ring_size)
+      ring->sq_ring_size = ring->cq_ring_size;
+    ring->cq_ring_size = 0;
+  }
+  ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if(ring->sq_ring == MAP_FAILED) {
+    ring->sq_ring = NULL;
+    return -1;
+  }
+  if(ring->cq_ring_size) {
+    ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    if(ring->cq_ring == MAP_FAILED) {
+      ring->cq_ring = NULL;
+      return -1;
+    }
+  }
+  unsigned char *cq = ring->cq_ring ? ring->cq_ring : ring->sq_ring;
+
+  ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if(ring->sqes == MAP_FAILED) {
+    ring->sqes = NULL;
+    return -1;
+  }
+
+  unsigned char *sq = ring->sq_ring;
+  ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+  ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  return 0;
+}
+
+static void zsv_uring_delete(struct zsv_uring *ring) {
+  if(ring->sqes)
+    munmap(ring->sqes, ring->sqes_size);
+  if(ring->cq_ring)
+    munmap(ring->cq_ring, ring->cq_ring_size);
+  if(ring->sq_ring)
+    munmap(ring->sq_ring, ring->sq_ring_size);
+  if(ring->fd >= 0)
+    close(ring->fd);
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = -1;
+}
+
+// queue a read of the next block into slot ix. Does not call io_uring_enter()
+static void zsv_file_reader_queue(struct zsv_file_reader *r, unsigned ix) {
+  struct zsv_uring *ring = &r->ring;
+  struct zsv_file_reader_slot *slot = &r->slots[ix];
+  unsigned tail = *ring->sq_tail;
+  unsigned sq_ix = tail & *ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[sq_ix];
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_READ_FIXED;
+  sqe->fd = r->fd;
+  sqe->addr = (unsigned long)slot->buff;
+  sqe->len = r->block_size;
+  sqe->off = r->offset;
+  sqe->buf_index = ix;
+  sqe->user_data = ix;
+  ring->sq_array[sq_ix] = sq_ix;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  slot->offset = r->offset;
+  slot->state = ZSV_FILE_READER_SLOT_IN_FLIGHT;
+  r->offset += r->block_size;
+  r->in_flight++;
+}
+
+static int zsv_uring_enter(struct zsv_uring *ring, unsigned to_submit, unsigned min_complete) {
+  int rc;
+  do {
+    rc = (int)syscall(__NR_io_uring_enter, ring->fd, to_submit, min_complete,
+                      min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+  } while(rc < 0 && errno == EINTR);
+  return rc;
+}
+
+// wait for the given slot's read to complete, or if slot is NULL, for all reads
+static int zsv_file_reader_wait(struct zsv_file_reader *r, struct zsv_file_reader_slot *slot) {
+  struct zsv_uring *ring = &r->ring;
+  while(slot ? slot->state == ZSV_FILE_READER_SLOT_IN_FLIGHT : r->in_flight > 0) {
+    unsigned head = *ring->cq_head;
+    if(head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+      if(zsv_uring_enter(ring, 0, 1) < 0)
+        return -1;
+      continue;
+    }
+    struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+    struct zsv_file_reader_slot *done = &r->slots[cqe->user_data];
+    done->result = cqe->res;
+    done->state = ZSV_FILE_READER_SLOT_DONE;
+    r->in_flight--;
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+  }
+  return 0;
+}
+
+// stop using io_uring. Subsequent reads use pread() from r->offset
+static void zsv_file_reader_uring_stop(struct zsv_file_reader *r) {
+  // the kernel may still write to our buffers until outstanding reads complete
+  zsv_file_reader_wait(r, NULL);
+  zsv_uring_delete(&r->ring);
+  r->use_uring = 0;
+  if(r->direct) {
+    fcntl(r->fd, F_SETFL, fcntl(r->fd, F_GETFL) & ~O_DIRECT);
+    r->direct = 0;
+  }
+}
+
+static size_t zsv_file_reader_uring_read(struct zsv_file_reader *r, unsigned char *buff, size_t wanted) {
+  size_t got = 0;
+  while(got < wanted) {
+    unsigned ix = r->head;
+    struct zsv_file_reader_slot *slot = &r->slots[ix];
+    if(slot->state == ZSV_FILE_READER_SLOT_IDLE)
+      break; // eof
+    if(zsv_file_reader_wait(r, slot)) {
+      r->offset = slot->offset + r->head_pos;
+      zsv_file_reader_uring_stop(r);
+      break;
+    }
+
+    size_t result = slot->result > 0 ? (size_t)slot->result : 0;
+    if(r->head_pos < result) {
+      size_t len = wanted - got < result - r->head_pos ? wanted - got : result - r->head_pos;
+      memcpy(buff + got, slot->buff + r->head_pos, len);
+      got += len;
+      r->head_pos += len;
+      if(r->head_pos < result)
+        break; // got == wanted
+    }
+
+    if(result < r->block_size && slot->offset + (off_t)result < r->size) {
+      // error or short read before eof: continue with pread()
+      if(slot->result < 0 && !(slot->result == -EINVAL && r->direct))
+        fprintf(stderr, "Warning: io_uring read failed (%s); using pread\n", strerror(-slot->result));
+      r->offset = slot->offset + result;
+      zsv_file_reader_uring_stop(r);
+      break;
+    }
+
+    // done with this block; reuse its slot for the next unread block
+    r->head = (ix + 1) % r->queue_depth;
+    r->head_pos = 0;
+    slot->state = ZSV_FILE_READER_SLOT_IDLE;
+    if(r->offset < r->size) {
+      zsv_file_reader_queue(r, ix);
+      if(zsv_uring_enter(&r->ring, 1, 0) < 0) {
+        // not submitted; resume with pread() from the oldest unconsumed block
+        slot->state = ZSV_FILE_READER_SLOT_IDLE;
+        r->in_flight--;
+        r->offset = r->slots[r->head].state == ZSV_FILE_READER_SLOT_IDLE ? slot->offset : r->slots[r->head].offset;
+        zsv_file_reader_uring_stop(r);
+        break;
+      }
+    }
+  }
+  return got;
+}
+
+static int zsv_file_reader_uring_init(struct zsv_file_reader *r) {
+  if(zsv_uring_init(&r->ring, r->queue_depth))
+    return -1;
+
+  r->slots = calloc(r->queue_depth, sizeof(*r->slots));
+  struct iovec *iov = calloc(r->queue_depth, sizeof(*iov));
+  int err = !r->slots || !iov;
+  for(unsigned i = 0; !err && i < r->queue_depth; i++) {
+    void *p;
+    if(posix_memalign(&p, ZSV_FILE_READER_ALIGN, r->block_size))
+      err = 1;
+    else {
+      r->slots[i].buff = p;
+      iov[i].iov_base = p;
+      iov[i].iov_len = r->block_size;
+    }
+  }
+  if(!err && syscall(__NR_io_uring_register, r->ring.fd, IORING_REGISTER_BUFFERS, iov, r->queue_depth) < 0)
+    err = 1;
+  free(iov);
+
+  if(!err) {
+    unsigned n = 0;
+    for(; n < r->queue_depth && r->offset < r->size; n++)
+      zsv_file_reader_queue(r, n);
+    if(n && zsv_uring_enter(&r->ring, n, 0) < 0) {
+      // nothing was submitted
+      err = 1;
+      r->in_flight = 0;
+      r->offset = 0;
+      for(unsigned i = 0; i < n; i++)
+        r->slots[i].state = ZSV_FILE_READER_SLOT_IDLE;
+    } else
+      r->use_uring = 1;
+  }
+  if(err) {
+    zsv_uring_delete(&r->ring);
+    r->use_uring = 0;
+  }
+  return err ? -1 : 0;
+}
+#endif // ZSV_HAVE_IO_URING
+
+ZSV_EXPORT
+size_t zsv_file_reader_read(void *buff, size_t size, size_t count, void *reader) {
+  struct zsv_file_reader *r = reader;
+  size_t wanted = size * count;
+  size_t got = 0;
+#ifdef ZSV_HAVE_IO_URING
+  if(r->use_uring)
+    got = zsv_file_reader_uring_read(r, buff, wanted);
+#endif
+  while(got < wanted) {
+    ssize_t n = r->not_seekable ? read(r->fd, (unsigned char *)buff + got, wanted - got)
+      : pread(r->fd, (unsigned char *)buff + got, wanted - got, r->offset);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n < 0 && errno == EINVAL && r->direct) {
+      // e.g. unaligned buffer: retry without O_DIRECT
+      fcntl(r->fd, F_SETFL, fcntl(r->fd, F_GETFL) & ~O_DIRECT);
+      r->direct = 0;
+      continue;
+    }
+    if(n < 0)
+      perror("read");
+    if(n <= 0)
+      break;
+    got += n;
+    r->offset += n;
+  }
+  return got / size;
+}
+
+ZSV_EXPORT
+void zsv_file_reader_delete(struct zsv_file_reader *r) {
+  if(r) {
+#ifdef ZSV_HAVE_IO_URING
+    if(r->use_uring)
+      zsv_file_reader_uring_stop(r);
+    if(r->slots) {
+      for(unsigned i = 0; i < r->queue_depth; i++)
+        free(r->slots[i].buff);
+      free(r->slots);
+    }
+#endif
+    if(r->fd >= 0)
+      close(r->fd);
+    free(r);
+  }
+}
+
+ZSV_EXPORT
+struct zsv_file_reader *zsv_file_reader_new(const char *path, unsigned queue_depth,
+                                            size_t block_size, char direct) {
+  struct zsv_file_reader *r = calloc(1, sizeof(*r));
+  if(!r) {
+    fprintf(stderr, "Out of memory!\n");
+    return NULL;
+  }
+  r->queue_depth = queue_depth ? queue_depth : ZSV_FILE_READER_QUEUE_DEPTH_DEFAULT;
+  if(!block_size)
+    block_size = ZSV_FILE_READER_BLOCK_SIZE_DEFAULT;
+  r->block_size = (block_size + ZSV_FILE_READER_ALIGN - 1) / ZSV_FILE_READER_ALIGN * ZSV_FILE_READER_ALIGN;
+
+  r->fd = -1;
+#ifdef O_DIRECT
+  if(direct && (r->fd = open(path, O_RDONLY | O_DIRECT)) >= 0)
+    r->direct = 1; // note: some file systems only fail later, on read
+#else
+  (void)(direct);
+#endif
+  if(r->fd < 0 && (r->fd = open(path, O_RDONLY)) < 0) {
+    perror(path);
+    free(r);
+    return NULL;
+  }
+
+  struct stat st;
+  if(fstat(r->fd, &st) || !S_ISREG(st.st_mode)) {
+    // not a regular file: just read it
+    if(r->direct)
+      fcntl(r->fd, F_SETFL, fcntl(r->fd, F_GETFL) & ~O_DIRECT);
+    r->direct = 0;
+    r->not_seekable = 1;
+    return r;
+  }
+  r->size = st.st_size;
+
+#ifdef ZSV_HAVE_IO_URING
+  const char *requested = getenv("ZSV_FILE_READER");
+  int uring_err = requested && !strcmp(requested, "pread") ? 1 : zsv_file_reader_uring_init(r);
+  if(uring_err && r->direct) {
+    fcntl(r->fd, F_SETFL, fcntl(r->fd, F_GETFL) & ~O_DIRECT);
+    r->direct = 0;
+  }
+#endif
+  return r;
+}
+
+#endif // ZSV_HAVE_FILE_READER
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+/*
+ * Fixed-width column detection (see zsv_detect_fixed_offsets())
+ *
+ * Each sampled line marks the byte positions at which it is not blank, a
+ * block at a time, with a fixed-size loop that the compiler vectorizes. A
+ * column ends where a position that is blank on every line is followed by one
+ * that is not. Lines that are cut off by the start or end of a sampled block
+ * are skipped
+ */
+
+#define ZSV_FIXED_DETECT_BLOCK_SIZE ZSV_DEFAULT_SCANNER_BUFFSIZE // bytes per sampled block
+#define ZSV_FIXED_DETECT_BLOCKS_DEFAULT 16
+#define ZSV_FIXED_DETECT_VEC_SIZE 64
+
+struct zsv_fixed_detect {
+  unsigned char *used; // used[i] is non-zero if any line is not blank at position i
+  size_t allocated;
+  size_t max_len;      // length of the longest line
+  size_t lines;
+  char err;
+};
+
+static void zsv_fixed_detect_line(struct zsv_fixed_detect *d, const unsigned char *s, size_t len) {
+  if(len && s[len - 1] == '\r')
+    len--;
+  if(len > d->allocated) {
+    size_t allocated = d->allocated ? d->allocated : 1024;
+    while(allocated < len)
+      allocated *= 2;
+    unsigned char *used = realloc(d->used, allocated);
+    if(!used) {
+      d->err = 1;
+      return;
+    }
+    memset(used + d->allocated, 0, allocated - d->allocated);
+    d->used = used;
+    d->allocated = allocated;
+  }
+
+  unsigned char *used = d->used;
+  size_t i = 0;
+  // the fixed-size loop is vectorized by the compiler
+  for(; len - i >= ZSV_FIXED_DETECT_VEC_SIZE; i += ZSV_FIXED_DETECT_VEC_SIZE)
+    for(int j = 0; j < ZSV_FIXED_DETECT_VEC_SIZE; j++)
+      used[i + j] |= s[i + j] != ' ';
+  for(; i < len; i++)
+    used[i] |= s[i] != ' ';
+
+  if(len > d->max_len)
+    d->max_len = len;
+  d->lines++;
+}
+
+/**
+ * Add the lines of a block. If cut_start is set, the block may start in the
+ * middle of a line, so its first line is skipped. If at_end is set, the
+ * block ends at the end of the data, so its last line is used even if it has
+ * no newline
+ */
+static void zsv_fixed_detect_block(struct zsv_fixed_detect *d, const unsigned char *s, size_t len,
+                                   char cut_start, char at_end) {
+  const unsigned char *end = s + len;
+  if(cut_start) {
+    const unsigned char *nl = memchr(s, '\n', len);
+    if(!nl)
+      return;
+    s = nl + 1;
+  }
+  while(s < end && !d->err) {
+    const unsigned char *nl = memchr(s, '\n', end - s);
+    if(!nl) {
+      if(at_end)
+        zsv_fixed_detect_line(d, s, end - s);
+      break;
+    }
+    zsv_fixed_detect_line(d, s, nl - s);
+    s = nl + 1;
+  }
+}
+
+static size_t zsv_fixed_detect_offsets(struct zsv_fixed_detect *d, size_t *offsets, size_t max_offsets) {
+  size_t count = 0;
+  if(d->err) {
+    fprintf(stderr, "Out of memory!\n");
+    return 0;
+  }
+  if(!d->lines || !d->max_len)
+    return 0;
+
+  // leading blanks belong to the first column
+  char seen = d->used[0];
+  for(size_t i = 1; i < d->max_len; i++) {
+    if(d->used[i] && !d->used[i - 1] && seen) {
+      if(count < max_offsets)
+        offsets[count] = i;
+      count++;
+    }
+    seen |= d->used[i];
+  }
+  if(count < max_offsets)
+    offsets[count] = d->max_len;
+  return count + 1;
+}
+
+static void zsv_fixed_detect_skip_bom(const unsigned char **buff, size_t *len) {
+  size_t bom_len = strlen(ZSV_BOM);
+  if(*len >= bom_len && !memcmp(*buff, ZSV_BOM, bom_len)) {
+    *buff += bom_len;
+    *len -= bom_len;
+  }
+}
+
+ZSV_EXPORT
+size_t zsv_detect_fixed_offsets(const unsigned char *buff, size_t len, size_t *offsets, size_t max_offsets) {
+  struct zsv_fixed_detect d = { 0 };
+  zsv_fixed_detect_skip_bom(&buff, &len);
+  zsv_fixed_detect_block(&d, buff, len, 0, 1);
+  size_t count = zsv_fixed_detect_offsets(&d, offsets, max_offsets);
+  free(d.used);
+  return count;
+}
+
+ZSV_EXPORT
+size_t zsv_detect_fixed_offsets_file(const char *filename, size_t sample_blocks,
+                                     size_t *offsets, size_t max_offsets) {
+  FILE *f = fopen(filename, "rb");
+  if(!f) {
+    perror(filename);
+    return 0;
+  }
+  if(!sample_blocks)
+    sample_blocks = ZSV_FIXED_DETECT_BLOCKS_DEFAULT;
+
+  off_t size = -1;
+  if(!fseeko(f, 0, SEEK_END))
+    size = ftello(f);
+  if(size < 0 || fseeko(f, 0, SEEK_SET))
+    size = -1;
+  // read all of a small file, or the start of one that is not seekable
+  char sample = size >= 0 && (uint64_t)size > (uint64_t)sample_blocks * ZSV_FIXED_DETECT_BLOCK_SIZE;
+  size_t buffsize = sample || size < 0 ? ZSV_FIXED_DETECT_BLOCK_SIZE : (size_t)size;
+  unsigned char *buff = malloc(buffsize ? buffsize : 1);
+  if(!buff) {
+    fprintf(stderr, "Out of memory!\n");
+    fclose(f);
+    return 0;
+  }
+
+  struct zsv_fixed_detect d = { 0 };
+  if(!sample) {
+    size_t n = fread(buff, 1, buffsize, f);
+    const unsigned char *s = buff;
+    zsv_fixed_detect_skip_bom(&s, &n);
+    zsv_fixed_detect_block(&d, s, n, 0, size >= 0 || n < buffsize);
+  } else {
+    // sample blocks spread evenly across the file, including its first and last
+    uint64_t span = (uint64_t)size - ZSV_FIXED_DETECT_BLOCK_SIZE;
+    for(size_t i = 0; i < sample_blocks && !d.err; i++) {
+      uint64_t start = sample_blocks > 1 ? span * i / (sample_blocks - 1) : 0;
+      if(fseeko(f, (off_t)start, SEEK_SET))
+        break;
+      size_t n = fread(buff, 1, ZSV_FIXED_DETECT_BLOCK_SIZE, f);
+      const unsigned char *s = buff;
+      if(i == 0)
+        zsv_fixed_detect_skip_bom(&s, &n);
+      zsv_fixed_detect_block(&d, s, n, i > 0, start + n >= (uint64_t)size);
+    }
+  }
+  fclose(f);
+  free(buff);
+
+  size_t count = zsv_fixed_detect_offsets(&d, offsets, max_offsets);
+  free(d.used);
+  return count;
+}
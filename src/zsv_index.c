@@ -0,0 +1,334 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+/*
+ * Row index sidecar files (see zsv_index_build())
+ *
+ * An index holds the file offset of every Nth row of a file, together with the
+ * header row and the dialect the file was parsed with, and is saved next to the
+ * file as <filename>.zsvidx. A parser that reads the file can then start at the
+ * indexed row nearest to any given row (see zsv_index_seek()), and
+ * zsv_parse_parallel() can split the file at indexed rows instead of working
+ * out where rows start
+ *
+ * An index is only loaded if the file's size and modification time are the
+ * same as when it was built. The sidecar is written in the host's byte order
+ */
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define ZSV_INDEX_SUFFIX ".zsvidx"
+#define ZSV_INDEX_MAGIC "zsvidx1"
+
+struct zsv_index_file_header {
+  char magic[8];
+  uint64_t file_size;
+  int64_t mtime;
+  uint64_t interval;     // rows between index entries
+  uint64_t row_count;    // total number of rows, including the header
+  uint64_t offset_count;
+  uint64_t header_len;
+  char delimiter;
+  char no_quotes;
+  char had_bom;
+  char reserved[5];
+};
+
+struct zsv_index {
+  struct zsv_index_file_header h;
+  uint64_t *offsets;     // offsets[i] is the file offset of row i * interval
+  unsigned char *header; // the first row, without its row end, NUL-terminated
+};
+
+ZSV_EXPORT
+void zsv_index_delete(struct zsv_index *ix) {
+  if(ix) {
+    free(ix->offsets);
+    free(ix->header);
+    free(ix);
+  }
+}
+
+ZSV_EXPORT
+size_t zsv_index_row_count(const struct zsv_index *ix) {
+  return ix ? ix->h.row_count : 0;
+}
+
+static char *zsv_index_path(const char *filename) {
+  size_t len = strlen(filename);
+  char *path = malloc(len + strlen(ZSV_INDEX_SUFFIX) + 1);
+  if(path) {
+    memcpy(path, filename, len);
+    strcpy(path + len, ZSV_INDEX_SUFFIX);
+  } else
+    fprintf(stderr, "Out of memory!\n");
+  return path;
+}
+
+/**
+ * Return the file offset of the row passed to the row handler. Valid only from
+ * within the row handler
+ */
+static uint64_t zsv_index_row_offset(struct zsv_scanner *scanner) {
+  return scanner->cum_scanned_length + scanner->row_start + (scanner->had_bom ? strlen(ZSV_BOM) : 0);
+}
+
+struct zsv_index_builder {
+  zsv_parser parser;
+  struct zsv_index *ix;
+  size_t allocated;
+  uint64_t header_end; // offset of the second row
+  char err;
+};
+
+static void zsv_index_build_row(void *ctx) {
+  struct zsv_index_builder *b = ctx;
+  struct zsv_index *ix = b->ix;
+  uint64_t row = ix->h.row_count++;
+  if(row == 1)
+    b->header_end = zsv_index_row_offset(b->parser);
+  if(row % ix->h.interval)
+    return;
+  if(ix->h.offset_count == b->allocated) {
+    size_t allocated = b->allocated ? b->allocated * 2 : 1024;
+    uint64_t *offsets = realloc(ix->offsets, allocated * sizeof(*offsets));
+    if(!offsets) {
+      fprintf(stderr, "Out of memory!\n");
+      b->err = 1;
+      zsv_abort(b->parser);
+      return;
+    }
+    ix->offsets = offsets;
+    b->allocated = allocated;
+  }
+  ix->offsets[ix->h.offset_count++] = zsv_index_row_offset(b->parser);
+}
+
+/**
+ * Read the header row from the file. Return 0 on success
+ */
+static int zsv_index_read_header(struct zsv_index *ix, const char *filename, uint64_t end) {
+  FILE *f = fopen(filename, "rb");
+  if(!f)
+    return 1;
+  uint64_t start = ix->h.offset_count ? ix->offsets[0] : 0;
+  size_t len = end > start ? end - start : 0;
+  int err = 1;
+  if((ix->header = malloc(len + 1))
+     && !fseeko(f, (off_t)start, SEEK_SET)
+     && fread(ix->header, 1, len, f) == len) {
+    while(len && (ix->header[len-1] == '\n' || ix->header[len-1] == '\r'))
+      len--;
+    ix->header[len] = '\0';
+    ix->h.header_len = len;
+    err = 0;
+  }
+  fclose(f);
+  return err;
+}
+
+static enum zsv_status zsv_index_save(struct zsv_index *ix, const char *filename) {
+  char *path = zsv_index_path(filename);
+  if(!path)
+    return zsv_status_memory;
+  FILE *f = fopen(path, "wb");
+  if(!f) {
+    fprintf(stderr, "Unable to open for writing: %s\n", path);
+    free(path);
+    return zsv_status_invalid_option;
+  }
+  enum zsv_status stat = zsv_status_ok;
+  if(fwrite(&ix->h, sizeof(ix->h), 1, f) != 1
+     || fwrite(ix->header, 1, ix->h.header_len, f) != ix->h.header_len
+     || fwrite(ix->offsets, sizeof(*ix->offsets), ix->h.offset_count, f) != ix->h.offset_count) {
+    fprintf(stderr, "Unable to write %s\n", path);
+    stat = zsv_status_invalid_option;
+  }
+  if(fclose(f) && stat == zsv_status_ok) {
+    fprintf(stderr, "Unable to write %s\n", path);
+    stat = zsv_status_invalid_option;
+  }
+  if(stat != zsv_status_ok)
+    remove(path);
+  free(path);
+  return stat;
+}
+
+ZSV_EXPORT
+enum zsv_status zsv_index_build(const char *filename, const struct zsv_opts *opts, size_t interval) {
+  struct stat st;
+  if(stat(filename, &st) || !S_ISREG(st.st_mode)) {
+    fprintf(stderr, "Not a regular file: %s\n", filename);
+    return zsv_status_invalid_option;
+  }
+
+  struct zsv_index_builder b = { 0 };
+  if(!(b.ix = calloc(1, sizeof(*b.ix)))) {
+    fprintf(stderr, "Out of memory!\n");
+    return zsv_status_memory;
+  }
+  struct zsv_index *ix = b.ix;
+  memcpy(ix->h.magic, ZSV_INDEX_MAGIC, sizeof(ix->h.magic));
+  ix->h.file_size = (uint64_t)st.st_size;
+  ix->h.mtime = (int64_t)st.st_mtime;
+  ix->h.interval = interval ? interval : ZSV_INDEX_INTERVAL_DEFAULT;
+
+  // rows are counted as they are in the file, so any inserted header is not wanted
+  struct zsv_opts o = *opts;
+  o.row = zsv_index_build_row;
+  o.cell = NULL;
+  o.overflow = NULL;
+  o.ctx = &b;
+  o.insert_header_row = NULL;
+#ifdef ZSV_EXTRAS
+  o.max_rows = 0;
+#endif
+  enum zsv_status stat = zsv_status_memory;
+  if((b.parser = zsv_new_mmap(filename, &o))) {
+    while((stat = zsv_parse_more(b.parser)) == zsv_status_ok)
+      ;
+    if(stat == zsv_status_no_more_input)
+      stat = zsv_finish(b.parser);
+    ix->h.delimiter = b.parser->opts.delimiter;
+    ix->h.no_quotes = b.parser->opts.no_quotes > 0;
+    ix->h.had_bom = b.parser->had_bom;
+    zsv_delete(b.parser);
+  }
+  if(b.err)
+    stat = zsv_status_memory;
+
+  if(stat == zsv_status_ok) {
+    if(zsv_index_read_header(ix, filename, ix->h.row_count > 1 ? b.header_end : ix->h.file_size)) {
+      fprintf(stderr, "Unable to read header of %s\n", filename);
+      stat = zsv_status_invalid_option;
+    } else
+      stat = zsv_index_save(ix, filename);
+  }
+  zsv_index_delete(ix);
+  return stat;
+}
+
+ZSV_EXPORT
+struct zsv_index *zsv_index_load(const char *filename, const struct zsv_opts *opts) {
+  char *path = zsv_index_path(filename);
+  if(!path)
+    return NULL;
+  FILE *f = fopen(path, "rb");
+  if(!f) {
+    free(path);
+    return NULL;
+  }
+
+  struct zsv_index *ix = calloc(1, sizeof(*ix));
+  struct stat st;
+  const char *err = NULL;
+  if(!ix)
+    err = "Out of memory!";
+  else if(fread(&ix->h, sizeof(ix->h), 1, f) != 1
+          || memcmp(ix->h.magic, ZSV_INDEX_MAGIC, sizeof(ix->h.magic))
+          || !ix->h.interval
+          || ix->h.offset_count != (ix->h.row_count + ix->h.interval - 1) / ix->h.interval
+          || ix->h.header_len > ix->h.file_size)
+    err = "Invalid index";
+  else if(stat(filename, &st) || ix->h.file_size != (uint64_t)st.st_size || ix->h.mtime != (int64_t)st.st_mtime)
+    err = "Ignoring out-of-date index";
+  else if(ix->h.delimiter != (opts->delimiter ? opts->delimiter : ',')
+          || ix->h.no_quotes != (opts->no_quotes > 0))
+    err = "Ignoring index built with different delimiter or quote options";
+  else if(!(ix->header = malloc(ix->h.header_len + 1))
+          || !(ix->offsets = malloc((ix->h.offset_count ? ix->h.offset_count : 1) * sizeof(*ix->offsets))))
+    err = "Out of memory!";
+  else if(fread(ix->header, 1, ix->h.header_len, f) != ix->h.header_len
+          || fread(ix->offsets, sizeof(*ix->offsets), ix->h.offset_count, f) != ix->h.offset_count)
+    err = "Invalid index";
+  else {
+    ix->header[ix->h.header_len] = '\0';
+    for(uint64_t i = 1; i < ix->h.offset_count && !err; i++)
+      if(ix->offsets[i] <= ix->offsets[i-1] || ix->offsets[i] >= ix->h.file_size)
+        err = "Invalid index";
+  }
+  fclose(f);
+
+  if(err) {
+    if(opts->verbose || !ix || !strcmp(err, "Out of memory!"))
+      fprintf(stderr, "%s: %s\n", err, path);
+    zsv_index_delete(ix);
+    ix = NULL;
+  }
+  free(path);
+  return ix;
+}
+
+ZSV_EXPORT
+enum zsv_status zsv_set_index(zsv_parser parser, struct zsv_index *ix) {
+  if(parser->read != (zsv_generic_read)fread || !parser->in
+     || parser->checked_bom || parser->old_bytes_read || parser->buff_readonly) {
+    fprintf(stderr, "An index can only be set for a file stream that has not been read\n");
+    return zsv_status_invalid_option;
+  }
+  if(parser->mode != ZSV_MODE_DELIM || parser->filter
+     || ix->h.delimiter != parser->opts.delimiter || ix->h.no_quotes != (parser->opts.no_quotes > 0)) {
+    fprintf(stderr, "Index does not match the parser options\n");
+    return zsv_status_invalid_option;
+  }
+  parser->index = ix;
+  return zsv_status_ok;
+}
+
+ZSV_EXPORT
+size_t zsv_index_seek(zsv_parser parser, size_t row) {
+  struct zsv_index *ix = parser->index;
+  if(!ix || !ix->h.offset_count || parser->checked_bom || parser->old_bytes_read)
+    return 0;
+  uint64_t k = row / ix->h.interval;
+  if(k >= ix->h.offset_count)
+    k = ix->h.offset_count - 1;
+  if(!k || fseeko(parser->in, (off_t)ix->offsets[k], SEEK_SET))
+    return 0;
+
+  // the header is still parsed first, unless the caller supplied their own
+  if(!parser->insert_string)
+    parser->insert_string = (const char *)ix->header;
+  parser->checked_bom = 1;
+  parser->had_bom = ix->h.had_bom;
+  parser->seeked = 1;
+  return k * ix->h.interval;
+}
+
+/**
+ * Return the first indexed row offset at or after offset, or UINT64_MAX if
+ * there is none
+ */
+static uint64_t zsv_index_next_offset(const struct zsv_index *ix, uint64_t offset) {
+  size_t lo = 0, hi = ix->h.offset_count;
+  while(lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if(ix->offsets[mid] < offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo < ix->h.offset_count ? ix->offsets[lo] : UINT64_MAX;
+}
+
+/**
+ * Return the last indexed row offset at or before offset, or 0 if there is none
+ */
+static uint64_t zsv_index_prior_offset(const struct zsv_index *ix, uint64_t offset) {
+  size_t lo = 0, hi = ix->h.offset_count;
+  while(lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if(ix->offsets[mid] <= offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo ? ix->offsets[lo-1] : 0;
+}
@@ -9,9 +9,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <ctype.h>
 
-#ifdef ZSV_EXTRAS
+#if defined(ZSV_EXTRAS) || defined(ZSV_STATS)
 #include <time.h>
 #endif
 
@@ -21,8 +22,108 @@
 struct zsv_row {
   size_t used, allocated, overflow;
   struct zsv_cell *cells;
+
+  // rows that had more than opts.max_columns cells, reported by zsv_finish()
+  size_t overflow_rows;
+  size_t overflow_max; // largest number of cells in such a row
 };
 
+#define ZSV_ROW_INITIAL_CELLS 256
+
+/**
+ * zsv_arena: chunked allocator for short-lived cell copies. Memory is only
+ * released all at once, by zsv_arena_reset(), so allocations never move
+ */
+#define ZSV_ARENA_CHUNK_SIZE (64 * 1024)
+
+struct zsv_arena_chunk {
+  struct zsv_arena_chunk *next;
+  size_t size;
+  size_t used;
+  unsigned char data[];
+};
+
+struct zsv_arena {
+  struct zsv_arena_chunk *first;
+  struct zsv_arena_chunk *current;
+};
+
+static unsigned char *zsv_arena_alloc(struct zsv_arena *a, size_t n) {
+  struct zsv_arena_chunk *c = a->current;
+  if(!c || c->used + n > c->size) {
+    struct zsv_arena_chunk *next = c ? c->next : NULL;
+    if(next && next->size >= n)
+      c = next;
+    else {
+      size_t size = n > ZSV_ARENA_CHUNK_SIZE ? n : ZSV_ARENA_CHUNK_SIZE;
+      struct zsv_arena_chunk *new_c = malloc(sizeof(*new_c) + size);
+      if(!new_c) {
+        fprintf(stderr, "Out of memory!\n");
+        return NULL;
+      }
+      new_c->size = size;
+      new_c->used = 0;
+      new_c->next = next;
+      if(c)
+        c->next = new_c;
+      else
+        a->first = new_c;
+      c = new_c;
+    }
+    a->current = c;
+  }
+  unsigned char *p = c->data + c->used;
+  c->used += n;
+  return p;
+}
+
+static void zsv_arena_reset(struct zsv_arena *a) {
+  for(struct zsv_arena_chunk *c = a->first; c; c = c->next)
+    c->used = 0;
+  a->current = a->first;
+}
+
+static void zsv_arena_delete(struct zsv_arena *a) {
+  for(struct zsv_arena_chunk *c = a->first, *next; c; c = next) {
+    next = c->next;
+    free(c);
+  }
+  a->first = a->current = NULL;
+}
+
+#ifdef ZSV_STATS
+/**
+ * Counters returned by zsv_get_stats(). Times are kept in nanoseconds
+ */
+struct zsv_scanner_stats {
+  size_t rows;
+  size_t cells;
+  size_t quoted_cells;
+  size_t embedded_quote_cells;
+  size_t dequote_bytes_moved;
+  size_t shifts;
+  size_t shift_bytes;
+  size_t truncated_rows;
+  uint64_t read_ns;
+  uint64_t scan_ns;
+};
+
+static inline uint64_t zsv_stats_clock() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+#define ZSV_STATS_ADD(scanner, counter, n) ((scanner)->stats.counter += (n))
+#define ZSV_STATS_TIMER_START(t) uint64_t t = zsv_stats_clock()
+#define ZSV_STATS_TIMER_STOP(scanner, counter, t) ((scanner)->stats.counter += zsv_stats_clock() - (t))
+#else
+// without ZSV_STATS, counters are compiled out
+#define ZSV_STATS_ADD(scanner, counter, n) ((void)0)
+#define ZSV_STATS_TIMER_START(t) ((void)0)
+#define ZSV_STATS_TIMER_STOP(scanner, counter, t) ((void)0)
+#endif
+
 struct zsv_scanner {
   char last;
   struct {
@@ -39,6 +140,7 @@ struct zsv_scanner {
   void *row_ctx_orig;
   size_t row_start;
   struct zsv_row row;
+  unsigned char *scan_buff; // buffer that row_start is relative to (see zsv_get_row_raw())
 
   size_t scanned_length;
   size_t cum_scanned_length;
@@ -67,81 +169,205 @@ struct zsv_scanner {
 #define ZSV_MODE_DELIM 0
 #define ZSV_MODE_FIXED 1
   unsigned char mode;
+  enum zsv_status (*scan_delim)(struct zsv_scanner *scanner, unsigned char *buff, size_t bytes_read);
+  enum zsv_status (*scan_fixed)(struct zsv_scanner *scanner, unsigned char *buff, size_t bytes_read);
   struct {
     unsigned *offsets; // 0-based position of each cell end. offset[0] = end of first cell
     unsigned count; // number of offsets
+    size_t *cell_starts;  // 0-based position of each cell start, for zsv_batch_fixed_rows()
+    size_t *cell_lengths; // length of each cell of a row that is at least offsets[count-1] long
+    size_t record_length; // if non-zero, each row is this long and has no row end
   } fixed;
 
+  struct {
+    unsigned char *base; // memory-mapped input file (see zsv_new_mmap()), or NULL
+    size_t size;
+    unsigned char *data; // start of data, after any BOM
+    size_t read_pos; // position of zsv_mmap_read(), if the mapping is read as a stream
+    unsigned char *work_buff; // the scanner's own buffer, not used unless we read as a stream
+    size_t work_size;
+  } mmap;
+  const unsigned char *readonly_end; // end of the data when buff_readonly is set (see zsv_scan_arena_copy())
+  struct {
+    size_t length; // partial row kept in our own buffer until the next chunk
+    unsigned char last; // char preceding the next chunk
+    char scanned; // the scanner state is that of a scan of the partial row
+  } carry; // see zsv_parse_buffer()
+  struct zsv_arena arena; // for unescaping cells when the buffer is read-only
+  struct zsv_arena arena_spare; // see zsv_mmap_arena_reset()
+  struct zsv_arena unescaped; // for zsv_get_cell_unescaped(); reset after each row
+  FILE *own_stream; // input file opened by zsv_new_mmap(), if it could not be mapped
+  struct zsv_readahead *readahead; // see zsv_opts.readahead_depth
+  struct zsv_batch *batch; // see zsv_parse_batch()
+  struct zsv_index *index; // see zsv_set_index(). owned by the caller
+
+  // see zsv_set_malformed_utf8_replace()
+  const unsigned char *utf8_malformed; // next malformed byte in the buffer, if any
+  const unsigned char *utf8_end;       // end of the data in the buffer
+  unsigned char utf8_replace;
+
+  // if non-NULL, projection[i] is non-zero if column i is used (see zsv_set_projection())
+  unsigned char *projection;
+
+#ifdef ZSV_STATS
+  struct zsv_scanner_stats stats;
+#endif
+
   unsigned char checked_bom:1;
   unsigned char free_buff:1;
   unsigned char finished:1;
   unsigned char had_bom:1;
   unsigned char abort:1;
-  unsigned char _:3;
+  unsigned char quote_pending:1; // last buffer ended with a quote that may or may not close a quoted cell
+  unsigned char buff_readonly:1; // buff is read-only (a memory mapping or a caller's buffer)
+  unsigned char have_unescaped:1; // unescaped arena is in use
+  unsigned char utf8_check:1; // see zsv_set_malformed_utf8_replace()
+  unsigned char caller_buff:1; // see zsv_parse_buffer()
+  unsigned char seeked:1; // input starts at an indexed row (see zsv_index_seek())
+  unsigned char raw_row_modified:1; // the current row's bytes were changed in place (see zsv_get_row_raw())
 };
 
+static int zsv_scan_arena_copy(struct zsv_scanner *scanner, unsigned char **s, size_t n);
+
+#include "zsv_utf8.c"
+
+/**
+ * Grow the cells array to hold at least n cells, doubling its size but not
+ * exceeding opts.max_columns. Return 0 on success
+ */
+__attribute__((noinline)) static int zsv_row_reserve(struct zsv_scanner *scanner, size_t n) {
+  size_t allocated = scanner->row.allocated;
+  if(n > scanner->opts.max_columns)
+    return 1;
+  while(allocated < n)
+    allocated = allocated > scanner->opts.max_columns / 2 ? scanner->opts.max_columns : allocated * 2;
+  struct zsv_cell *cells = realloc(scanner->row.cells, allocated * sizeof(*cells));
+  if(!cells) {
+    fprintf(stderr, "Out of memory!\n");
+    return 1;
+  }
+  scanner->row.cells = cells;
+  scanner->row.allocated = allocated;
+  return 0;
+}
+
 __attribute__((always_inline)) static inline void zsv_clear_cell(struct zsv_scanner *scanner) {
   scanner->quoted = 0;
 }
 
-__attribute__((always_inline)) static inline void cell_dl(struct zsv_scanner * scanner, unsigned char * s, size_t n, char is_end) {
+/*
+ * Flags for the delimited scanners specialized at compile time (see
+ * zsv_scan_delim.c). Each flag lets the compiler drop a run-time check from
+ * cell_dl_spec(), row_dl_spec() and the scanner loop, so a specialized scanner
+ * is only selected if its flags hold for the parser's options (see
+ * zsv_scan_delim_flags())
+ */
+#define ZSV_SCAN_COMMA 1    // delimiter is ',' and quotes are handled (opts.no_quotes is 0)
+#define ZSV_SCAN_TAB_RAW 2  // delimiter is '\t' and quotes are not handled (opts.no_quotes > 0)
+#define ZSV_SCAN_NO_HOOKS 4 // no cell handler, and (with ZSV_EXTRAS) no progress callback or row limit
+
+__attribute__((always_inline)) static inline void cell_dl_spec(struct zsv_scanner * scanner, unsigned char * s, size_t n, char is_end,
+                                                               const int flags) {
+  ZSV_STATS_ADD(scanner, cells, is_end != 0);
+  char utf8_repair = 0;
+  if(VERY_UNLIKELY(scanner->utf8_malformed != NULL) && s + n > scanner->utf8_malformed) {
+    // this cell has malformed utf8. look for the next one after it
+    utf8_repair = 1;
+    scanner->utf8_malformed = zsv_utf8_find_malformed(s + n, scanner->utf8_end, 1);
+  }
+
+  if(VERY_UNLIKELY(scanner->projection != NULL) && !scanner->waiting_for_end
+     && scanner->row.used < scanner->row.allocated && !scanner->projection[scanner->row.used]) {
+    // column is not used: keep its position, but skip unquoting and the cell handler
+    struct zsv_cell c = { s, 0, 0 };
+    scanner->row.cells[scanner->row.used++] = c;
+    scanner->waiting_for_end = !is_end;
+    scanner->have_cell = 1;
+    zsv_clear_cell(scanner);
+    return;
+  }
+
   // handle quoting
-  if(UNLIKELY(scanner->quoted > 0)) {
+  if(!(flags & ZSV_SCAN_TAB_RAW) && UNLIKELY(scanner->quoted > 0)) {
+    ZSV_STATS_ADD(scanner, quoted_cells, (scanner->quoted & (ZSV_PARSER_QUOTE_CLOSED | ZSV_PARSER_QUOTE_UNCLOSED)) != 0);
+    ZSV_STATS_ADD(scanner, embedded_quote_cells, (scanner->quoted & ZSV_PARSER_QUOTE_EMBEDDED) != 0);
     if(LIKELY(scanner->quote_close_position + 1 == n)) {
       if(LIKELY((scanner->quoted & ZSV_PARSER_QUOTE_EMBEDDED) == 0)) {
         // this is the easy and usual case: no embedded double-quotes
         // just remove surrounding quotes from content
         s++;
         n -= 2;
-      } else { // embedded dbl-quotes to remove
+      } else if(scanner->opts.lazy_dequote) {
+        // leave as-is; see zsv_get_cell_unescaped()
+        scanner->quoted |= ZSV_PARSER_QUOTE_RAW;
+      } else if(VERY_LIKELY(!scanner->buff_readonly) || !zsv_scan_arena_copy(scanner, &s, n)) {
+        // embedded dbl-quotes to remove
+        scanner->raw_row_modified |= !scanner->buff_readonly;
         s++;
         n--;
         // remove dbl-quotes. TO DO: consider adding option to skip this
         for(size_t i = 0; i + 1 < n; i++) {
           if(s[i] == '"' && s[i+1] == '"') {
-            if(n > i + 2)
+            if(n > i + 2) {
               memmove(s + i + 1, s + i + 2, n - i - 2);
+              ZSV_STATS_ADD(scanner, dequote_bytes_moved, n - i - 2);
+            }
             n--;
           }
         }
         n--;
       }
     } else {
-      if(scanner->quote_close_position) {
+      if(scanner->quote_close_position
+         && (VERY_LIKELY(!scanner->buff_readonly) || !zsv_scan_arena_copy(scanner, &s, n))) {
         // the first char was a quote, and we have content after the closing quote
         // the solution below is a generalized on that will work
         // for the easy and usual case, but by handling separately
         // we avoid the memmove in the easy / usual case
+        scanner->raw_row_modified |= !scanner->buff_readonly;
         memmove(s + 1, s, scanner->quote_close_position);
+        ZSV_STATS_ADD(scanner, dequote_bytes_moved, scanner->quote_close_position);
         s += 2;
         n -= 2;
         if(UNLIKELY((scanner->quoted & ZSV_PARSER_QUOTE_EMBEDDED) != 0)) {
           // remove dbl-quotes
           for(size_t i = 0; i + 1 < n; i++) {
             if(s[i] == '"' && s[i+1] == '"') {
-              if(n > i + 2)
+              if(n > i + 2) {
                 memmove(s + i + 1, s + i + 2, n - i - 2);
+                ZSV_STATS_ADD(scanner, dequote_bytes_moved, n - i - 2);
+              }
               n--;
             }
           }
         }
       }
     }
-  } else if(UNLIKELY(scanner->opts.delimiter != ',')) {
+  } else if(!(flags & (ZSV_SCAN_COMMA | ZSV_SCAN_TAB_RAW)) && UNLIKELY(scanner->opts.delimiter != ',')) {
+    // no need with ZSV_SCAN_TAB_RAW, as every cell is then flagged as quoted anyway
     if(memchr(s, ',', n))
       scanner->quoted = ZSV_PARSER_QUOTE_NEEDED;
   }
   // end quote handling
 
+  if(VERY_UNLIKELY(utf8_repair)
+     && (VERY_LIKELY(!scanner->buff_readonly) || !zsv_scan_arena_copy(scanner, &s, n))) {
+    // even when repaired in a copy, the row's bytes no longer match its cells
+    scanner->raw_row_modified = 1;
+    n = zsv_utf8_repair(s, n, scanner->utf8_replace);
+  }
+
   if(VERY_UNLIKELY(scanner->waiting_for_end != 0)) { // overflow: cell size exceeds allocated memory
     if(scanner->opts.overflow)
       scanner->opts.overflow(scanner->opts.ctx, s, n);
   } else {
-    if(scanner->opts.cell)
+    if(!(flags & ZSV_SCAN_NO_HOOKS) && scanner->opts.cell)
       scanner->opts.cell(scanner->opts.ctx, s, n);
-    if(VERY_LIKELY(scanner->row.used < scanner->row.allocated)) {
+    if(VERY_LIKELY(scanner->row.used < scanner->row.allocated)
+       || !zsv_row_reserve(scanner, scanner->row.used + 1)) {
       struct zsv_row *row = &scanner->row;
-      struct zsv_cell c = { s, n, scanner->opts.no_quotes ? 1 : scanner->quoted };
+      struct zsv_cell c = { s, n, (flags & ZSV_SCAN_TAB_RAW) ? 1 : (flags & ZSV_SCAN_COMMA) ? scanner->quoted
+                            : scanner->opts.no_quotes ? 1 : scanner->quoted };
       row->cells[row->used++] = c;
     } else
       scanner->row.overflow++;
@@ -152,48 +378,62 @@ __attribute__((always_inline)) static inline void cell_dl(struct zsv_scanner * s
   zsv_clear_cell(scanner);
 }
 
-__attribute__((always_inline)) static inline enum zsv_status row_dl(struct zsv_scanner *scanner) {
+__attribute__((always_inline)) static inline void cell_dl(struct zsv_scanner * scanner, unsigned char * s, size_t n, char is_end) {
+  cell_dl_spec(scanner, s, n, is_end, 0);
+}
+
+__attribute__((always_inline)) static inline enum zsv_status row_dl_spec(struct zsv_scanner *scanner, const int flags) {
+  ZSV_STATS_ADD(scanner, rows, 1);
   if(VERY_UNLIKELY(scanner->row.overflow)) {
-    fprintf(stderr, "Warning: number of columns (%zu) exceeds row max (%zu)\n",
-            scanner->row.allocated + scanner->row.overflow, scanner->row.allocated);
+    // summarized by zsv_finish()
+    scanner->row.overflow_rows++;
+    if(scanner->row.overflow_max < scanner->row.allocated + scanner->row.overflow)
+      scanner->row.overflow_max = scanner->row.allocated + scanner->row.overflow;
     scanner->row.overflow = 0;
+    scanner->raw_row_modified = 1; // the row has cells that are not in row.cells
   }
   if(scanner->opts.row)
     scanner->opts.row(scanner->opts.ctx);
+  scanner->raw_row_modified = 0;
+  if(VERY_UNLIKELY(scanner->have_unescaped)) {
+    zsv_arena_reset(&scanner->unescaped);
+    scanner->have_unescaped = 0;
+  }
 # ifdef ZSV_EXTRAS
-  scanner->progress.cum_row_count++;
-  if(VERY_UNLIKELY(scanner->opts.progress.rows_interval
-                   && scanner->progress.cum_row_count % scanner->opts.progress.rows_interval == 0)) {
-    char ok;
-    if(!scanner->opts.progress.seconds_interval)
-      ok = 1;
-    else {
-      // using timer_create() would be better, but is not currently supported on
-      // all platforms, so the fallback is to poll
-      time_t now = time(NULL);
-      if(now > scanner->progress.last_time &&
-         (unsigned int)(now - scanner->progress.last_time) >=
-         scanner->opts.progress.seconds_interval) {
+  if(!(flags & ZSV_SCAN_NO_HOOKS)) {
+    scanner->progress.cum_row_count++;
+    if(VERY_UNLIKELY(scanner->opts.progress.rows_interval
+                     && scanner->progress.cum_row_count % scanner->opts.progress.rows_interval == 0)) {
+      char ok;
+      if(!scanner->opts.progress.seconds_interval)
         ok = 1;
-        scanner->progress.last_time = now;
-      } else
-        ok = 0;
-    }
-    if(ok && scanner->opts.progress.callback)
-      scanner->abort = scanner->opts.progress.callback(scanner->opts.progress.ctx, scanner->progress.cum_row_count);
+      else {
+        // using timer_create() would be better, but is not currently supported on
+        // all platforms, so the fallback is to poll
+        time_t now = time(NULL);
+        if(now > scanner->progress.last_time &&
+           (unsigned int)(now - scanner->progress.last_time) >=
+           scanner->opts.progress.seconds_interval) {
+          ok = 1;
+          scanner->progress.last_time = now;
+        } else
+          ok = 0;
+      }
+      if(ok && scanner->opts.progress.callback)
+        scanner->abort = scanner->opts.progress.callback(scanner->opts.progress.ctx, scanner->progress.cum_row_count);
 #ifndef NDEBUG
-    if(scanner->abort)
-      fprintf(stderr, "ZSV parsing aborted at %zu\n", scanner->progress.cum_row_count);
+      if(scanner->abort)
+        fprintf(stderr, "ZSV parsing aborted at %zu\n", scanner->progress.cum_row_count);
 #endif
-  }
-  if(VERY_UNLIKELY(scanner->progress.max_rows > 0)) {
-    if(VERY_UNLIKELY(scanner->progress.cum_row_count == scanner->progress.max_rows)) {
-      scanner->abort = 1;
-      scanner->row.used = 0;
-      return zsv_status_max_rows_read;
+    }
+    if(VERY_UNLIKELY(scanner->progress.max_rows > 0)) {
+      if(VERY_UNLIKELY(scanner->progress.cum_row_count == scanner->progress.max_rows)) {
+        scanner->abort = 1;
+        scanner->row.used = 0;
+        return zsv_status_max_rows_read;
+      }
     }
   }
-
 # endif
   if(VERY_UNLIKELY(scanner->abort))
     return zsv_status_cancelled;
@@ -203,219 +443,357 @@ __attribute__((always_inline)) static inline enum zsv_status row_dl(struct zsv_s
   return zsv_status_ok;
 }
 
+__attribute__((always_inline)) static inline enum zsv_status row_dl(struct zsv_scanner *scanner) {
+  return row_dl_spec(scanner, 0);
+}
+
+__attribute__((always_inline)) static inline enum zsv_status cell_and_row_dl_spec(struct zsv_scanner *scanner,
+                                                                                  unsigned char *s, size_t n,
+                                                                                  const int flags) {
+  cell_dl_spec(scanner, s, n, 1, flags);
+  return row_dl_spec(scanner, flags);
+}
+
 static inline enum zsv_status cell_and_row_dl(struct zsv_scanner *scanner, unsigned char *s, size_t n) {
-  cell_dl(scanner, s, n, 1);
-  return row_dl(scanner);
+  return cell_and_row_dl_spec(scanner, s, n, 0);
 }
 
-# define VECTOR_BYTES 32
+// see zsv_batch.c
+static void zsv_batch_row(void *ctx);
+static char zsv_batch_fixed_rows(struct zsv_scanner *scanner, unsigned char *buff,
+                                 size_t row_start, size_t row_length, size_t count);
 
-typedef unsigned char zsv_uc_vector __attribute__ ((vector_size (VECTOR_BYTES)));
+/**
+ * Return non-zero if fixed-width rows can be added to the batch (see
+ * zsv_parse_batch()) directly, without filling row.cells for the row handler
+ */
+static inline char zsv_fixed_batch(struct zsv_scanner *scanner) {
+  return scanner->opts.row == zsv_batch_row && !scanner->opts.cell;
+}
 
-#if defined(HAVE__MM256_MOVEMASK_EPI8)
-# if defined(HAVE_IMMINTRIN_H)
-#  include <immintrin.h>
-# else
-#  error MM256_MOVEMASK_EPI8 include unhandled
-# endif
-# define movemask_pseudo(x) _mm256_movemask_epi8((__m256i)x)
+static inline char row_fx(struct zsv_scanner *scanner,
+                          unsigned char *buff,
+                          size_t row_start,
+                          size_t row_end) {
+  if(zsv_fixed_batch(scanner))
+    return zsv_batch_fixed_rows(scanner, buff, row_start, row_end - row_start, 1);
+  size_t cell_start = row_start;
+  size_t row_length = row_end - row_start;
+  for(unsigned i = 0; i < scanner->fixed.count; i++) {
+    size_t cell_end = row_start + (scanner->fixed.offsets[i] > row_length ? row_length : scanner->fixed.offsets[i]);
+    size_t cell_length = cell_end - cell_start;
+    unsigned char *s = buff + cell_start;
+    if(scanner->opts.cell)
+      scanner->opts.cell(scanner->opts.ctx, s, cell_length);
+    struct zsv_cell c = { s, cell_length, 1 };
+    scanner->row.cells[scanner->row.used++] = c;
 
-#else
-/*
-  provide our own pseudo-movemask, which sets the 1 bit for each corresponding
-  non-zero value in the vector (as opposed to real movemask which sets the bit
-  only for each corresponding non-zero highest-bit value in the vector)
-*/
-static inline unsigned int movemask_pseudo(zsv_uc_vector v) {
-  unsigned int mask = 0, tmp = 1;
-  for(int i = 0; i < sizeof(zsv_uc_vector); i++) {
-    mask += (v[i] ? tmp : 0);
-    tmp <<= 1;
+    cell_start = cell_end;
   }
-  return mask;
+  ZSV_STATS_ADD(scanner, cells, scanner->fixed.count);
+  ZSV_STATS_ADD(scanner, rows, 1);
+  if(scanner->opts.row)
+    scanner->opts.row(scanner->opts.ctx);
+  scanner->raw_row_modified = 0;
+  scanner->row.used = 0;
+  return scanner->abort;
 }
-#endif
 
-# include "vector_delim.c"
-
-static enum zsv_status zsv_scan_delim(struct zsv_scanner *scanner,
-                                      unsigned char *buff,
-                                      size_t bytes_read
-                                      ) {
+/**
+ * Fixed-width scanner for rows of fixed.record_length bytes with no row end
+ * (see zsv_set_fixed_record_length()). Rows are found by arithmetic alone, and
+ * when rows are collected with zsv_parse_batch(), all complete rows in the
+ * buffer are added at once
+ */
+static enum zsv_status zsv_scan_fixed_records(struct zsv_scanner *scanner,
+                                              unsigned char *buff,
+                                              size_t bytes_read
+                                              ) {
   bytes_read += scanner->partial_row_length;
-  size_t i = scanner->partial_row_length;
-  unsigned char c;
-  char skip_next_delim = 0;
-  size_t bytes_chunk_end = bytes_read >= sizeof(zsv_uc_vector) ? bytes_read - sizeof(zsv_uc_vector) + 1 : 0;
-  const char delimiter = scanner->opts.delimiter;
-
   scanner->partial_row_length = 0;
+  scanner->buffer_end = bytes_read;
 
-  int quote = '"';
-  zsv_uc_vector dl_v; memset(&dl_v, delimiter, sizeof(zsv_uc_vector));
-  zsv_uc_vector nl_v; memset(&nl_v, '\n', sizeof(zsv_uc_vector));
-  zsv_uc_vector cr_v; memset(&cr_v, '\r', sizeof(zsv_uc_vector));
-  zsv_uc_vector qt_v;
-  if(scanner->opts.no_quotes > 0) {
-    quote = -1;
-    memset(&qt_v, 0, sizeof(qt_v));
-  } else
-    memset(&qt_v, '"', sizeof(zsv_uc_vector));
-
-  // case "hel"|"o": check if we have an embedded dbl-quote past the initial opening quote, which was
-  // split between the last buffer and this one e.g. "hel""o" where the last buffer ended
-  // with "hel" and this one starts with "o"
-  if((scanner->quoted & ZSV_PARSER_QUOTE_UNCLOSED)
-     && i > scanner->cell_start + 1 // case "|hello": need the + 1 in case split after first char of quoted value e.g. "hello" => " and hello"
-     && scanner->last == quote) {
-    if(buff[i] != quote) {
-      scanner->quoted |= ZSV_PARSER_QUOTE_CLOSED;
-      scanner->quoted -= ZSV_PARSER_QUOTE_UNCLOSED;
-      scanner->quote_close_position = i - scanner->cell_start - 1;
-    } else {
-      scanner->quoted |= ZSV_PARSER_QUOTE_NEEDED;
-      scanner->quoted |= ZSV_PARSER_QUOTE_EMBEDDED;
-      i++;
+  const size_t record_length = scanner->fixed.record_length;
+  size_t row_start = scanner->row_start;
+  size_t count = (bytes_read - row_start) / record_length;
+  if(count && zsv_fixed_batch(scanner)) {
+    if(VERY_UNLIKELY(zsv_batch_fixed_rows(scanner, buff, row_start, record_length, count)))
+      return zsv_status_cancelled;
+    row_start += count * record_length;
+  } else {
+    for(; count; count--) {
+      scanner->scanned_length = row_start + record_length;
+      if(VERY_UNLIKELY(row_fx(scanner, buff, row_start, row_start + record_length)))
+        return zsv_status_cancelled;
+      scanner->row_start = row_start += record_length;
     }
   }
+  scanner->scanned_length = scanner->row_start = row_start;
+
+  // as in the other scanners, any partial row is shifted by the next zsv_parse_more()
+  scanner->old_bytes_read = bytes_read;
+  return zsv_status_ok;
+}
+
+/**
+ * case "hel"|"o: resolve a quote at the end of the last buffer that was inside
+ * a quoted cell, and which either closes the cell or is the first of an escaped
+ * pair depending on the next char e.g. "hel""o" where the last buffer ended with
+ * "hel" and this one starts with "o"
+ *
+ * Return the position from which to continue scanning
+ */
+static inline size_t zsv_scan_quote_pending(struct zsv_scanner *scanner, unsigned char *buff, size_t i) {
+  scanner->quote_pending = 0;
+  if(buff[i] != '"') {
+    scanner->quoted |= ZSV_PARSER_QUOTE_CLOSED;
+    scanner->quoted -= ZSV_PARSER_QUOTE_UNCLOSED;
+    scanner->quote_close_position = i - scanner->cell_start - 1;
+  } else {
+    scanner->quoted |= ZSV_PARSER_QUOTE_NEEDED;
+    scanner->quoted |= ZSV_PARSER_QUOTE_EMBEDDED;
+    i++;
+  }
+  return i;
+}
 
-#define scanner_last (i ? buff[i-1] : scanner->last)
-  size_t mask_total_offset = 0;
-  unsigned int mask = 0;
-  int mask_last_start;
+/**
+ * Update the quote flags of the current cell with the bitfields, from the
+ * structural index scanner, of its closing quotes, escaped quotes and chars that
+ * need quoting, in the 64-byte block starting at base
+ */
+static inline void zsv_scan_index_quotes(struct zsv_scanner *scanner, size_t base,
+                                         uint64_t closes, uint64_t escaped, uint64_t needed) {
+  if(closes) {
+    scanner->quoted |= ZSV_PARSER_QUOTE_CLOSED;
+    scanner->quote_close_position = base + 63 - __builtin_clzll(closes) - scanner->cell_start;
+  }
+  if(escaped)
+    scanner->quoted |= ZSV_PARSER_QUOTE_EMBEDDED;
+  if(needed)
+    scanner->quoted |= ZSV_PARSER_QUOTE_NEEDED;
+}
 
-  scanner->buffer_end = bytes_read;
-  for(; i < bytes_read; i++) {
-    if(mask == 0) {
-      mask_last_start = i;
-      if(i < bytes_chunk_end) {
-        // keep going until we get a delim or we are at the eof
-        mask_total_offset = vec_delims(buff + i, bytes_read - i, &dl_v, &nl_v, &cr_v, &qt_v,
-                                       &mask);
-        if(mask_total_offset) {
-          i += mask_total_offset;
-          if(!mask) {
-            if(i == bytes_read)
-              break; // vector processing ended on exactly our buffer end
-          }
-        }
-      } else if(skip_next_delim) {
-        skip_next_delim = 0;
-        continue;
-      }
-    }
-    if(VERY_LIKELY(mask)) {
-      size_t next_offset = __builtin_ffs(mask);
-      i = mask_last_start + next_offset - 1;
-      mask = clear_lowest_bit(mask);
-      if(skip_next_delim) {
-        skip_next_delim = 0;
-        continue;
-      }
-    }
+#include "vector_delim.c"
 
-    // to do: consolidate csv and tsv/scanner->delimiter parsers
-    c = buff[i];
-    if(LIKELY(c == delimiter)) { // case ',':
-      if((scanner->quoted & ZSV_PARSER_QUOTE_UNCLOSED) == 0) {
-        scanner->scanned_length = i;
-        cell_dl(scanner, buff + scanner->cell_start, i - scanner->cell_start, 1);
-        scanner->cell_start = i + 1;
-        c = 0;
-        continue; // this char is not part of the cell content
-      } else
-        // we are inside an open quote, which is needed to escape this char
-        scanner->quoted |= ZSV_PARSER_QUOTE_NEEDED;
-    } else if(UNLIKELY(c == '\r')) {
-      if((scanner->quoted & ZSV_PARSER_QUOTE_UNCLOSED) == 0) {
-        scanner->scanned_length = i;
-        enum zsv_status stat = cell_and_row_dl(scanner, buff + scanner->cell_start, i - scanner->cell_start);
-        if(VERY_UNLIKELY(stat))
-          return stat;
-
-        scanner->cell_start = i + 1;
-        scanner->row_start = i + 1;
-        continue; // this char is not part of the cell content
-      } else
-        // we are inside an open quote, which is needed to escape this char
-        scanner->quoted |= ZSV_PARSER_QUOTE_NEEDED;
-    } else if(UNLIKELY(c == '\n')) {
-      if((scanner->quoted & ZSV_PARSER_QUOTE_UNCLOSED) == 0) {
-        if(scanner_last == '\r') { // ignore; we are outside a cell and last char was rowend
-          scanner->cell_start = i + 1;
-          scanner->row_start = i + 1;
-        } else {
-          // this is a row end
-          scanner->scanned_length = i;
-          enum zsv_status stat = cell_and_row_dl(scanner, buff + scanner->cell_start, i - scanner->cell_start);
-          if(VERY_UNLIKELY(stat))
-            return stat;
-          scanner->cell_start = i + 1;
-          scanner->row_start = i + 1;
-        }
-        continue; // this char is not part of the cell content
-      } else
-        // we are inside an open quote, which is needed to escape this char
-        scanner->quoted |= ZSV_PARSER_QUOTE_NEEDED;
-    } else if(LIKELY(c == quote)) {
-      if(i == scanner->cell_start) {
-        scanner->quoted = ZSV_PARSER_QUOTE_UNCLOSED;
-        scanner->quote_close_position = 0;
-        c = 0;
-      } else if(scanner->quoted & ZSV_PARSER_QUOTE_UNCLOSED) {
-        // the cell started with a quote that is not yet closed
-        if(VERY_LIKELY(i + 1 < bytes_read)) {
-          if(LIKELY(buff[i+1] != quote)) {
-            // buff[i] is the closing quote (not an escaped quote)
-            scanner->quoted |= ZSV_PARSER_QUOTE_CLOSED;
-            scanner->quoted -= ZSV_PARSER_QUOTE_UNCLOSED;
-
-            // keep track of closing quote position to handle the edge case
-            // where content follows the closing quote e.g. cell content is:
-            //  "this-cell"-did-not-need-quotes
-            if(LIKELY(scanner->quote_close_position == 0))
-              scanner->quote_close_position = i - scanner->cell_start;
-          } else {
-            // next char is also '"'
-            // e.g. cell content is: "this "" is a dbl quote"
-            //           cursor is here => ^
-            // include in cell content and don't further process
-            scanner->quoted |= ZSV_PARSER_QUOTE_NEEDED;
-            scanner->quoted |= ZSV_PARSER_QUOTE_EMBEDDED;
-            skip_next_delim = 1;
-          }
-        }
-      } else {
-        // cell_length > 0 and cell did not start w quote, so
-        // we have a quote in middle of an unquoted cell
-        // process as a normal char
-        scanner->quoted |= ZSV_PARSER_QUOTE_EMBEDDED;
-        scanner->quote_close_position = 0;
-      }
+/*
+ * Instantiate the delimited and fixed-width scanners once for each vector
+ * kernel, as zsv_scan_delim_<kernel>() and zsv_scan_fixed_<kernel>()
+ */
+#define ZSV_SCAN_CONCAT_(a, b) a##_##b
+#define ZSV_SCAN_CONCAT(a, b) ZSV_SCAN_CONCAT_(a, b)
+#define ZSV_SCAN_FN(name) ZSV_SCAN_CONCAT(name, ZSV_SCAN_KERNEL)
+#define ZSV_SCAN_VEC_BYTES ZSV_SCAN_CONCAT(ZSV_VEC_BYTES, ZSV_SCAN_KERNEL)
+
+#define ZSV_SCAN_KERNEL generic
+#define ZSV_SCAN_TARGET
+#include "zsv_scan_delim.c"
+#include "zsv_scan_index.c"
+#include "zsv_scan_fixed.c"
+#undef ZSV_SCAN_TARGET
+#undef ZSV_SCAN_KERNEL
+
+#ifdef ZSV_VEC_X86
+#define ZSV_SCAN_KERNEL sse2
+#define ZSV_SCAN_TARGET __attribute__((target("sse2")))
+#include "zsv_scan_delim.c"
+#include "zsv_scan_index.c"
+#include "zsv_scan_fixed.c"
+#undef ZSV_SCAN_TARGET
+#undef ZSV_SCAN_KERNEL
+
+#define ZSV_SCAN_KERNEL avx2
+#define ZSV_SCAN_TARGET __attribute__((target("avx2,pclmul")))
+#include "zsv_scan_delim.c"
+#include "zsv_scan_index.c"
+#include "zsv_scan_fixed.c"
+#undef ZSV_SCAN_TARGET
+#undef ZSV_SCAN_KERNEL
+
+#define ZSV_SCAN_KERNEL avx512
+#define ZSV_SCAN_TARGET __attribute__((target("avx512f,avx512bw,pclmul")))
+#include "zsv_scan_delim.c"
+#include "zsv_scan_index.c"
+#include "zsv_scan_fixed.c"
+#undef ZSV_SCAN_TARGET
+#undef ZSV_SCAN_KERNEL
+
+static int zsv_cpu_has_sse2(void) {
+  return __builtin_cpu_supports("sse2");
+}
+
+static int zsv_cpu_has_avx2(void) {
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("pclmul");
+}
+
+static int zsv_cpu_has_avx512(void) {
+  return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+    && __builtin_cpu_supports("pclmul");
+}
+#endif /* ZSV_VEC_X86 */
+
+#ifdef ZSV_VEC_NEON
+#define ZSV_SCAN_KERNEL neon
+#define ZSV_SCAN_TARGET
+#include "zsv_scan_delim.c"
+#include "zsv_scan_index.c"
+#include "zsv_scan_fixed.c"
+#undef ZSV_SCAN_TARGET
+#undef ZSV_SCAN_KERNEL
+#endif
+
+struct zsv_scan_kernel {
+  const char *name;
+  int (*supported)(void); // NULL if always supported
+  // delimited scanners, indexed by their ZSV_SCAN_XXX flags
+  enum zsv_status (*scan_delim[ZSV_SCAN_NO_HOOKS * 2])(struct zsv_scanner *scanner, unsigned char *buff, size_t bytes_read);
+  enum zsv_status (*scan_index)(struct zsv_scanner *scanner, unsigned char *buff, size_t bytes_read);
+  enum zsv_status (*scan_fixed)(struct zsv_scanner *scanner, unsigned char *buff, size_t bytes_read);
+};
+
+#define ZSV_SCAN_KERNEL_ENTRY(kernel, supported) \
+  { #kernel, supported,                                                                  \
+    { [0] = zsv_scan_delim_##kernel,                                                   \
+      [ZSV_SCAN_NO_HOOKS] = zsv_scan_delim_lean_##kernel,                              \
+      [ZSV_SCAN_COMMA] = zsv_scan_delim_csv_##kernel,                                  \
+      [ZSV_SCAN_COMMA | ZSV_SCAN_NO_HOOKS] = zsv_scan_delim_csv_lean_##kernel,         \
+      [ZSV_SCAN_TAB_RAW] = zsv_scan_delim_tab_##kernel,                                \
+      [ZSV_SCAN_TAB_RAW | ZSV_SCAN_NO_HOOKS] = zsv_scan_delim_tab_lean_##kernel },     \
+    zsv_scan_index_##kernel, zsv_scan_fixed_##kernel }
+
+// in order of preference
+static const struct zsv_scan_kernel zsv_scan_kernels[] = {
+#ifdef ZSV_VEC_X86
+  ZSV_SCAN_KERNEL_ENTRY(avx512, zsv_cpu_has_avx512),
+  ZSV_SCAN_KERNEL_ENTRY(avx2, zsv_cpu_has_avx2),
+  ZSV_SCAN_KERNEL_ENTRY(sse2, zsv_cpu_has_sse2),
+#endif
+#ifdef ZSV_VEC_NEON
+  ZSV_SCAN_KERNEL_ENTRY(neon, NULL),
+#endif
+  ZSV_SCAN_KERNEL_ENTRY(generic, NULL)
+};
+
+/**
+ * Return the ZSV_SCAN_XXX flags that hold for the given options, to select
+ * the delimited scanner specialized for them
+ */
+static int zsv_scan_delim_flags(const struct zsv_opts *opts) {
+  int flags = 0;
+  if(opts->delimiter == ',' && opts->no_quotes == 0)
+    flags |= ZSV_SCAN_COMMA;
+  else if(opts->delimiter == '\t' && opts->no_quotes > 0)
+    flags |= ZSV_SCAN_TAB_RAW;
+
+  char hooks = opts->cell != NULL;
+#ifdef ZSV_EXTRAS
+  hooks = hooks || opts->progress.rows_interval || opts->max_rows;
+#endif
+  if(!hooks)
+    flags |= ZSV_SCAN_NO_HOOKS;
+  return flags;
+}
+
+/**
+ * Select the best vector kernel that the host cpu supports. This can be
+ * overridden by setting the environment variable ZSV_VECTOR_KERNEL to the
+ * name of a specific kernel (e.g. for testing or benchmarking)
+ *
+ * The selection is made once per process
+ */
+static const struct zsv_scan_kernel *zsv_scan_kernel_select(char verbose) {
+  static const struct zsv_scan_kernel *selected = NULL;
+  if(!selected) {
+    const struct zsv_scan_kernel *k = NULL;
+    const size_t count = sizeof(zsv_scan_kernels) / sizeof(zsv_scan_kernels[0]);
+#ifdef ZSV_VEC_X86
+    __builtin_cpu_init();
+#endif
+    const char *requested = getenv("ZSV_VECTOR_KERNEL");
+    if(requested && *requested) {
+      for(size_t i = 0; i < count && !k; i++)
+        if(!strcmp(requested, zsv_scan_kernels[i].name)
+           && (!zsv_scan_kernels[i].supported || zsv_scan_kernels[i].supported()))
+          k = &zsv_scan_kernels[i];
+      if(!k)
+        fprintf(stderr, "warning: ignoring ZSV_VECTOR_KERNEL %s (unknown or not supported by this cpu)\n",
+                requested);
     }
+    for(size_t i = 0; i < count && !k; i++)
+      if(!zsv_scan_kernels[i].supported || zsv_scan_kernels[i].supported())
+        k = &zsv_scan_kernels[i];
+    if(verbose)
+      fprintf(stderr, "Using %s scanner\n", k->name);
+    selected = k;
   }
-  scanner->scanned_length = i;
+  return selected;
+}
 
-  // save bytes_read-- we will need to shift any remaining partial row
-  // before we read next from our input. however, we intentionally refrain
-  // from doing this until the next parse_more() call, so that the entirety
-  // of all rows parsed thus far are still available until that next call
-  scanner->old_bytes_read = bytes_read;
-  return zsv_status_ok;
+/**
+ * Set the scanner functions for the given options, e.g. again after
+ * opts.sniff has changed the delimiter
+ */
+static void zsv_scanner_select_scan(struct zsv_scanner *scanner, const struct zsv_opts *opts) {
+  const struct zsv_scan_kernel *kernel = zsv_scan_kernel_select(0);
+  scanner->scan_delim = opts->structural_index ? kernel->scan_index : kernel->scan_delim[zsv_scan_delim_flags(opts)];
+  scanner->scan_fixed = scanner->fixed.record_length ? zsv_scan_fixed_records : kernel->scan_fixed;
 }
 
-#include "zsv_scan_fixed.c"
+static inline enum zsv_status zsv_scan_mode(struct zsv_scanner *scanner,
+                                            unsigned char *buff,
+                                            size_t bytes_read
+                                            ) {
+  switch(scanner->mode) {
+  case ZSV_MODE_FIXED:
+    return scanner->scan_fixed(scanner, buff, bytes_read);
+  default:
+    if(VERY_UNLIKELY(scanner->utf8_check)) {
+      // validate everything from the start of the current cell
+      scanner->utf8_end = buff + scanner->partial_row_length + bytes_read;
+      scanner->utf8_malformed = zsv_utf8_find_malformed(buff + scanner->cell_start, scanner->utf8_end, 1);
+    }
+    return scanner->scan_delim(scanner, buff, bytes_read);
+  }
+}
 
 enum zsv_status zsv_scan(struct zsv_scanner *scanner,
                          unsigned char *buff,
                          size_t bytes_read
                          ) {
-  switch(scanner->mode) {
-  case ZSV_MODE_FIXED:
-    return zsv_scan_fixed(scanner, buff, bytes_read);
-  default:
-    return zsv_scan_delim(scanner, buff, bytes_read);
+  scanner->scan_buff = buff;
+#ifdef ZSV_STATS
+  ZSV_STATS_TIMER_START(start);
+  enum zsv_status stat = zsv_scan_mode(scanner, buff, bytes_read);
+  ZSV_STATS_TIMER_STOP(scanner, scan_ns, start);
+  return stat;
+#else
+  return zsv_scan_mode(scanner, buff, bytes_read);
+#endif
+}
+
+/**
+ * Prepare a partial row at the end of the buffer for further scanning, as
+ * zsv_parse_more() does before reading more data, but by moving the start of
+ * the buffer forward instead of moving the data. Used when the buffer is not
+ * reused e.g. when scanning a chunk of a larger buffer that stays in memory
+ */
+static void zsv_scan_rebase(struct zsv_scanner *scanner) {
+  scanner->last = '\0';
+  if(scanner->old_bytes_read) {
+    scanner->last = scanner->buff.buff[scanner->old_bytes_read-1];
+    if(scanner->row_start < scanner->old_bytes_read) {
+      scanner->partial_row_length = scanner->old_bytes_read - scanner->row_start;
+      scanner->buff.buff += scanner->row_start;
+      scanner->buff.size -= scanner->row_start;
+      scanner->cell_start -= scanner->row_start;
+    } else {
+      scanner->cell_start = 0;
+      zsv_clear_cell(scanner);
+    }
+    scanner->row_start = 0;
+    scanner->old_bytes_read = 0;
   }
+  scanner->scanned_length = scanner->partial_row_length;
 }
 
 #define ZSV_BOM "\xef\xbb\xbf"
@@ -430,6 +808,10 @@ enum zsv_status zsv_set_scan_filter(struct zsv_scanner *scanner,
                                                                 size_t bytes_read),
                                                void *ctx
                                                ) {
+  if(scanner->buff_readonly && scanner->checked_bom) {
+    fprintf(stderr, "Filter cannot be set after parsing of a memory-mapped file has begun\n");
+    return zsv_status_invalid_option;
+  }
   scanner->filter = filter;
   scanner->filter_ctx = ctx;
   return zsv_status_ok;
@@ -440,27 +822,6 @@ size_t zsv_filter_write(void *FILEp, unsigned char *buff, size_t bytes_read) {
   return bytes_read;
 }
 
-// zsv_parse_string(): *utf8 may not overlap w scanner buffer!
-enum zsv_status zsv_parse_string(struct zsv_scanner *scanner,
-                                            const unsigned char *utf8,
-                                            size_t len) {
-  const unsigned char *cursor = utf8;
-  while(len) {
-    size_t capacity = scanner->buff.size - scanner->partial_row_length;
-    size_t bytes_read = len > capacity ? capacity : len;
-    memcpy(scanner->buff.buff + scanner->partial_row_length, cursor, len);
-    cursor += len;
-    len -= bytes_read;
-    if(scanner->filter)
-      bytes_read = scanner->filter(scanner->filter_ctx,
-                                   scanner->buff.buff + scanner->partial_row_length,
-                                   bytes_read);
-    if(bytes_read)
-      return zsv_scan(scanner, scanner->buff.buff, bytes_read);
-  }
-  return zsv_status_ok;
-}
-
 static void zsv_throwaway_row(void *ctx) {
   struct zsv_scanner *scanner = ctx;
   scanner->opts.row = scanner->row_orig;
@@ -497,6 +858,9 @@ static int zsv_scanner_init(struct zsv_scanner *scanner,
   scanner->buff.buff = opts->buff;
   scanner->buff.size = opts->buffsize;
 
+  zsv_scan_kernel_select(opts->verbose);
+  zsv_scanner_select_scan(scanner, opts);
+
   if(opts->buffsize && !opts->buff) {
     scanner->buff.buff = malloc(opts->buffsize);
     scanner->free_buff = 1;
@@ -510,8 +874,10 @@ static int zsv_scanner_init(struct zsv_scanner *scanner,
     scanner->opts = *opts;
     if(!scanner->opts.max_columns)
       scanner->opts.max_columns = 1024;
-    if((scanner->row.allocated = scanner->opts.max_columns)
-       && (scanner->row.cells = calloc(scanner->row.allocated, sizeof(*scanner->row.cells))))
+    // the cells array grows as needed, up to max_columns (see zsv_row_reserve())
+    scanner->row.allocated = scanner->opts.max_columns < ZSV_ROW_INITIAL_CELLS ?
+      scanner->opts.max_columns : ZSV_ROW_INITIAL_CELLS;
+    if((scanner->row.cells = calloc(scanner->row.allocated, sizeof(*scanner->row.cells))))
       return 0;
   }
   return 1;
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2021 Tai Chi Minh Ralph Eastwood (self), Matt Wong (Guarnerix Inc dba Liquidaty)
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+/*
+ * Memory-mapped input (see zsv_new_mmap())
+ *
+ * The scanner scans the mapping directly, one window of opts.buffsize bytes
+ * at a time. Instead of moving a partial row at the end of a window to the
+ * start of the buffer, the next window simply starts at the partial row, so
+ * there is no copying and no limit on row size. Cells that must be modified
+ * to remove quotes are copied to a side arena first, since the mapping is
+ * read-only
+ */
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+# define ZSV_HAVE_MMAP
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+/**
+ * Replace *s with a writable copy of its n bytes, from an arena that is reset
+ * at each call to zsv_parse_more(). Return 0 on success
+ */
+static int zsv_scan_arena_copy(struct zsv_scanner *scanner, unsigned char **s, size_t n) {
+  unsigned char *dest = zsv_arena_alloc(&scanner->arena, n + 2); // cell_dl() may write up to 2 bytes past the cell end
+  if(!dest)
+    return 1;
+
+  // the cell may extend past the end of the data (see zsv_finish())
+  size_t available = scanner->readonly_end - *s;
+  if(n > available) {
+    memcpy(dest, *s, available);
+    memset(dest + available, 0, n - available);
+  } else
+    memcpy(dest, *s, n);
+  *s = dest;
+  return 0;
+}
+
+/**
+ * Reset the arena at the start of a window. Cells of a partial row that were
+ * copied to the arena are still needed, so move them to the spare arena and
+ * swap the two
+ */
+static void zsv_mmap_arena_reset(struct zsv_scanner *scanner) {
+  const unsigned char *start = scanner->mmap.base;
+  const unsigned char *end = start + scanner->mmap.size;
+  struct zsv_arena *spare = &scanner->arena_spare;
+  char swap = 0;
+  for(size_t i = 0; i < scanner->row.used; i++) {
+    struct zsv_cell *c = &scanner->row.cells[i];
+    if(c->len && (c->str < start || c->str >= end)) {
+      if(!swap) {
+        zsv_arena_reset(spare);
+        swap = 1;
+      }
+      unsigned char *dest = zsv_arena_alloc(spare, c->len);
+      if(dest) {
+        memcpy(dest, c->str, c->len);
+        c->str = dest;
+      } else
+        c->len = 0;
+    }
+  }
+  if(swap) {
+    struct zsv_arena tmp = scanner->arena;
+    scanner->arena = *spare;
+    *spare = tmp;
+  } else
+    zsv_arena_reset(&scanner->arena);
+}
+
+// zsv_generic_read that copies from the mapping, for when we can't scan it directly
+static size_t zsv_mmap_read(void *buff, size_t n, size_t size, void *in) {
+  struct zsv_scanner *scanner = in;
+  size_t len = n * size;
+  size_t available = scanner->mmap.size - scanner->mmap.read_pos;
+  if(len > available)
+    len = available;
+  memcpy(buff, scanner->mmap.base + scanner->mmap.read_pos, len);
+  scanner->mmap.read_pos += len;
+  return len;
+}
+
+static enum zsv_status zsv_mmap_parse_more(struct zsv_scanner *scanner) {
+  if(UNLIKELY(!scanner->checked_bom)) {
+    if(scanner->filter) {
+      // the filter may modify the data, so copy it to our own buffer as usual
+      scanner->buff_readonly = 0;
+      scanner->buff.buff = scanner->mmap.work_buff;
+      scanner->buff.size = scanner->mmap.work_size;
+      scanner->read = zsv_mmap_read;
+      scanner->in = scanner;
+      return zsv_parse_more(scanner);
+    }
+
+#ifdef ZSV_EXTRAS
+    if(scanner->opts.progress.seconds_interval)
+      scanner->progress.last_time = time(NULL);
+#endif
+
+    scanner->checked_bom = 1;
+    size_t bom_len = strlen(ZSV_BOM);
+    if(scanner->mmap.size >= bom_len && !memcmp(scanner->mmap.base, ZSV_BOM, bom_len)) {
+      scanner->mmap.data += bom_len;
+      scanner->had_bom = 1;
+    }
+
+    if(scanner->insert_string) {
+      // scan the inserted row in our own buffer, then start over at the mapping
+      scanner->buff.buff = scanner->mmap.work_buff;
+      scanner->buff.size = scanner->mmap.work_size;
+      scanner->buff_readonly = 0;
+      zsv_scan_insert_string(scanner);
+      scanner->buff_readonly = 1;
+      scanner->old_bytes_read = scanner->row_start = scanner->cell_start = 0;
+      scanner->scanned_length = 0;
+      scanner->buff.size = scanner->opts.buffsize;
+    }
+    zsv_scanner_sniff(scanner, scanner->mmap.data,
+                      scanner->mmap.base + scanner->mmap.size - scanner->mmap.data);
+    scanner->buff.buff = scanner->mmap.data;
+  }
+
+  zsv_mmap_arena_reset(scanner);
+
+  // keep any partial row by moving the start of the buffer to the start of the row
+  scanner->last = '\0';
+  if(scanner->old_bytes_read) {
+    scanner->last = scanner->buff.buff[scanner->old_bytes_read-1];
+    scanner->partial_row_length = scanner->old_bytes_read - scanner->row_start;
+    if(!scanner->partial_row_length)
+      zsv_clear_cell(scanner);
+    scanner->buff.buff += scanner->row_start;
+    scanner->cell_start -= scanner->row_start;
+    scanner->row_start = 0;
+    scanner->old_bytes_read = 0;
+  }
+  scanner->cum_scanned_length = scanner->buff.buff - scanner->mmap.data;
+
+  size_t available = scanner->mmap.base + scanner->mmap.size - (scanner->buff.buff + scanner->partial_row_length);
+  if(!available) {
+    scanner->scanned_length = scanner->partial_row_length;
+    return zsv_status_no_more_input;
+  }
+  size_t bytes_read = available > scanner->opts.buffsize ? scanner->opts.buffsize : available;
+  return zsv_scan(scanner, scanner->buff.buff, bytes_read);
+}
+
+static void zsv_mmap_delete(struct zsv_scanner *scanner) {
+#ifdef ZSV_HAVE_MMAP
+  if(scanner->mmap.base)
+    munmap(scanner->mmap.base, scanner->mmap.size);
+#endif
+  if(scanner->buff_readonly) // restore our own buffer so that zsv_delete() can free it
+    scanner->buff.buff = scanner->mmap.work_buff;
+  scanner->mmap.base = NULL;
+  zsv_arena_delete(&scanner->arena);
+  zsv_arena_delete(&scanner->arena_spare);
+  if(scanner->own_stream)
+    fclose(scanner->own_stream);
+  scanner->own_stream = NULL;
+}
+
+ZSV_EXPORT
+zsv_parser zsv_new_mmap(const char *path, struct zsv_opts *opts) {
+  struct zsv_opts tmp;
+  if(!opts) {
+    opts = &tmp;
+    memset(opts, 0, sizeof(*opts));
+  }
+
+#ifdef ZSV_HAVE_MMAP
+  int fd = open(path, O_RDONLY);
+  if(fd < 0) {
+    perror(path);
+    return NULL;
+  }
+  struct stat st;
+  void *base = MAP_FAILED;
+  if(!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0)
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if(base != MAP_FAILED) {
+    size_t size = st.st_size;
+    void *stream = opts->stream;
+    opts->stream = NULL;
+    zsv_parser parser = zsv_new(opts);
+    opts->stream = stream;
+    if(!parser) {
+      munmap(base, size);
+      return NULL;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(base, size, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_HUGEPAGE
+    madvise(base, size, MADV_HUGEPAGE); // only a hint; may not be supported for files
+#endif
+    parser->mmap.base = parser->mmap.data = base;
+    parser->mmap.size = size;
+    parser->readonly_end = parser->mmap.base + size;
+    parser->mmap.work_buff = parser->buff.buff;
+    parser->mmap.work_size = parser->buff.size;
+    parser->buff.buff = parser->mmap.data;
+    parser->buff_readonly = 1;
+    parser->in = NULL;
+    return parser;
+  }
+#endif
+
+  // not a regular file (or an empty one), or could not be mapped: read it as usual
+  FILE *f = fopen(path, "rb");
+  if(!f) {
+    perror(path);
+    return NULL;
+  }
+  void *stream = opts->stream;
+  opts->stream = f;
+  zsv_parser parser = zsv_new(opts);
+  opts->stream = stream;
+  if(!parser)
+    fclose(f);
+  else
+    parser->own_stream = f;
+  return parser;
+}
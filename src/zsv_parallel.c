@@ -0,0 +1,730 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+/*
+ * zsv_parse_parallel(): parse one seekable input with multiple threads
+ *
+ * Each round reads (nthreads * segment size) bytes and proceeds in phases:
+ * 1. read: each worker preads its own segment into the shared round buffer
+ * 2. speculate: the round is split just after the first row-end char found in
+ *    each segment. Each worker computes the quote state at the end of its
+ *    range for both possible start states (outside quotes, or inside a
+ *    quoted cell)
+ * 3. resolve (main thread): starting from the known state at the start of the
+ *    round, chain the speculative results to find which split points are real
+ *    row boundaries. Splits that fall inside a quoted cell are dropped
+ * 4. scan: each worker runs its own scanner over one resolved chunk, in place,
+ *    and collects its rows
+ * 5. deliver (main thread): rows are copied into the caller's parser, in input
+ *    order, and passed through the usual cell / row handlers via row_dl()
+ *
+ * Any data after the last resolved row boundary is re-read in the next round
+ *
+ * If the parser has an index (see zsv_set_index()), split points are taken from
+ * the index where possible. These are known row boundaries, so the ranges that
+ * end at them need not be speculated on
+ */
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__) && !defined(ZSV_NO_THREADS)
+# define ZSV_HAVE_PARALLEL
+#endif
+
+#ifdef ZSV_HAVE_PARALLEL
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef ZSV_PARALLEL_SEGMENT_BUFFS
+#define ZSV_PARALLEL_SEGMENT_BUFFS 8 // segment size, as a multiple of opts.buffsize
+#endif
+
+#ifndef ZSV_PARALLEL_MAX_GROWTH
+#define ZSV_PARALLEL_MAX_GROWTH 4 // times a round may double before reverting to serial
+#endif
+
+// speculative scan states
+#define ZSV_PARALLEL_CELL_START 0
+#define ZSV_PARALLEL_UNQUOTED 1
+#define ZSV_PARALLEL_QUOTED 2
+
+enum zsv_parallel_phase {
+  zsv_parallel_phase_read = 1,
+  zsv_parallel_phase_speculate,
+  zsv_parallel_phase_scan,
+  zsv_parallel_phase_exit
+};
+
+struct zsv_parallel_barrier {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  unsigned count;
+  unsigned waiting;
+  unsigned generation;
+};
+
+struct zsv_parallel_row {
+  size_t first_cell;
+  size_t cell_count;
+};
+
+struct zsv_parallel;
+
+struct zsv_parallel_worker {
+  struct zsv_parallel *p;
+  struct zsv_scanner *scanner;
+  pthread_t thread;
+
+  // read phase
+  size_t read_offset, read_len, bytes_read;
+
+  // speculate phase
+  size_t range_start, range_end;
+  unsigned char end_state[2]; // [0]: starting outside quotes; [1]: starting inside quotes
+
+  // scan phase
+  size_t chunk_start, chunk_end;
+  char final_chunk;
+  enum zsv_status stat;
+
+  struct {
+    struct zsv_parallel_row *rows;
+    size_t count, allocated;
+    struct zsv_cell *cells;
+    size_t cell_count, cells_allocated;
+  } out;
+};
+
+struct zsv_parallel {
+  struct zsv_scanner *parser;
+  int fd;
+  char delimiter;
+  char no_quotes;
+
+  unsigned char *buff;
+  size_t buff_size;
+  size_t data_len;
+
+  size_t offset; // file offset of the current round
+
+  unsigned nthreads; // number of workers allocated
+  unsigned active;   // number of workers running, including the calling thread
+  struct zsv_parallel_worker *workers;
+  struct zsv_parallel_barrier barrier;
+  enum zsv_parallel_phase phase;
+
+  size_t *splits; // candidate row boundaries within the round
+  char *split_known; // split_known[i] is set if splits[i] is an indexed row boundary
+  unsigned split_count;
+
+  struct zsv_index *index; // see zsv_set_index(), or NULL
+};
+
+static void zsv_parallel_barrier_wait(struct zsv_parallel_barrier *b) {
+  pthread_mutex_lock(&b->mutex);
+  unsigned generation = b->generation;
+  if(++b->waiting == b->count) {
+    b->waiting = 0;
+    b->generation++;
+    pthread_cond_broadcast(&b->cond);
+  } else {
+    while(generation == b->generation)
+      pthread_cond_wait(&b->cond, &b->mutex);
+  }
+  pthread_mutex_unlock(&b->mutex);
+}
+
+/**
+ * Return the quote state at the end of s..end, given the state at s
+ * Only quotes at the start of a cell open a quoted cell; all others are
+ * content, as in zsv_scan_delim()
+ */
+static unsigned char zsv_parallel_speculate(const unsigned char *s, const unsigned char *end,
+                                            unsigned char state, char delimiter) {
+  while(s < end) {
+    const unsigned char *q = memchr(s, '"', end - s);
+    if(state == ZSV_PARALLEL_QUOTED) {
+      if(!q)
+        return ZSV_PARALLEL_QUOTED;
+      if(q + 1 == end)
+        return ZSV_PARALLEL_QUOTED; // closing quote or first of an escaped pair: undecided
+      unsigned char c = q[1];
+      if(c == '"')
+        state = ZSV_PARALLEL_QUOTED;
+      else if(c == delimiter || c == '\n' || c == '\r')
+        state = ZSV_PARALLEL_CELL_START;
+      else
+        state = ZSV_PARALLEL_UNQUOTED; // content after the closing quote
+      s = q + 2;
+    } else {
+      if(!q) {
+        unsigned char c = end[-1];
+        if(c == delimiter || c == '\n' || c == '\r')
+          return ZSV_PARALLEL_CELL_START;
+        return ZSV_PARALLEL_UNQUOTED;
+      }
+      // a quote opens a quoted cell only if it is the first char of the cell
+      char at_cell_start;
+      if(q == s)
+        at_cell_start = state == ZSV_PARALLEL_CELL_START;
+      else
+        at_cell_start = q[-1] == delimiter || q[-1] == '\n' || q[-1] == '\r';
+      state = at_cell_start ? ZSV_PARALLEL_QUOTED : ZSV_PARALLEL_UNQUOTED;
+      s = q + 1;
+    }
+  }
+  return state;
+}
+
+/**
+ * Return the offset following the first row-end in [start, end), or 0 if none
+ * A \r\n pair is kept together so that no chunk starts with the \n
+ */
+static size_t zsv_parallel_find_split(const unsigned char *buff, size_t start, size_t end,
+                                      size_t data_len) {
+  const unsigned char *s = buff + start;
+  const unsigned char *nl = memchr(s, '\n', end - start);
+  const unsigned char *cr = memchr(s, '\r', (nl ? nl : buff + end) - s);
+  if(cr) {
+    if(cr + 1 == buff + data_len)
+      return 0; // can't yet tell if this is followed by \n
+    if(cr[1] == '\n')
+      return cr + 2 - buff;
+    return cr + 1 - buff;
+  }
+  return nl ? (size_t)(nl + 1 - buff) : 0;
+}
+
+static void zsv_parallel_row(void *ctx) {
+  struct zsv_parallel_worker *w = ctx;
+  struct zsv_scanner *scanner = w->scanner;
+  size_t n = scanner->row.used;
+  if(VERY_UNLIKELY(w->out.count == w->out.allocated)) {
+    size_t allocated = w->out.allocated ? w->out.allocated * 2 : 1024;
+    struct zsv_parallel_row *rows = realloc(w->out.rows, allocated * sizeof(*rows));
+    if(!rows) {
+      w->stat = zsv_status_memory;
+      scanner->abort = 1;
+      return;
+    }
+    w->out.rows = rows;
+    w->out.allocated = allocated;
+  }
+  if(VERY_UNLIKELY(w->out.cell_count + n > w->out.cells_allocated)) {
+    size_t allocated = w->out.cells_allocated ? w->out.cells_allocated * 2 : 8192;
+    while(allocated < w->out.cell_count + n)
+      allocated *= 2;
+    struct zsv_cell *cells = realloc(w->out.cells, allocated * sizeof(*cells));
+    if(!cells) {
+      w->stat = zsv_status_memory;
+      scanner->abort = 1;
+      return;
+    }
+    w->out.cells = cells;
+    w->out.cells_allocated = allocated;
+  }
+  struct zsv_parallel_row *r = &w->out.rows[w->out.count++];
+  r->first_cell = w->out.cell_count;
+  r->cell_count = n;
+  memcpy(w->out.cells + w->out.cell_count, scanner->row.cells, n * sizeof(*scanner->row.cells));
+  w->out.cell_count += n;
+}
+
+static void zsv_parallel_read(struct zsv_parallel_worker *w) {
+  struct zsv_parallel *p = w->p;
+  w->bytes_read = 0;
+  while(w->bytes_read < w->read_len) {
+    ssize_t n = pread(p->fd, p->buff + w->read_offset + w->bytes_read, w->read_len - w->bytes_read,
+                      (off_t)(p->offset + w->read_offset + w->bytes_read));
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n <= 0)
+      break;
+    w->bytes_read += (size_t)n;
+  }
+}
+
+static void zsv_parallel_scan(struct zsv_parallel_worker *w) {
+  struct zsv_parallel *p = w->p;
+  struct zsv_scanner *scanner = w->scanner;
+  unsigned char *own_buff = scanner->buff.buff;
+  size_t own_size = scanner->buff.size;
+
+  w->out.count = 0;
+  w->out.cell_count = 0;
+  w->stat = zsv_status_ok;
+
+  scanner->cell_start = scanner->row_start = 0;
+  scanner->partial_row_length = scanner->old_bytes_read = 0;
+  scanner->scanned_length = 0;
+  scanner->row.used = 0;
+  scanner->have_cell = 0;
+  scanner->finished = 0;
+  scanner->last = '\0';
+  zsv_clear_cell(scanner);
+
+  size_t len = w->chunk_end - w->chunk_start;
+  scanner->buff.buff = p->buff + w->chunk_start;
+  scanner->buff.size = len;
+  if(len) {
+    enum zsv_status stat = zsv_scan(scanner, scanner->buff.buff, len);
+    if(stat && !w->stat)
+      w->stat = stat;
+  }
+  if(w->final_chunk && !w->stat) {
+    zsv_scan_rebase(scanner);
+    scanner->finished = 1;
+    zsv_finish_input(scanner); // not zsv_finish(), which would warn of too-wide rows itself
+  }
+  scanner->buff.buff = own_buff;
+  scanner->buff.size = own_size;
+}
+
+static void zsv_parallel_work(struct zsv_parallel_worker *w) {
+  struct zsv_parallel *p = w->p;
+  switch(p->phase) {
+  case zsv_parallel_phase_read:
+    zsv_parallel_read(w);
+    break;
+  case zsv_parallel_phase_speculate:
+    if(w->range_end > w->range_start) {
+      const unsigned char *s = p->buff + w->range_start, *end = p->buff + w->range_end;
+      w->end_state[0] = zsv_parallel_speculate(s, end, ZSV_PARALLEL_CELL_START, p->delimiter);
+      w->end_state[1] = zsv_parallel_speculate(s, end, ZSV_PARALLEL_QUOTED, p->delimiter);
+    }
+    break;
+  case zsv_parallel_phase_scan:
+    if(w->chunk_end > w->chunk_start || w->final_chunk)
+      zsv_parallel_scan(w);
+    break;
+  case zsv_parallel_phase_exit:
+    break;
+  }
+}
+
+static void *zsv_parallel_worker_main(void *ctx) {
+  struct zsv_parallel_worker *w = ctx;
+  struct zsv_parallel *p = w->p;
+  while(1) {
+    zsv_parallel_barrier_wait(&p->barrier);
+    if(p->phase == zsv_parallel_phase_exit)
+      return NULL;
+    zsv_parallel_work(w);
+    zsv_parallel_barrier_wait(&p->barrier);
+  }
+}
+
+// run one phase on all workers; the calling thread acts as worker 0
+static void zsv_parallel_run_phase(struct zsv_parallel *p, enum zsv_parallel_phase phase) {
+  ZSV_STATS_TIMER_START(start);
+  p->phase = phase;
+  zsv_parallel_barrier_wait(&p->barrier);
+  zsv_parallel_work(&p->workers[0]);
+  zsv_parallel_barrier_wait(&p->barrier);
+#ifdef ZSV_STATS
+  if(phase == zsv_parallel_phase_read)
+    ZSV_STATS_TIMER_STOP(p->parser, read_ns, start);
+  else
+    ZSV_STATS_TIMER_STOP(p->parser, scan_ns, start);
+#endif
+}
+
+#ifdef ZSV_STATS
+/**
+ * Add a worker's cell counts to the caller's parser. Rows are counted when
+ * they are delivered, and times are those of each phase as a whole
+ */
+static void zsv_parallel_add_stats(struct zsv_scanner *parser, const struct zsv_scanner *scanner) {
+  parser->stats.cells += scanner->stats.cells;
+  parser->stats.quoted_cells += scanner->stats.quoted_cells;
+  parser->stats.embedded_quote_cells += scanner->stats.embedded_quote_cells;
+  parser->stats.dequote_bytes_moved += scanner->stats.dequote_bytes_moved;
+}
+#endif
+
+static void zsv_parallel_delete(struct zsv_parallel *p) {
+  if(p->workers) {
+    if(p->active > 1) {
+      p->phase = zsv_parallel_phase_exit;
+      zsv_parallel_barrier_wait(&p->barrier);
+      for(unsigned i = 1; i < p->active; i++)
+        pthread_join(p->workers[i].thread, NULL);
+    }
+    for(unsigned i = 0; i < p->nthreads; i++) {
+      struct zsv_parallel_worker *w = &p->workers[i];
+#ifdef ZSV_STATS
+      if(w->scanner)
+        zsv_parallel_add_stats(p->parser, w->scanner);
+#endif
+      zsv_delete(w->scanner);
+      free(w->out.rows);
+      free(w->out.cells);
+    }
+    free(p->workers);
+  }
+  pthread_mutex_destroy(&p->barrier.mutex);
+  pthread_cond_destroy(&p->barrier.cond);
+  free(p->splits);
+  free(p->split_known);
+  free(p->buff);
+}
+
+static enum zsv_status zsv_parallel_init(struct zsv_parallel *p, struct zsv_scanner *parser,
+                                         int fd, unsigned nthreads) {
+  p->parser = parser;
+  p->fd = fd;
+  p->delimiter = parser->opts.delimiter;
+  p->no_quotes = parser->opts.no_quotes > 0;
+  p->index = parser->index;
+  pthread_mutex_init(&p->barrier.mutex, NULL);
+  pthread_cond_init(&p->barrier.cond, NULL);
+
+  if(!(p->workers = calloc(nthreads, sizeof(*p->workers)))
+     || !(p->splits = calloc(nthreads + 1, sizeof(*p->splits)))
+     || !(p->split_known = calloc(nthreads + 1, sizeof(*p->split_known))))
+    return zsv_status_memory;
+  p->nthreads = nthreads;
+
+  struct zsv_opts wopts = parser->opts;
+  wopts.row = zsv_parallel_row;
+  wopts.cell = NULL;
+  wopts.overflow = NULL;
+  wopts.buff = NULL;
+  wopts.buffsize = 0;
+  wopts.max_row_size = ZSV_ROW_MAX_SIZE_MIN;
+  wopts.insert_header_row = NULL;
+  wopts.read = NULL;
+  wopts.stream = NULL;
+  wopts.stats = 0;
+#ifdef ZSV_EXTRAS
+  memset(&wopts.progress, 0, sizeof(wopts.progress));
+  memset(&wopts.completed, 0, sizeof(wopts.completed));
+  wopts.max_rows = 0;
+#endif
+  for(unsigned i = 0; i < nthreads; i++) {
+    struct zsv_parallel_worker *w = &p->workers[i];
+    struct zsv_opts tmp = wopts;
+    tmp.ctx = w;
+    w->p = p;
+    if(!(w->scanner = zsv_new(&tmp)))
+      return zsv_status_memory;
+    w->scanner->checked_bom = 1;
+    w->scanner->utf8_check = parser->utf8_check;
+    w->scanner->utf8_replace = parser->utf8_replace;
+  }
+
+  // if we can't start all threads, carry on with those we have
+  p->active = 1;
+  for(unsigned i = 1; i < nthreads; i++, p->active++)
+    if(pthread_create(&p->workers[i].thread, NULL, zsv_parallel_worker_main, &p->workers[i]))
+      break;
+  p->barrier.count = p->active;
+  return zsv_status_ok;
+}
+
+/**
+ * Deliver a worker's rows to the caller's parser, in order
+ */
+static enum zsv_status zsv_parallel_deliver(struct zsv_parallel *p, struct zsv_parallel_worker *w) {
+  struct zsv_scanner *parser = p->parser;
+  parser->scan_buff = NULL; // rows are not in the parser's buffer (see zsv_get_row_raw())
+
+  // too-wide rows are summarized by the caller's zsv_finish()
+  struct zsv_scanner *scanner = w->scanner;
+  parser->row.overflow_rows += scanner->row.overflow_rows;
+  if(parser->row.overflow_max < scanner->row.overflow_max)
+    parser->row.overflow_max = scanner->row.overflow_max;
+  scanner->row.overflow_rows = scanner->row.overflow_max = 0;
+  for(size_t i = 0; i < w->out.count; i++) {
+    struct zsv_parallel_row *r = &w->out.rows[i];
+    struct zsv_cell *cells = w->out.cells + r->first_cell;
+    if(VERY_UNLIKELY(r->cell_count > parser->row.allocated) && zsv_row_reserve(parser, r->cell_count))
+      return zsv_status_memory;
+    memcpy(parser->row.cells, cells, r->cell_count * sizeof(*cells));
+    parser->row.used = r->cell_count;
+    if(parser->opts.cell)
+      for(size_t j = 0; j < r->cell_count; j++)
+        parser->opts.cell(parser->opts.ctx, cells[j].str, cells[j].len);
+    parser->have_cell = 1;
+    enum zsv_status stat = row_dl(parser);
+    if(VERY_UNLIKELY(stat))
+      return stat;
+  }
+  return zsv_status_ok;
+}
+
+/**
+ * Parse one round. On return, *consumed holds the number of bytes, from the
+ * start of the round, that were fully parsed; 0 means the round held no
+ * complete chunk and should be retried with a larger segment size
+ */
+static enum zsv_status zsv_parallel_round(struct zsv_parallel *p, size_t segment_size,
+                                          size_t *consumed, char *eof) {
+  unsigned n = p->active;
+  *consumed = 0;
+
+  // read
+  for(unsigned i = 0; i < n; i++) {
+    struct zsv_parallel_worker *w = &p->workers[i];
+    w->read_offset = i * segment_size;
+    w->read_len = segment_size;
+  }
+  zsv_parallel_run_phase(p, zsv_parallel_phase_read);
+  p->data_len = 0;
+  *eof = 0;
+  for(unsigned i = 0; i < n; i++) {
+    p->data_len += p->workers[i].bytes_read;
+    if(p->workers[i].bytes_read < segment_size) {
+      *eof = 1;
+      break;
+    }
+  }
+
+  size_t start = 0;
+  if(!p->parser->checked_bom) {
+    size_t bom_len = strlen(ZSV_BOM);
+    p->parser->checked_bom = 1;
+    if(p->data_len >= bom_len && !memcmp(p->buff, ZSV_BOM, bom_len)) {
+      p->parser->had_bom = 1;
+      start = bom_len;
+    }
+    if(p->parser->opts.sniff) {
+      // apply the sniffed dialect to the workers too, none of which has scanned anything yet
+      zsv_scanner_sniff(p->parser, p->buff + start, p->data_len - start);
+      p->delimiter = p->parser->opts.delimiter;
+      p->no_quotes = p->parser->opts.no_quotes > 0;
+      for(unsigned i = 0; i < p->nthreads; i++) {
+        struct zsv_scanner *ws = p->workers[i].scanner;
+        ws->opts.delimiter = p->delimiter;
+        ws->opts.no_quotes = p->parser->opts.no_quotes;
+        zsv_scanner_select_scan(ws, &ws->opts);
+      }
+    }
+  }
+
+  // find candidate row boundaries: one per segment, plus the last row end in the round
+  p->split_count = 0;
+  p->split_known[p->split_count] = 1;
+  p->splits[p->split_count++] = start;
+  for(unsigned i = 1; i < n; i++) {
+    size_t seg_start = i * segment_size;
+    if(seg_start >= p->data_len)
+      break;
+    size_t seg_end = seg_start + segment_size;
+    if(seg_end > p->data_len)
+      seg_end = p->data_len;
+    size_t split = 0;
+    char known = 0;
+    if(p->index) {
+      uint64_t next = zsv_index_next_offset(p->index, p->offset + seg_start);
+      if(next < p->offset + seg_end) {
+        split = next - p->offset;
+        known = 1;
+      }
+    }
+    if(!known)
+      split = zsv_parallel_find_split(p->buff, seg_start, seg_end, p->data_len);
+    if(split > p->splits[p->split_count-1] && split < p->data_len) {
+      p->split_known[p->split_count] = known;
+      p->splits[p->split_count++] = split;
+    }
+  }
+  if(!*eof) {
+    size_t prior = p->splits[p->split_count-1];
+    size_t split = 0;
+    char known = 0;
+    if(p->index) {
+      uint64_t last = zsv_index_prior_offset(p->index, p->offset + p->data_len);
+      if(last > p->offset + prior) {
+        split = last - p->offset;
+        known = 1;
+      }
+    }
+    if(!known) {
+      size_t last = p->data_len;
+      while(last > prior && p->buff[last-1] != '\n' && p->buff[last-1] != '\r')
+        last--;
+      if(last > prior)
+        split = zsv_parallel_find_split(p->buff, last - 1, p->data_len, p->data_len);
+    }
+    if(split > prior) {
+      p->split_known[p->split_count] = known;
+      p->splits[p->split_count++] = split;
+    }
+  }
+
+  // speculate: worker i computes the end state of range [splits[i], splits[i+1]),
+  // unless the range ends at a known row boundary
+  char speculate = 0;
+  for(unsigned i = 0; i < n; i++) {
+    struct zsv_parallel_worker *w = &p->workers[i];
+    w->range_start = w->range_end = 0;
+    if(i + 1 < p->split_count && !p->split_known[i+1]) {
+      w->range_start = p->splits[i];
+      w->range_end = p->splits[i+1];
+      speculate = 1;
+    }
+    w->end_state[0] = ZSV_PARALLEL_CELL_START;
+    w->end_state[1] = ZSV_PARALLEL_QUOTED;
+  }
+  if(!p->no_quotes && speculate)
+    zsv_parallel_run_phase(p, zsv_parallel_phase_speculate);
+
+  // resolve: keep only the splits that are not inside a quoted cell
+  unsigned chunk_count = 0;
+  unsigned char state = ZSV_PARALLEL_CELL_START;
+  size_t chunk_start = p->splits[0];
+  for(unsigned i = 0; i + 1 < p->split_count; i++) {
+    if(p->split_known[i+1])
+      state = ZSV_PARALLEL_CELL_START;
+    else
+      state = p->workers[i].end_state[state == ZSV_PARALLEL_QUOTED];
+    if(state != ZSV_PARALLEL_QUOTED) {
+      struct zsv_parallel_worker *w = &p->workers[chunk_count++];
+      w->chunk_start = chunk_start;
+      w->chunk_end = chunk_start = p->splits[i+1];
+      w->final_chunk = 0;
+      state = ZSV_PARALLEL_CELL_START;
+    }
+  }
+  if(*eof) {
+    if(chunk_count == n)
+      *eof = 0; // no worker left for the tail, which will be re-read next round
+    else {
+      struct zsv_parallel_worker *w = &p->workers[chunk_count++];
+      w->chunk_start = chunk_start;
+      w->chunk_end = chunk_start = p->data_len;
+      w->final_chunk = 1;
+    }
+  }
+  if(chunk_count == 0)
+    return zsv_status_ok;
+  for(unsigned i = chunk_count; i < n; i++) {
+    struct zsv_parallel_worker *w = &p->workers[i];
+    w->chunk_start = w->chunk_end = 0;
+    w->final_chunk = 0;
+  }
+
+  // scan, then deliver in order
+  zsv_parallel_run_phase(p, zsv_parallel_phase_scan);
+  for(unsigned i = 0; i < chunk_count; i++) {
+    struct zsv_parallel_worker *w = &p->workers[i];
+    if(w->stat == zsv_status_memory)
+      return w->stat;
+    enum zsv_status stat = zsv_parallel_deliver(p, w);
+    if(stat)
+      return stat;
+  }
+  *consumed = chunk_start;
+  return zsv_status_ok;
+}
+
+/**
+ * Parse the remainder of a regular file in parallel. Sets *serial if the caller
+ * should instead (or from where this left off) continue with zsv_parse_more()
+ */
+static enum zsv_status zsv_parallel_parse_file(struct zsv_scanner *parser, FILE *f,
+                                               unsigned nthreads, char *serial) {
+  struct zsv_parallel p = { 0 };
+  struct stat st;
+  int fd = fileno(f);
+  off_t start = ftello(f);
+  *serial = 1;
+  if(fd < 0 || start < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode))
+    return zsv_status_ok;
+
+  enum zsv_status stat = zsv_parallel_init(&p, parser, fd, nthreads);
+  if(stat || p.active < 2) {
+    zsv_parallel_delete(&p);
+    return stat;
+  }
+  nthreads = p.active;
+  *serial = 0;
+
+  size_t segment_size = parser->opts.buffsize * ZSV_PARALLEL_SEGMENT_BUFFS;
+  size_t remaining = st.st_size > start ? (size_t)(st.st_size - start) : 0;
+  while(segment_size > ZSV_MIN_SCANNER_BUFFSIZE && segment_size / 2 * nthreads >= remaining)
+    segment_size /= 2; // no need for rounds much bigger than the file
+
+#ifdef ZSV_EXTRAS
+  if(parser->opts.progress.seconds_interval)
+    parser->progress.last_time = time(NULL);
+#endif
+
+  p.offset = (size_t)start;
+  unsigned growth = 0;
+  char eof = 0;
+  while(!eof) {
+    size_t want = segment_size * nthreads;
+    if(want > p.buff_size) {
+      free(p.buff);
+      p.buff_size = 0;
+      if(!(p.buff = malloc(want))) {
+        stat = zsv_status_memory;
+        break;
+      }
+      p.buff_size = want;
+    }
+    size_t consumed;
+    if((stat = zsv_parallel_round(&p, segment_size, &consumed, &eof)))
+      break;
+    p.offset += consumed;
+    parser->cum_scanned_length = p.offset - (size_t)start - (parser->had_bom ? strlen(ZSV_BOM) : 0);
+    if(consumed)
+      growth = 0;
+    else if(!eof) {
+      if(++growth > ZSV_PARALLEL_MAX_GROWTH) {
+        // rows (or quoted values) are too large to split up efficiently
+        *serial = 1;
+        break;
+      }
+      segment_size *= 2;
+    }
+  }
+  zsv_parallel_delete(&p);
+
+  parser->scanned_length = 0;
+  if(fseeko(f, *serial ? (off_t)p.offset : 0, *serial ? SEEK_SET : SEEK_END) && *serial)
+    return zsv_status_invalid_option;
+  if(!stat && !*serial)
+    stat = zsv_status_no_more_input;
+  return stat;
+}
+#endif
+
+ZSV_EXPORT
+enum zsv_status zsv_parse_parallel(zsv_parser parser, unsigned nthreads) {
+  enum zsv_status stat;
+#ifdef ZSV_HAVE_PARALLEL
+  if(!nthreads) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = ncpu > 0 ? (unsigned)ncpu : 1;
+  }
+  if(nthreads > 1
+     && parser->mode == ZSV_MODE_DELIM
+     && parser->read == (zsv_generic_read)fread && parser->in
+     && !parser->filter
+     && (!parser->checked_bom || parser->seeked) && !parser->cum_scanned_length && !parser->old_bytes_read) {
+    char serial;
+    if(parser->insert_string) {
+      zsv_scan_insert_string(parser);
+      parser->old_bytes_read = parser->row_start = parser->cell_start = 0;
+      parser->scanned_length = 0;
+    }
+    stat = zsv_parallel_parse_file(parser, parser->in, nthreads, &serial);
+    if(stat || !serial)
+      return stat;
+  }
+#else
+  (void)(nthreads);
+#endif
+  while((stat = zsv_parse_more(parser)) == zsv_status_ok)
+    ;
+  return stat;
+}
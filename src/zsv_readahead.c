@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+/*
+ * Read-ahead input (see zsv_opts.readahead_depth)
+ *
+ * A producer thread calls the caller's read function to fill a ring of
+ * readahead_depth blocks, while the scanner works on data it already has.
+ * The scanner's read function is replaced with zsv_readahead_read(), which
+ * copies from the filled blocks into the scanner's own buffer. The scanner
+ * buffer is managed exactly as without read-ahead, so parsed rows remain valid
+ * until the next call to zsv_parse_more()
+ *
+ * The producer thread is started on the first read, so that zsv_set_input()
+ * may still be called after zsv_new()
+ */
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__) && !defined(ZSV_NO_THREADS)
+# define ZSV_HAVE_READAHEAD
+#endif
+
+#ifdef ZSV_HAVE_READAHEAD
+#include <pthread.h>
+
+struct zsv_readahead {
+  zsv_generic_read read; // the caller's read function and stream
+  void *in;
+
+  unsigned char *blocks; // depth blocks of block_size bytes
+  size_t *lengths;       // number of bytes read into each block
+  unsigned depth;
+  size_t block_size;
+
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t filled;  // signaled by the producer when a block is ready
+  pthread_cond_t emptied; // signaled by the consumer when a block is free
+
+  unsigned head;   // next block to consume
+  unsigned tail;   // next block to fill
+  unsigned count;  // number of filled blocks
+  size_t head_pos; // bytes of the head block already consumed
+
+  char started; // only accessed by the consumer, so kept apart from the below
+  char eof;     // set by the producer; protected by mutex
+  char stop;    // set by the consumer; protected by mutex
+};
+
+static void *zsv_readahead_main(void *arg) {
+  struct zsv_readahead *ra = arg;
+  pthread_mutex_lock(&ra->mutex);
+  while(1) {
+    while(ra->count == ra->depth && !ra->stop)
+      pthread_cond_wait(&ra->emptied, &ra->mutex);
+    if(ra->stop)
+      break;
+    unsigned tail = ra->tail;
+    pthread_mutex_unlock(&ra->mutex);
+
+    // the consumer does not touch the tail block until we mark it filled
+    size_t n = ra->read(ra->blocks + (size_t)tail * ra->block_size, 1, ra->block_size, ra->in);
+
+    pthread_mutex_lock(&ra->mutex);
+    if(n == 0) {
+      ra->eof = 1;
+      pthread_cond_signal(&ra->filled);
+      break;
+    }
+    ra->lengths[tail] = n;
+    ra->tail = (tail + 1) % ra->depth;
+    ra->count++;
+    pthread_cond_signal(&ra->filled);
+  }
+  pthread_mutex_unlock(&ra->mutex);
+  return NULL;
+}
+
+// zsv_generic_read that copies from the filled blocks
+static size_t zsv_readahead_read(void *buff, size_t size, size_t count, void *in) {
+  struct zsv_readahead *ra = in;
+  size_t wanted = size * count;
+  if(VERY_UNLIKELY(!ra->started)) {
+    ra->started = 1;
+    if(pthread_create(&ra->thread, NULL, zsv_readahead_main, ra)) {
+      fprintf(stderr, "Warning: unable to start read-ahead thread\n");
+      ra->eof = 1;
+      ra->started = 0;
+    }
+  }
+  if(VERY_UNLIKELY(!ra->started)) // could not start the producer; read directly
+    return ra->read(buff, size, count, ra->in);
+
+  size_t got = 0;
+  pthread_mutex_lock(&ra->mutex);
+  while(got < wanted) {
+    if(!ra->count) {
+      // return what we have rather than wait for more
+      if(got || ra->eof)
+        break;
+      pthread_cond_wait(&ra->filled, &ra->mutex);
+      continue;
+    }
+    unsigned head = ra->head;
+    size_t available = ra->lengths[head] - ra->head_pos;
+    size_t len = wanted - got < available ? wanted - got : available;
+    pthread_mutex_unlock(&ra->mutex);
+
+    memcpy((unsigned char *)buff + got, ra->blocks + (size_t)head * ra->block_size + ra->head_pos, len);
+    got += len;
+
+    pthread_mutex_lock(&ra->mutex);
+    ra->head_pos += len;
+    if(ra->head_pos == ra->lengths[head]) {
+      ra->head = (head + 1) % ra->depth;
+      ra->head_pos = 0;
+      ra->count--;
+      pthread_cond_signal(&ra->emptied);
+    }
+  }
+  pthread_mutex_unlock(&ra->mutex);
+  return got / size;
+}
+
+static void zsv_readahead_delete(struct zsv_scanner *scanner) {
+  struct zsv_readahead *ra = scanner->readahead;
+  if(!ra)
+    return;
+  if(ra->started) {
+    // if the producer is blocked in read(), this waits until that call returns
+    pthread_mutex_lock(&ra->mutex);
+    ra->stop = 1;
+    pthread_cond_signal(&ra->emptied);
+    pthread_mutex_unlock(&ra->mutex);
+    pthread_join(ra->thread, NULL);
+  }
+  pthread_mutex_destroy(&ra->mutex);
+  pthread_cond_destroy(&ra->filled);
+  pthread_cond_destroy(&ra->emptied);
+  free(ra->blocks);
+  free(ra->lengths);
+  free(ra);
+  scanner->readahead = NULL;
+}
+
+static enum zsv_status zsv_readahead_new(struct zsv_scanner *scanner) {
+  struct zsv_readahead *ra = calloc(1, sizeof(*ra));
+  if(!ra) {
+    fprintf(stderr, "Out of memory!\n");
+    return zsv_status_memory;
+  }
+  ra->depth = scanner->opts.readahead_depth;
+  ra->block_size = scanner->opts.readahead_block_size ? scanner->opts.readahead_block_size : scanner->buff.size;
+  ra->blocks = malloc((size_t)ra->depth * ra->block_size);
+  ra->lengths = calloc(ra->depth, sizeof(*ra->lengths));
+  if(!ra->blocks || !ra->lengths) {
+    fprintf(stderr, "Out of memory!\n");
+    free(ra->blocks);
+    free(ra->lengths);
+    free(ra);
+    return zsv_status_memory;
+  }
+  pthread_mutex_init(&ra->mutex, NULL);
+  pthread_cond_init(&ra->filled, NULL);
+  pthread_cond_init(&ra->emptied, NULL);
+
+  ra->read = scanner->read;
+  ra->in = scanner->in;
+  scanner->read = zsv_readahead_read;
+  scanner->in = ra;
+  scanner->readahead = ra;
+  return zsv_status_ok;
+}
+
+#else
+
+static void zsv_readahead_delete(struct zsv_scanner *scanner) {
+  (void)(scanner);
+}
+
+static enum zsv_status zsv_readahead_new(struct zsv_scanner *scanner) {
+  (void)(scanner); // read-ahead is not supported; read synchronously
+  return zsv_status_ok;
+}
+
+#endif
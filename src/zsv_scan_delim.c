@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2021 Tai Chi Minh Ralph Eastwood (self), Matt Wong (Guarnerix Inc dba Liquidaty)
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+/*
+ * Delimited-mode scanner. This file is included once for each vector kernel
+ * (see zsv_internal.c), with the following defined:
+ *   ZSV_SCAN_KERNEL: kernel name suffix e.g. avx2
+ *   ZSV_SCAN_TARGET: function attributes for the kernel's instruction set
+ *   ZSV_SCAN_FN(name): name##_##ZSV_SCAN_KERNEL
+ *   ZSV_SCAN_VEC_BYTES: block size of the kernel's vec_delims()
+ *
+ * For each kernel, the scanner is further specialized by the ZSV_SCAN_XXX
+ * flags, which are compile-time constants in each instance below, so that
+ * invariant checks of the delimiter, quoting and hooks drop out of the loop
+ */
+
+ZSV_SCAN_TARGET
+__attribute__((always_inline)) static inline enum zsv_status ZSV_SCAN_FN(zsv_scan_delim_spec)(struct zsv_scanner *scanner,
+                                                                                            unsigned char *buff,
+                                                                                            size_t bytes_read,
+                                                                                            const int flags
+                                                                                            ) {
+  bytes_read += scanner->partial_row_length;
+  size_t i = scanner->partial_row_length;
+  unsigned char c;
+  char skip_next_delim = 0;
+  size_t bytes_chunk_end = bytes_read >= ZSV_SCAN_VEC_BYTES ? bytes_read - ZSV_SCAN_VEC_BYTES + 1 : 0;
+  const char delimiter = (flags & ZSV_SCAN_COMMA) ? ',' : (flags & ZSV_SCAN_TAB_RAW) ? '\t' : scanner->opts.delimiter;
+
+  scanner->partial_row_length = 0;
+
+  int quote = '"';
+  unsigned char qt_c = '"';
+  if((flags & ZSV_SCAN_TAB_RAW) || (!(flags & ZSV_SCAN_COMMA) && scanner->opts.no_quotes > 0)) {
+    quote = -1;
+    qt_c = 0;
+  }
+
+  if(!(flags & ZSV_SCAN_TAB_RAW) && scanner->quote_pending)
+    i = zsv_scan_quote_pending(scanner, buff, i);
+
+// without quote handling, we are never inside a quoted cell
+#define scanner_unquoted ((flags & ZSV_SCAN_TAB_RAW) || (scanner->quoted & ZSV_PARSER_QUOTE_UNCLOSED) == 0)
+
+#define scanner_last (i ? buff[i-1] : scanner->last)
+  size_t mask_total_offset = 0;
+  uint64_t mask = 0;
+  size_t mask_last_start = 0;
+
+  scanner->buffer_end = bytes_read;
+  for(; i < bytes_read; i++) {
+    if(mask == 0) {
+      mask_last_start = i;
+      if(i < bytes_chunk_end) {
+        // keep going until we get a delim or we are at the eof
+        mask_total_offset = ZSV_SCAN_FN(vec_delims)(buff + i, bytes_read - i,
+                                                    delimiter, '\n', '\r', qt_c, &mask);
+        if(mask_total_offset) {
+          i += mask_total_offset;
+          mask_last_start = i;
+          if(!mask) {
+            if(i == bytes_read)
+              break; // vector processing ended on exactly our buffer end
+          }
+        }
+      } else if(skip_next_delim) {
+        skip_next_delim = 0;
+        continue;
+      }
+    }
+    if(VERY_LIKELY(mask)) {
+      size_t next_offset = __builtin_ffsll(mask);
+      i = mask_last_start + next_offset - 1;
+      mask = clear_lowest_bit(mask);
+      if(skip_next_delim) {
+        skip_next_delim = 0;
+        continue;
+      }
+    }
+
+    // to do: consolidate csv and tsv/scanner->delimiter parsers
+    c = buff[i];
+    if(LIKELY(c == delimiter)) { // case ',':
+      if(scanner_unquoted) {
+        scanner->scanned_length = i;
+        cell_dl_spec(scanner, buff + scanner->cell_start, i - scanner->cell_start, 1, flags);
+        scanner->cell_start = i + 1;
+        c = 0;
+        continue; // this char is not part of the cell content
+      } else
+        // we are inside an open quote, which is needed to escape this char
+        scanner->quoted |= ZSV_PARSER_QUOTE_NEEDED;
+    } else if(UNLIKELY(c == '\r')) {
+      if(scanner_unquoted) {
+        scanner->scanned_length = i;
+        enum zsv_status stat = cell_and_row_dl_spec(scanner, buff + scanner->cell_start, i - scanner->cell_start,
+                                                     flags);
+        if(VERY_UNLIKELY(stat))
+          return stat;
+
+        scanner->cell_start = i + 1;
+        scanner->row_start = i + 1;
+        continue; // this char is not part of the cell content
+      } else
+        // we are inside an open quote, which is needed to escape this char
+        scanner->quoted |= ZSV_PARSER_QUOTE_NEEDED;
+    } else if(UNLIKELY(c == '\n')) {
+      if(scanner_unquoted) {
+        if(scanner_last == '\r') { // ignore; we are outside a cell and last char was rowend
+          scanner->cell_start = i + 1;
+          scanner->row_start = i + 1;
+        } else {
+          // this is a row end
+          scanner->scanned_length = i;
+          enum zsv_status stat = cell_and_row_dl_spec(scanner, buff + scanner->cell_start, i - scanner->cell_start,
+                                                     flags);
+          if(VERY_UNLIKELY(stat))
+            return stat;
+          scanner->cell_start = i + 1;
+          scanner->row_start = i + 1;
+        }
+        continue; // this char is not part of the cell content
+      } else
+        // we are inside an open quote, which is needed to escape this char
+        scanner->quoted |= ZSV_PARSER_QUOTE_NEEDED;
+    } else if(LIKELY(c == quote)) {
+      if(i == scanner->cell_start) {
+        scanner->quoted = ZSV_PARSER_QUOTE_UNCLOSED;
+        scanner->quote_close_position = 0;
+        c = 0;
+      } else if(scanner->quoted & ZSV_PARSER_QUOTE_UNCLOSED) {
+        // the cell started with a quote that is not yet closed
+        if(VERY_LIKELY(i + 1 < bytes_read)) {
+          if(LIKELY(buff[i+1] != quote)) {
+            // buff[i] is the closing quote (not an escaped quote)
+            scanner->quoted |= ZSV_PARSER_QUOTE_CLOSED;
+            scanner->quoted -= ZSV_PARSER_QUOTE_UNCLOSED;
+
+            // keep track of closing quote position to handle the edge case
+            // where content follows the closing quote e.g. cell content is:
+            //  "this-cell"-did-not-need-quotes
+            if(LIKELY(scanner->quote_close_position == 0))
+              scanner->quote_close_position = i - scanner->cell_start;
+          } else {
+            // next char is also '"'
+            // e.g. cell content is: "this "" is a dbl quote"
+            //           cursor is here => ^
+            // include in cell content and don't further process
+            scanner->quoted |= ZSV_PARSER_QUOTE_NEEDED;
+            scanner->quoted |= ZSV_PARSER_QUOTE_EMBEDDED;
+            skip_next_delim = 1;
+          }
+        } else // we can't tell until we have the next char
+          scanner->quote_pending = 1;
+      } else {
+        // cell_length > 0 and cell did not start w quote, so
+        // we have a quote in middle of an unquoted cell
+        // process as a normal char
+        scanner->quoted |= ZSV_PARSER_QUOTE_EMBEDDED;
+        scanner->quote_close_position = 0;
+      }
+    }
+  }
+#undef scanner_last
+#undef scanner_unquoted
+  scanner->scanned_length = i;
+
+  // save bytes_read-- we will need to shift any remaining partial row
+  // before we read next from our input. however, we intentionally refrain
+  // from doing this until the next parse_more() call, so that the entirety
+  // of all rows parsed thus far are still available until that next call
+  scanner->old_bytes_read = bytes_read;
+  return zsv_status_ok;
+}
+
+#define ZSV_SCAN_DELIM_INSTANCE(name, flags)                            \
+  ZSV_SCAN_TARGET                                                       \
+  static enum zsv_status ZSV_SCAN_FN(name)(struct zsv_scanner *scanner, \
+                                           unsigned char *buff,         \
+                                           size_t bytes_read) {         \
+    return ZSV_SCAN_FN(zsv_scan_delim_spec)(scanner, buff, bytes_read, flags); \
+  }
+
+ZSV_SCAN_DELIM_INSTANCE(zsv_scan_delim, 0)
+ZSV_SCAN_DELIM_INSTANCE(zsv_scan_delim_lean, ZSV_SCAN_NO_HOOKS)
+ZSV_SCAN_DELIM_INSTANCE(zsv_scan_delim_csv, ZSV_SCAN_COMMA)
+ZSV_SCAN_DELIM_INSTANCE(zsv_scan_delim_csv_lean, ZSV_SCAN_COMMA | ZSV_SCAN_NO_HOOKS)
+ZSV_SCAN_DELIM_INSTANCE(zsv_scan_delim_tab, ZSV_SCAN_TAB_RAW)
+ZSV_SCAN_DELIM_INSTANCE(zsv_scan_delim_tab_lean, ZSV_SCAN_TAB_RAW | ZSV_SCAN_NO_HOOKS)
+
+#undef ZSV_SCAN_DELIM_INSTANCE
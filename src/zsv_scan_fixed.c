@@ -1,44 +1,30 @@
-static inline char row_fx(struct zsv_scanner *scanner,
-                          unsigned char *buff,
-                          size_t row_start,
-                          size_t row_end) {
-  size_t cell_start = row_start;
-  size_t row_length = row_end - row_start;
-  for(unsigned i = 0; i < scanner->fixed.count; i++) {
-    size_t cell_end = row_start + (scanner->fixed.offsets[i] > row_length ? row_length : scanner->fixed.offsets[i]);
-    size_t cell_length = cell_end - cell_start;
-    unsigned char *s = buff + cell_start;
-    if(scanner->opts.cell)
-      scanner->opts.cell(scanner->opts.ctx, s, cell_length);
-    struct zsv_cell c = { s, cell_length, 1 };
-    scanner->row.cells[scanner->row.used++] = c;
+/*
+ * Copyright (C) 2021 Tai Chi Minh Ralph Eastwood (self), Matt Wong (Guarnerix Inc dba Liquidaty)
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
 
-    cell_start = cell_end;
-  }
-  if(scanner->opts.row)
-    scanner->opts.row(scanner->opts.ctx);
-  scanner->row.used = 0;
-  return scanner->abort;
-}
+/*
+ * Fixed-width-mode scanner. Like zsv_scan_delim.c, this file is included once
+ * for each vector kernel (see zsv_internal.c)
+ */
 
-static enum zsv_status zsv_scan_fixed(struct zsv_scanner *scanner,
-                                      unsigned char *buff,
-                                      size_t bytes_read
-                                      ) {
+ZSV_SCAN_TARGET
+static enum zsv_status ZSV_SCAN_FN(zsv_scan_fixed)(struct zsv_scanner *scanner,
+                                                   unsigned char *buff,
+                                                   size_t bytes_read
+                                                   ) {
   bytes_read += scanner->partial_row_length;
   unsigned char c;
-  size_t bytes_chunk_end = bytes_read >= sizeof(zsv_uc_vector) ? bytes_read - sizeof(zsv_uc_vector) + 1 : 0;
+  size_t bytes_chunk_end = bytes_read >= ZSV_SCAN_VEC_BYTES ? bytes_read - ZSV_SCAN_VEC_BYTES + 1 : 0;
 
   scanner->partial_row_length = 0;
 
-  // dl_v and qt_v are unused, we just leave them to reuse vec_delims()
-  zsv_uc_vector dl_v; memset(&dl_v, 0, sizeof(zsv_uc_vector));
-  zsv_uc_vector nl_v; memset(&nl_v, '\n', sizeof(zsv_uc_vector));
-  zsv_uc_vector cr_v; memset(&cr_v, '\r', sizeof(zsv_uc_vector));
-  zsv_uc_vector qt_v; memset(&qt_v, 0, sizeof(zsv_uc_vector));
   size_t mask_total_offset = 0;
-  unsigned int mask = 0;
-  int mask_last_start;
+  uint64_t mask = 0;
+  size_t mask_last_start;
 
   scanner->buffer_end = bytes_read;
   for(size_t i = scanner->partial_row_length; ; i++) {
@@ -46,26 +32,29 @@ static enum zsv_status zsv_scan_fixed(struct zsv_scanner *scanner,
       mask_last_start = i;
       if(LIKELY(i < bytes_chunk_end)) {
         // keep going until we get a delim or we are at the eof
-        mask_total_offset = vec_delims(buff + i, bytes_read - i, &dl_v, &nl_v, &cr_v, &qt_v,
-                                       &mask);
-        if(mask_total_offset)
+        // the delimiter and quote tokens are unused, so just search for the row-end chars twice
+        mask_total_offset = ZSV_SCAN_FN(vec_delims)(buff + i, bytes_read - i,
+                                                    '\n', '\r', '\n', '\r', &mask);
+        if(mask_total_offset) {
           i += mask_total_offset;
+          mask_last_start = i;
+        }
       } else { // we only have a few bytes left, so manually parse
         for(unsigned i2 = i; i2 < bytes_read; i2++)
           if(strchr("\n\r", buff[i2]))
-            mask += 1 << (i2 - i);
+            mask += 1ULL << (i2 - i);
       }
       if(UNLIKELY(mask == 0))
         break;
     }
 
-    size_t next_offset = __builtin_ffs(mask);
+    size_t next_offset = __builtin_ffsll(mask);
     i = mask_last_start + next_offset - 1;
     mask = clear_lowest_bit(mask);
 
     c = buff[i];
     if(LIKELY(c == '\n')) {
-      if(scanner_last == '\r') { // ignore; we are outside a cell and last char was rowend
+      if((i ? buff[i-1] : scanner->last) == '\r') { // ignore; we are outside a cell and last char was rowend
         scanner->row_start = i + 1;
       } else {
         // this is a row end
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2021 Tai Chi Minh Ralph Eastwood (self), Matt Wong (Guarnerix Inc dba Liquidaty)
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+/*
+ * Two-stage (structural index) delimited-mode scanner, used if
+ * zsv_opts.structural_index is set. Like zsv_scan_delim.c, this file is
+ * included once for each vector kernel
+ *
+ * Stage 1 classifies each 64-byte block into bitfields of quote, delimiter
+ * and row-end positions, and uses a prefix xor of the quote bits to remove
+ * the delimiters and row ends that are inside quotes. Stage 2 then walks the
+ * remaining bits to emit cells and rows, without any per-char state machine
+ *
+ * This is only equivalent to zsv_scan_delim() for "regular" quoting, where every
+ * quote either starts a cell or closes / escapes a quoted value. If a quote
+ * does not (e.g. a"b), the rest of the buffer is handed to zsv_scan_delim()
+ */
+
+ZSV_SCAN_TARGET
+static enum zsv_status ZSV_SCAN_FN(zsv_scan_index)(struct zsv_scanner *scanner,
+                                                   unsigned char *buff,
+                                                   size_t bytes_read
+                                                   ) {
+  bytes_read += scanner->partial_row_length;
+  size_t i = scanner->partial_row_length;
+  const unsigned char delimiter = scanner->opts.delimiter;
+  const char no_quotes = scanner->opts.no_quotes > 0;
+
+  scanner->partial_row_length = 0;
+  if(scanner->quote_pending)
+    i = zsv_scan_quote_pending(scanner, buff, i);
+
+  // state carried from one block to the next: all 1s if inside quotes, else 0;
+  // and whether the previous char ended a cell, or was a closing quote
+  uint64_t in_quote = (scanner->quoted & ZSV_PARSER_QUOTE_UNCLOSED) ? ~0ULL : 0;
+  uint64_t prev_end = i == scanner->cell_start;
+  uint64_t prev_close = (scanner->quoted & (ZSV_PARSER_QUOTE_CLOSED | ZSV_PARSER_QUOTE_UNCLOSED)) == ZSV_PARSER_QUOTE_CLOSED
+    && scanner->cell_start + scanner->quote_close_position + 1 == i;
+
+  scanner->buffer_end = bytes_read;
+  for(size_t base = i; base < bytes_read; base += 64) {
+    // stage 1
+    const unsigned char *block = buff + base;
+    unsigned char tail[64];
+    if(bytes_read - base < 64) {
+      memcpy(tail, block, bytes_read - base);
+      memset(tail + (bytes_read - base), 0, 64 - (bytes_read - base));
+      block = tail;
+    }
+    uint64_t quotes, delims, ends;
+    ZSV_SCAN_FN(vec_classify)(block, delimiter, &quotes, &delims, &ends);
+    if(no_quotes)
+      quotes = 0;
+
+    uint64_t inside = ZSV_SCAN_FN(vec_prefix_xor)(quotes) ^ in_quote;
+    in_quote = (uint64_t)((int64_t)inside >> 63);
+
+    uint64_t opens = quotes & inside;
+    uint64_t closes = quotes & ~inside;
+    uint64_t structurals = (delims | ends) & ~inside;
+    uint64_t after_end = (structurals << 1) | prev_end;
+    uint64_t after_close = (closes << 1) | prev_close;
+    prev_end = structurals >> 63;
+    prev_close = closes >> 63;
+
+    uint64_t escaped = opens & after_close; // the 2nd quote of ""
+    uint64_t needed = ((delims | ends) & inside) | escaped;
+    uint64_t irregular = opens & ~(after_end | after_close);
+    if(VERY_UNLIKELY(irregular)) {
+      uint64_t before = (irregular & -irregular) - 1;
+      structurals &= before;
+      quotes &= before;
+      closes &= before;
+      escaped &= before;
+      needed &= before;
+    }
+
+    // stage 2
+    uint64_t done = 0; // bits of cells that we have already emitted
+    while(structurals) {
+      unsigned pos = __builtin_ctzll(structurals);
+      uint64_t cell_bits = ((1ULL << pos) - 1) & ~done;
+      if(UNLIKELY((quotes | needed) & cell_bits))
+        zsv_scan_index_quotes(scanner, base, closes & cell_bits, escaped & cell_bits, needed & cell_bits);
+      scanner->quoted &= ~ZSV_PARSER_QUOTE_UNCLOSED;
+
+      size_t p = base + pos;
+      if(LIKELY((delims >> pos) & 1)) {
+        scanner->scanned_length = p;
+        cell_dl(scanner, buff + scanner->cell_start, p - scanner->cell_start, 1);
+        scanner->cell_start = p + 1;
+      } else if(buff[p] == '\n' && (p ? buff[p-1] : scanner->last) == '\r') {
+        // ignore; last char was rowend
+        scanner->cell_start = p + 1;
+        scanner->row_start = p + 1;
+      } else {
+        scanner->scanned_length = p;
+        enum zsv_status stat = cell_and_row_dl(scanner, buff + scanner->cell_start, p - scanner->cell_start);
+        if(VERY_UNLIKELY(stat))
+          return stat;
+        scanner->cell_start = p + 1;
+        scanner->row_start = p + 1;
+      }
+      done = (2ULL << pos) - 1;
+      structurals &= structurals - 1;
+    }
+    if(UNLIKELY((quotes | needed) & ~done))
+      zsv_scan_index_quotes(scanner, base, closes & ~done, escaped & ~done, needed & ~done);
+
+    if(VERY_UNLIKELY(irregular)) {
+      // let the classic scanner decide how to handle this quote and the rest of the buffer
+      size_t p = base + __builtin_ctzll(irregular);
+      scanner->quoted &= ~ZSV_PARSER_QUOTE_UNCLOSED;
+      scanner->partial_row_length = p;
+      return ZSV_SCAN_FN(zsv_scan_delim)(scanner, buff, bytes_read - p);
+    }
+  }
+
+  if(in_quote) {
+    // same state as zsv_scan_delim() leaves for a quoted cell that is still open
+    scanner->quoted = (scanner->quoted & ~ZSV_PARSER_QUOTE_CLOSED) | ZSV_PARSER_QUOTE_UNCLOSED;
+    scanner->quote_close_position = 0;
+  } else
+    scanner->quoted &= ~ZSV_PARSER_QUOTE_UNCLOSED;
+
+  scanner->scanned_length = bytes_read;
+  scanner->old_bytes_read = bytes_read;
+  return zsv_status_ok;
+}
@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+/*
+ * Dialect detection (see zsv_sniff() and opts.sniff)
+ *
+ * The sample is split into lines, and the candidate delimiters and double-quotes
+ * in each line are counted a block at a time, with a fixed-size loop that the
+ * compiler vectorizes (as in zsv_utf8.c). Each candidate is then scored twice:
+ * once treating each line as a row and every delimiter as a separator, and
+ * once joining lines that end inside quotes and skipping delimiters that are
+ * inside quotes. Only lines with quotes need the second, byte-by-byte count.
+ * The candidate and quote handling for which the most rows agree on the
+ * number of cells wins
+ */
+
+#define ZSV_SNIFF_MAX_LEN (64 * 1024)
+#define ZSV_SNIFF_MAX_ROWS 256
+#define ZSV_SNIFF_HEADER_ROWS 32
+#define ZSV_SNIFF_HEADER_COLUMNS 256
+#define ZSV_SNIFF_BLOCK_SIZE 64
+
+// in order of preference
+static const unsigned char zsv_sniff_delims[] = { ',', '\t', '|', ';' };
+#define ZSV_SNIFF_DELIM_COUNT sizeof(zsv_sniff_delims)
+#define ZSV_SNIFF_QUOTE ZSV_SNIFF_DELIM_COUNT // index of the double-quote count
+
+struct zsv_sniff_row {
+  const unsigned char *start;
+  size_t len; // excluding the row end
+  unsigned counts[ZSV_SNIFF_DELIM_COUNT + 1];
+};
+
+struct zsv_sniff {
+  struct zsv_sniff_row lines[ZSV_SNIFF_MAX_ROWS];
+  struct zsv_sniff_row rows[ZSV_SNIFF_MAX_ROWS]; // lines joined where a quoted value spans lines
+  size_t line_count;
+  size_t row_count;
+};
+
+/**
+ * Add the number of each candidate delimiter and of double-quotes in [s, s + len)
+ * to counts
+ */
+static void zsv_sniff_count(const unsigned char *s, size_t len, unsigned counts[ZSV_SNIFF_DELIM_COUNT + 1]) {
+  const unsigned char *end = s + len;
+  // the fixed-size loops are vectorized by the compiler
+  for(; end - s >= ZSV_SNIFF_BLOCK_SIZE; s += ZSV_SNIFF_BLOCK_SIZE) {
+    for(size_t k = 0; k < ZSV_SNIFF_DELIM_COUNT; k++) {
+      unsigned char n = 0;
+      for(int i = 0; i < ZSV_SNIFF_BLOCK_SIZE; i++)
+        n += s[i] == zsv_sniff_delims[k];
+      counts[k] += n;
+    }
+    unsigned char n = 0;
+    for(int i = 0; i < ZSV_SNIFF_BLOCK_SIZE; i++)
+      n += s[i] == '"';
+    counts[ZSV_SNIFF_QUOTE] += n;
+  }
+  for(; s < end; s++) {
+    for(size_t k = 0; k < ZSV_SNIFF_DELIM_COUNT; k++)
+      counts[k] += *s == zsv_sniff_delims[k];
+    counts[ZSV_SNIFF_QUOTE] += *s == '"';
+  }
+}
+
+/**
+ * Count each candidate delimiter in a row, skipping those inside quotes
+ */
+static void zsv_sniff_count_quoted(const unsigned char *s, size_t len, unsigned counts[ZSV_SNIFF_DELIM_COUNT + 1]) {
+  char in_quote = 0;
+  memset(counts, 0, ZSV_SNIFF_DELIM_COUNT * sizeof(*counts));
+  for(const unsigned char *end = s + len; s < end; s++) {
+    if(*s == '"')
+      in_quote = !in_quote;
+    else if(!in_quote)
+      for(size_t k = 0; k < ZSV_SNIFF_DELIM_COUNT; k++)
+        counts[k] += *s == zsv_sniff_delims[k];
+  }
+}
+
+/**
+ * Split the sample into lines, and lines into rows. Only lines that end with
+ * a newline are used, unless there are none
+ */
+static void zsv_sniff_split(struct zsv_sniff *sn, const unsigned char *s, size_t len) {
+  const unsigned char eol = memchr(s, '\n', len) ? '\n' : '\r';
+  const unsigned char *end = s + len;
+  struct zsv_sniff_row *row = NULL;
+  while(s < end && sn->line_count < ZSV_SNIFF_MAX_ROWS) {
+    const unsigned char *line_end = memchr(s, eol, end - s);
+    if(!line_end) {
+      if(sn->line_count)
+        break;
+      line_end = end;
+    }
+    struct zsv_sniff_row *line = &sn->lines[sn->line_count++];
+    line->start = s;
+    line->len = line_end - s;
+    if(eol == '\n' && line->len && s[line->len - 1] == '\r')
+      line->len--;
+    zsv_sniff_count(line->start, line->len, line->counts);
+
+    if(row) { // continue a row that ended inside quotes
+      row->len = line->start + line->len - row->start;
+      row->counts[ZSV_SNIFF_QUOTE] += line->counts[ZSV_SNIFF_QUOTE];
+    } else {
+      row = &sn->rows[sn->row_count];
+      *row = *line;
+    }
+    if(!(row->counts[ZSV_SNIFF_QUOTE] % 2) || line_end == end) {
+      if(row->counts[ZSV_SNIFF_QUOTE])
+        zsv_sniff_count_quoted(row->start, row->len, row->counts);
+      sn->row_count++;
+      row = NULL;
+    }
+    s = line_end + 1;
+  }
+  // a row that is still open has no end in the sample, so is not used
+}
+
+/**
+ * Score a candidate: the number of rows that have its most common non-zero
+ * count, as a fraction of all rows, and that count
+ */
+static double zsv_sniff_score(const struct zsv_sniff_row *rows, size_t row_count, size_t k, unsigned *mode) {
+  size_t best = 0;
+  *mode = 0;
+  for(size_t i = 0; i < row_count; i++) {
+    unsigned n = rows[i].counts[k];
+    if(!n || n == *mode)
+      continue;
+    size_t same = 0;
+    for(size_t j = 0; j < row_count; j++)
+      same += rows[j].counts[k] == n;
+    if(same > best || (same == best && n > *mode)) {
+      best = same;
+      *mode = n;
+    }
+  }
+  return row_count ? (double)best / row_count : 0;
+}
+
+/**
+ * Get the next cell of a row, without any surrounding quotes
+ * @return the position after the cell's delimiter, or NULL if there are no more cells
+ */
+static const unsigned char *zsv_sniff_cell(const unsigned char *s, const unsigned char *end,
+                                           const struct zsv_dialect *d,
+                                           const unsigned char **cell, size_t *cell_len) {
+  if(!s)
+    return NULL;
+  char in_quote = 0;
+  const unsigned char *p = s;
+  for(; p < end && (in_quote || *p != d->delimiter); p++)
+    if(*p == '"' && !d->no_quotes)
+      in_quote = !in_quote;
+  *cell = s;
+  *cell_len = p - s;
+  if(!d->no_quotes && *cell_len >= 2 && **cell == '"' && (*cell)[*cell_len - 1] == '"') {
+    (*cell)++;
+    *cell_len -= 2;
+  }
+  return p < end ? p + 1 : NULL;
+}
+
+static char zsv_sniff_is_number(const unsigned char *s, size_t len) {
+  char digits = 0;
+  for(size_t i = 0; i < len; i++) {
+    if(s[i] >= '0' && s[i] <= '9')
+      digits = 1;
+    else if(!strchr("+-.,eE$% ", s[i]))
+      return 0;
+  }
+  return digits;
+}
+
+/**
+ * Guess whether the first row is a header: for each column, a first-row value
+ * that is text where the other values are numbers, or that is of a different
+ * length where the other values are text of one length, votes for a header,
+ * and a first-row value like the others votes against. Without any votes,
+ * a first row of distinct, non-empty text values is taken to be a header
+ */
+static char zsv_sniff_has_header(const struct zsv_sniff *sn, const struct zsv_dialect *d) {
+  const struct zsv_sniff_row *rows = d->no_quotes ? sn->lines : sn->rows;
+  size_t row_count = d->no_quotes ? sn->line_count : sn->row_count;
+  if(row_count > ZSV_SNIFF_HEADER_ROWS)
+    row_count = ZSV_SNIFF_HEADER_ROWS;
+  if(!row_count)
+    return 0;
+
+  const unsigned char *header_end = rows[0].start + rows[0].len;
+  const unsigned char *header = rows[0].start;
+  const unsigned char *positions[ZSV_SNIFF_HEADER_ROWS];
+  for(size_t i = 1; i < row_count; i++)
+    positions[i] = rows[i].start;
+
+  int votes = 0;
+  char all_text = 1;
+  for(size_t col = 0; header && col < ZSV_SNIFF_HEADER_COLUMNS; col++) {
+    const unsigned char *h;
+    size_t h_len;
+    header = zsv_sniff_cell(header, header_end, d, &h, &h_len);
+    char h_number = zsv_sniff_is_number(h, h_len);
+    if(!h_len || h_number)
+      all_text = 0;
+    else {
+      // a repeated value is not a column name
+      const unsigned char *prev = rows[0].start;
+      for(size_t j = 0; j < col; j++) {
+        const unsigned char *v;
+        size_t v_len;
+        prev = zsv_sniff_cell(prev, header_end, d, &v, &v_len);
+        if(v_len == h_len && !memcmp(v, h, h_len))
+          all_text = 0;
+      }
+    }
+
+    size_t values = 0, numbers = 0, same_len = 0;
+    size_t len = 0;
+    for(size_t i = 1; i < row_count; i++) {
+      const unsigned char *v;
+      size_t v_len;
+      if(!positions[i])
+        continue;
+      positions[i] = zsv_sniff_cell(positions[i], rows[i].start + rows[i].len, d, &v, &v_len);
+      if(!v_len)
+        continue;
+      if(!values++)
+        len = v_len;
+      numbers += zsv_sniff_is_number(v, v_len);
+      same_len += v_len == len;
+    }
+    if(!values)
+      continue;
+    if(numbers == values)
+      votes += h_number ? -1 : 1;
+    else if(!numbers && same_len == values)
+      votes += h_len == len ? -1 : 1;
+  }
+  return votes > 0 || (votes == 0 && all_text && row_count > 1);
+}
+
+ZSV_EXPORT
+struct zsv_dialect zsv_sniff(const unsigned char *buff, size_t len, struct zsv_opts *opts) {
+  struct zsv_dialect d = { 0 };
+  d.delimiter = opts && opts->delimiter ? opts->delimiter : ',';
+  d.no_quotes = opts ? opts->no_quotes > 0 : 0;
+  d.columns = 1;
+
+  size_t bom_len = strlen(ZSV_BOM);
+  if(len >= bom_len && !memcmp(buff, ZSV_BOM, bom_len)) {
+    d.has_bom = 1;
+    buff += bom_len;
+    len -= bom_len;
+  }
+  if(len > ZSV_SNIFF_MAX_LEN)
+    len = ZSV_SNIFF_MAX_LEN;
+  if(!len)
+    return d;
+
+  struct zsv_sniff *sn = calloc(1, sizeof(*sn));
+  if(!sn) {
+    fprintf(stderr, "Out of memory!\n");
+    return d;
+  }
+  zsv_sniff_split(sn, buff, len);
+
+  // the most consistent wins. of equally consistent ones, prefer quote handling
+  // unless it finds no delimiters, then the most columns
+  double best = 0;
+  unsigned best_mode = 0;
+  char best_no_quotes = 0;
+  for(char no_quotes = 0; no_quotes < 2; no_quotes++) {
+    for(size_t k = 0; k < ZSV_SNIFF_DELIM_COUNT; k++) {
+      unsigned mode;
+      double score = no_quotes ? zsv_sniff_score(sn->lines, sn->line_count, k, &mode)
+                               : zsv_sniff_score(sn->rows, sn->row_count, k, &mode);
+      if(mode && (score > best || (score == best && mode > best_mode && no_quotes == best_no_quotes))) {
+        best = score;
+        best_mode = mode;
+        best_no_quotes = no_quotes;
+        d.delimiter = zsv_sniff_delims[k];
+      }
+    }
+  }
+  if(best_mode) {
+    d.no_quotes = best_no_quotes;
+    d.columns = best_mode + 1;
+    if(opts) {
+      opts->delimiter = d.delimiter;
+      opts->no_quotes = d.no_quotes;
+    }
+  }
+  d.rows = d.no_quotes ? sn->line_count : sn->row_count;
+  d.has_header = zsv_sniff_has_header(sn, &d);
+  free(sn);
+  return d;
+}
+
+/**
+ * Apply opts.sniff to the first data to be parsed, and reselect the scanner
+ * for the detected dialect. Not done if an index is in use, as the index is
+ * only valid for the dialect it was built with
+ */
+static void zsv_scanner_sniff(struct zsv_scanner *scanner, const unsigned char *buff, size_t len) {
+  if(!scanner->opts.sniff || scanner->mode != ZSV_MODE_DELIM || scanner->index)
+    return;
+  struct zsv_dialect d = zsv_sniff(buff, len, &scanner->opts);
+  zsv_scanner_select_scan(scanner, &scanner->opts);
+  if(scanner->opts.verbose) {
+    fprintf(stderr, "Sniffed ");
+    if(d.delimiter == '\t')
+      fprintf(stderr, "delimiter: tab");
+    else
+      fprintf(stderr, "delimiter: '%c'", d.delimiter);
+    fprintf(stderr, ", quotes: %s, columns: %zu, header: %s\n", d.no_quotes ? "no" : "yes",
+            d.columns, d.has_header ? "yes" : "no");
+  }
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+/*
+ * Malformed UTF-8 handling (see zsv_set_malformed_utf8_replace())
+ *
+ * Each buffer is validated in bulk when it is scanned, skipping pure-ASCII
+ * data a block at a time, to find the first malformed byte if any. Only the
+ * cell that contains that byte is repaired, after which the search for the
+ * next malformed byte resumes after that cell. So cells of valid data are
+ * never checked one by one
+ *
+ * As with zsv_strencode(), a sequence is valid if its lead byte is followed by
+ * as many continuation bytes as the lead byte indicates
+ */
+
+#define ZSV_UTF8_BLOCK_SIZE 64
+
+/**
+ * Return the length of the sequence at s, 0 if it is malformed, or -1 if it
+ * is cut off by end
+ */
+static inline int zsv_utf8_sequence_len(const unsigned char *s, const unsigned char *end) {
+  int len = ZSV_UTF8_CHARLEN(*s);
+  if(len < 0)
+    return 0;
+  for(int i = 1; i < len; i++) {
+    if(s + i == end)
+      return -1;
+    if(!ZSV_UTF8_SUBSEQUENT_CHAR_OK(s[i]))
+      return 0;
+  }
+  return len;
+}
+
+/**
+ * Return the first malformed byte in [s, end), or NULL if there is none. If
+ * partial_ok is set, a sequence cut off by end is not malformed, as the rest of
+ * it has yet to be read
+ */
+static const unsigned char *zsv_utf8_find_malformed(const unsigned char *s, const unsigned char *end,
+                                                    char partial_ok) {
+  while(s < end) {
+    // skip ascii a block at a time. the fixed-size loop is vectorized by the compiler
+    while(end - s >= ZSV_UTF8_BLOCK_SIZE) {
+      uint64_t w[ZSV_UTF8_BLOCK_SIZE / 8];
+      uint64_t high = 0;
+      memcpy(w, s, sizeof(w));
+      for(int i = 0; i < ZSV_UTF8_BLOCK_SIZE / 8; i++)
+        high |= w[i];
+      if(high & 0x8080808080808080ULL)
+        break;
+      s += ZSV_UTF8_BLOCK_SIZE;
+    }
+
+    // check the next block byte by byte
+    const unsigned char *block_end = end - s > ZSV_UTF8_BLOCK_SIZE ? s + ZSV_UTF8_BLOCK_SIZE : end;
+    while(s < block_end) {
+      if(*s < 128) {
+        s++;
+        continue;
+      }
+      int len = zsv_utf8_sequence_len(s, end);
+      if(len > 0)
+        s += len;
+      else
+        return len < 0 && partial_ok ? NULL : s;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Replace each malformed byte of s with replace, or remove it if replace is 0
+ * Return the new length
+ */
+static size_t zsv_utf8_repair(unsigned char *s, size_t n, unsigned char replace) {
+  size_t new_len = 0;
+  for(size_t i = 0; i < n; ) {
+    int len = s[i] < 128 ? 1 : zsv_utf8_sequence_len(s + i, s + n);
+    if(len > 0) {
+      memmove(s + new_len, s + i, len);
+      new_len += len;
+      i += len;
+    } else {
+      if(replace)
+        s[new_len++] = replace;
+      i++;
+    }
+  }
+  return new_len;
+}